@@ -0,0 +1,323 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  AsyncDelayPipeline.cpp                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <OpenSim/Common/Exception.h>
+#include "AsyncDelayPipeline.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <sstream>
+
+using namespace OpenSim;
+using namespace std;
+
+namespace {
+	// tag of a row slot that holds nothing, and first stale row of a
+	// sample that replaces none
+	const long long NoRow = -1;
+	const long long NothingStale = numeric_limits<long long>::max();
+
+	// sample times the integrator remembers to find the last sample kept
+	// when it steps back; stepping back further makes every row stale
+	const size_t MaxKeptTimes = 64;
+
+	// polls of the other side before a thread goes to sleep
+	const int SpinLimit = 256;
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+AsyncDelayPipeline::AsyncDelayPipeline(const vector<double>& delays,
+	double interval, int queueCapacity) :
+	_numChannels((int)delays.size()),
+	_delays(delays),
+	_minDelay(0),
+	_interval(interval),
+	_queueCapacity(std::max(2, queueCapacity)),
+	_queueHead(0),
+	_queueTail(0),
+	_numRows(0),
+	_numRevisions(0),
+	_numWaits(0),
+	_revisionsApplied(0),
+	_running(true),
+	_workerAsleep(false),
+	_integratorAsleep(false)
+{
+	if(_numChannels == 0)
+		throw Exception("AsyncDelayPipeline: no channels to delay.");
+	_minDelay = *min_element(_delays.begin(), _delays.end());
+	double maxDelay = *max_element(_delays.begin(), _delays.end());
+	if(_minDelay <= 0)
+		throw Exception("AsyncDelayPipeline: every delay must be positive.");
+	if(_interval <= 0 || _interval > _minDelay)
+		throw Exception("AsyncDelayPipeline: the interval must be positive and "
+			"no longer than the shortest delay.");
+
+	for(int c=0; c<_numChannels; ++c)
+		_line.addChannel(to_string((long long)c));
+	_line.requireDelay(maxDelay);
+
+	_queueTimes.resize(_queueCapacity);
+	_queueStaleFrom.resize(_queueCapacity);
+	_queueValues.resize((size_t)_queueCapacity*_numChannels);
+
+	// rows from the fetch time up to the worker's front, with headroom
+	_numRows = 2*(int)ceil(_minDelay/_interval) + 8;
+	_rowTags.reset(new atomic<long long>[_numRows]);
+	_rowValues.reset(new atomic<double>[(size_t)_numRows*_numChannels]);
+	for(int r=0; r<_numRows; ++r)
+		_rowTags[r].store(NoRow, memory_order_relaxed);
+
+	_row0.resize(_numChannels);
+	_row1.resize(_numChannels);
+	_lastValues.resize(_numChannels);
+
+	_worker = std::thread(&AsyncDelayPipeline::run, this);
+}
+
+AsyncDelayPipeline::~AsyncDelayPipeline()
+{
+	_running.store(false);
+	{
+		lock_guard<mutex> lock(_sleepMutex);
+		_workerWake.notify_one();
+	}
+	if(_worker.joinable())
+		_worker.join();
+}
+
+size_t AsyncDelayPipeline::getMemoryBytes() const
+{
+	return (_queueTimes.capacity() + _queueValues.capacity()
+			+ _row0.capacity() + _row1.capacity() + _lastValues.capacity())*sizeof(double)
+		+ _queueStaleFrom.capacity()*sizeof(long long) + _keptTimes.size()*sizeof(double)
+		+ (size_t)_numRows*(sizeof(atomic<long long>)
+			+ _numChannels*sizeof(atomic<double>));
+}
+
+//=============================================================================
+// INTEGRATOR SIDE
+//=============================================================================
+void AsyncDelayPipeline::push(double time, const double* values)
+{
+	long long staleFrom = NothingStale;
+	if(!_keptTimes.empty() && time <= _keptTimes.back()){
+		// the same state sensed again
+		if(time == _keptTimes.back()
+			&& equal(values, values + _numChannels, _lastValues.begin()))
+			return;
+		// another state at this time (an integrator stage) replaces the
+		// sample, and an earlier time (a rejected step) discards the samples
+		// after it. Rows reading only samples up to the last one kept stay
+		// valid; the others lie at least the shortest delay after it (one
+		// row earlier here, against rounding).
+		while(!_keptTimes.empty() && _keptTimes.back() >= time)
+			_keptTimes.pop_back();
+		staleFrom = _keptTimes.empty() ? 0 : std::max(0LL,
+			(long long)floor((_keptTimes.back() + _minDelay)/_interval));
+		dropAppliedRevisions();
+		_pendingRevisions.push_back(make_pair(++_numRevisions, staleFrom));
+	}
+	_keptTimes.push_back(time);
+	if(_keptTimes.size() > MaxKeptTimes)
+		_keptTimes.pop_front();
+	copy(values, values + _numChannels, _lastValues.begin());
+
+	long long tail = _queueTail.load(memory_order_relaxed);
+	// wait for room if the worker has fallen a whole queue behind
+	if(tail - _queueHead.load(memory_order_acquire) >= _queueCapacity)
+		waitForWorker([this, tail]() {
+			return tail - _queueHead.load(memory_order_acquire) < _queueCapacity; });
+
+	int slot = (int)(tail % _queueCapacity);
+	_queueTimes[slot] = time;
+	_queueStaleFrom[slot] = staleFrom;
+	copy(values, values + _numChannels, &_queueValues[(size_t)slot*_numChannels]);
+	_queueTail.store(tail + 1);
+	wakeWorker();
+}
+
+void AsyncDelayPipeline::waitForWorker(const function<bool()>& ready)
+{
+	for(int spin=0; spin<SpinLimit; ++spin){
+		if(ready())
+			return;
+		this_thread::yield();
+	}
+
+	unique_lock<mutex> lock(_sleepMutex);
+	_integratorAsleep.store(true);
+	// pairs with the fence in the worker: either it sees us asleep, or we
+	// see its progress before sleeping
+	atomic_thread_fence(memory_order_seq_cst);
+	_integratorWake.wait(lock, ready);
+	_integratorAsleep.store(false);
+}
+
+void AsyncDelayPipeline::wakeWorker()
+{
+	if(_workerAsleep.load()){
+		lock_guard<mutex> lock(_sleepMutex);
+		_workerWake.notify_one();
+	}
+}
+
+void AsyncDelayPipeline::wakeIntegrator()
+{
+	atomic_thread_fence(memory_order_seq_cst);
+	if(_integratorAsleep.load()){
+		lock_guard<mutex> lock(_sleepMutex);
+		_integratorWake.notify_one();
+	}
+}
+
+bool AsyncDelayPipeline::readRow(long long index, double* row) const
+{
+	const atomic<long long>& tag = _rowTags[index % _numRows];
+	if(tag.load(memory_order_acquire) != index)
+		return false;
+	const atomic<double>* values = &_rowValues[(size_t)(index % _numRows)*_numChannels];
+	for(int c=0; c<_numChannels; ++c)
+		row[c] = values[c].load(memory_order_relaxed);
+	// the worker may have reused the slot while we copied it
+	atomic_thread_fence(memory_order_acquire);
+	return tag.load(memory_order_relaxed) == index;
+}
+
+void AsyncDelayPipeline::dropAppliedRevisions()
+{
+	long long applied = _revisionsApplied.load(memory_order_acquire);
+	while(!_pendingRevisions.empty() && _pendingRevisions.front().first <= applied)
+		_pendingRevisions.pop_front();
+}
+
+void AsyncDelayPipeline::fetch(double time, double* delayed)
+{
+	double position = std::max(0.0, time)/_interval;
+	long long k = (long long)floor(position);
+	double w = position - (double)k;
+
+	// the rows may still hold values from before a replacement the worker
+	// has not applied yet
+	dropAppliedRevisions();
+	long long revision = 0;
+	for(size_t r=0; r<_pendingRevisions.size(); ++r)
+		if(k+1 >= _pendingRevisions[r].second)
+			revision = _pendingRevisions[r].first;
+	if(revision > 0){
+		++_numWaits;
+		waitForWorker([this, revision]() {
+			return _revisionsApplied.load(memory_order_acquire) >= revision; });
+		dropAppliedRevisions();
+	}
+
+	if(!readRow(k, &_row0[0]) || !readRow(k+1, &_row1[0])){
+		++_numWaits;
+		waitForWorker([this, k]() {
+			return readRow(k, &_row0[0]) && readRow(k+1, &_row1[0]); });
+	}
+
+	for(int c=0; c<_numChannels; ++c)
+		delayed[c] = _row0[c] + w*(_row1[c] - _row0[c]);
+}
+
+//=============================================================================
+// WORKER
+//=============================================================================
+void AsyncDelayPipeline::run()
+{
+	long long nextRow = 0;
+	double latest = 0;
+	bool hasSample = false;
+	int idle = 0;
+
+	while(true){
+		long long head = _queueHead.load(memory_order_relaxed);
+		if(head == _queueTail.load(memory_order_acquire)){
+			if(!_running.load(memory_order_acquire))
+				return;
+			if(++idle < SpinLimit){
+				this_thread::yield();
+				continue;
+			}
+			// nothing queued for a while: sleep until push() or the destructor
+			unique_lock<mutex> lock(_sleepMutex);
+			_workerAsleep.store(true);
+			_workerWake.wait(lock, [this, head]() {
+				return _queueTail.load() != head || !_running.load(); });
+			_workerAsleep.store(false);
+			idle = 0;
+			continue;
+		}
+		idle = 0;
+
+		int slot = (int)(head % _queueCapacity);
+		double time = _queueTimes[slot];
+		long long staleFrom = _queueStaleFrom[slot];
+		// the line discards its history after an earlier time
+		for(int c=0; c<_numChannels; ++c)
+			_line.write(time, c, _queueValues[(size_t)slot*_numChannels + c]);
+		_queueHead.store(head + 1, memory_order_release);
+
+		long long first = std::max(0LL, (long long)floor(time/_interval) - 1);
+		if(staleFrom != NothingStale){
+			// withdraw the rows that read replaced samples, and publish them
+			// again from the rows the integrator may still ask for
+			for(long long i=std::max(staleFrom, nextRow - _numRows); i<nextRow; ++i)
+				_rowTags[i % _numRows].store(NoRow, memory_order_relaxed);
+			if(staleFrom < nextRow)
+				nextRow = std::max(staleFrom, first);
+			_revisionsApplied.fetch_add(1, memory_order_release);
+		}
+		else if(!hasSample)
+			nextRow = first;
+		latest = time;
+		hasSample = true;
+
+		// publish every row whose inputs are all in the history
+		while(nextRow*_interval <= latest + _minDelay){
+			double rowTime = nextRow*_interval;
+			int r = (int)(nextRow % _numRows);
+			_rowTags[r].store(NoRow, memory_order_relaxed);
+			atomic_thread_fence(memory_order_release);
+			for(int c=0; c<_numChannels; ++c)
+				_rowValues[(size_t)r*_numChannels + c].store(
+					_line.read(c, rowTime - _delays[c]), memory_order_relaxed);
+			_rowTags[r].store(nextRow, memory_order_release);
+			++nextRow;
+		}
+		// room in the queue, and possibly the rows a fetch is waiting for
+		wakeIntegrator();
+	}
+}
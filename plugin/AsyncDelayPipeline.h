@@ -0,0 +1,174 @@
+#ifndef OPENSIM_AsyncDelayPipeline_H_
+#define OPENSIM_AsyncDelayPipeline_H_
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  AsyncDelayPipeline.h                         *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+#include "SignalDelayLine.h"
+
+namespace OpenSim {
+
+//=============================================================================
+//=============================================================================
+/**
+ * AsyncDelayPipeline delays a set of signals on a worker thread.
+ *
+ * A delayed signal at time t only needs samples at least `delay` seconds
+ * old, so its future values can be computed while the integrator advances.
+ * The integrator thread push()es a sample of every channel and fetch()es the
+ * delayed signals. Samples travel through a lock-free single-producer,
+ * single-consumer queue to the worker, which keeps the history in its own
+ * SignalDelayLine and publishes the delayed signals ahead of time on a
+ * uniform grid of spacing `interval` (no larger than the shortest delay).
+ * fetch() interpolates between two published grid rows, which is constant
+ * time when the worker keeps up; if it lags, fetch() waits for it.
+ *
+ * Neither side burns a core while waiting: the worker polls an empty queue
+ * briefly and then sleeps on a condition variable until push() wakes it,
+ * and push() on a full queue and fetch() missing a row likewise sleep until
+ * the worker has made progress.
+ *
+ * When the integrator steps back in time, or evaluates another state at the
+ * time of the last sample, the history after that time is discarded (or the
+ * sample replaced). Only the rows that read the discarded samples become
+ * stale: those more than the shortest delay after the last sample kept.
+ * The worker publishes them again, and a fetch waits for it only if it
+ * needs one of them, which with steps shorter than the delays it does not.
+ *
+ * Times are assumed non-negative (the grid starts at zero).
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API AsyncDelayPipeline {
+
+public:
+	/** Start a worker for one channel per delay.
+	 *
+	 * @param delays			delay (seconds) of each channel, all positive
+	 * @param interval			spacing (seconds) of the published grid
+	 * @param queueCapacity		samples that can be queued for the worker
+	 */
+	AsyncDelayPipeline(const std::vector<double>& delays, double interval,
+		int queueCapacity = 1024);
+	/** Stop and join the worker. */
+	~AsyncDelayPipeline();
+
+	int getNumChannels() const { return _numChannels; }
+
+	/** Queue a sample of every channel (integrator thread only). A sample at
+	 * the time of the previous one with other values (another integrator
+	 * stage) replaces it, and one at an earlier time discards the samples
+	 * after it, as in the synchronous delay line. The rows that read the
+	 * replaced samples are published again. */
+	void push(double time, const double* values);
+	/** Delayed value of every channel at the given time (integrator thread
+	 * only), i.e. channel i sampled at time - delay_i. */
+	void fetch(double time, double* delayed);
+
+	/** Number of fetches that had to wait for the worker. */
+	long getNumWaits() const { return _numWaits; }
+	/** Bytes held by the queue and the published rows. The worker's history
+	 * is not included, as only the worker may touch it. */
+	size_t getMemoryBytes() const;
+
+private:
+	AsyncDelayPipeline(const AsyncDelayPipeline&);
+	AsyncDelayPipeline& operator=(const AsyncDelayPipeline&);
+
+	// worker thread body
+	void run();
+	// copy the row if it is published; a row slot is tagged with the grid
+	// index of the row it holds
+	bool readRow(long long index, double* row) const;
+	// forget the replacements the worker has applied
+	void dropAppliedRevisions();
+	// integrator side: poll, then sleep, until the worker makes ready true
+	void waitForWorker(const std::function<bool()>& ready);
+	// wake the worker or the integrator if it is asleep
+	void wakeWorker();
+	void wakeIntegrator();
+
+	int _numChannels;
+	std::vector<double> _delays;
+	double _minDelay;
+	double _interval;
+
+	// sample queue: slot k holds time, the first row the sample makes stale
+	// (if it replaces samples) and the channel values
+	int _queueCapacity;
+	std::vector<double> _queueTimes;
+	std::vector<long long> _queueStaleFrom;
+	std::vector<double> _queueValues;
+	std::atomic<long long> _queueHead;	// next slot to pop (worker)
+	std::atomic<long long> _queueTail;	// next slot to push (integrator)
+
+	// published rows of delayed values, a ring indexed by grid index
+	int _numRows;
+	std::unique_ptr<std::atomic<long long>[]> _rowTags;
+	std::unique_ptr<std::atomic<double>[]> _rowValues;
+
+	// integrator side: the latest sample times the worker's history keeps,
+	// the values last pushed, the number of replacements pushed, and the
+	// number and first stale row of those the worker may not have applied
+	std::deque<double> _keptTimes;
+	std::vector<double> _lastValues;
+	long long _numRevisions;
+	std::deque<std::pair<long long, long long> > _pendingRevisions;
+	std::vector<double> _row0, _row1;
+	long _numWaits;
+
+	// worker side
+	SignalDelayLine _line;
+	std::atomic<long long> _revisionsApplied;
+	std::atomic<bool> _running;
+	std::thread _worker;
+
+	// sleeping while the other side has nothing for us
+	std::mutex _sleepMutex;
+	std::condition_variable _workerWake;
+	std::condition_variable _integratorWake;
+	std::atomic<bool> _workerAsleep;
+	std::atomic<bool> _integratorAsleep;
+
+};	// END of class AsyncDelayPipeline
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_AsyncDelayPipeline_H_
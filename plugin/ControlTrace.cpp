@@ -0,0 +1,217 @@
+/* -------------------------------------------------------------------------- *
+ *                        OpenSim:  ControlTrace.cpp                          *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <OpenSim/Common/Exception.h>
+#include "ControlTrace.h"
+
+#include <algorithm>
+#include <cstring>
+
+using namespace OpenSim;
+using namespace std;
+
+namespace {
+	const char TraceMagic[8] = { 'R','F','X','T','R','A','C','E' };
+	const unsigned int TraceVersion = 1;
+	// records searched ahead of the replay cursor for a request's time
+	const int ResyncWindow = 64;
+
+	template <class T>
+	void writeValue(ofstream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <class T>
+	bool readValue(ifstream& in, T& value)
+	{
+		in.read(reinterpret_cast<char*>(&value), sizeof(T));
+		return in.gcount() == sizeof(T);
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ControlTrace::ControlTrace() :
+	_cursor(0)
+{
+}
+
+ControlTrace::~ControlTrace()
+{
+	close();
+}
+
+//=============================================================================
+// RECORDING
+//=============================================================================
+void ControlTrace::openForRecording(const string& fileName,
+	const vector<string>& channelNames)
+{
+	close();
+
+	_out.open(fileName.c_str(), ios::out | ios::binary | ios::trunc);
+	if(!_out.is_open())
+		throw Exception("ControlTrace: could not create trace file " + fileName + ".");
+	_fileName = fileName;
+	_channelNames = channelNames;
+
+	_out.write(TraceMagic, sizeof(TraceMagic));
+	writeValue(_out, TraceVersion);
+	writeValue(_out, (unsigned int)_channelNames.size());
+	for(size_t c=0; c<_channelNames.size(); ++c){
+		writeValue(_out, (unsigned int)_channelNames[c].size());
+		_out.write(_channelNames[c].data(), _channelNames[c].size());
+	}
+}
+
+void ControlTrace::record(double time, const SimTK::Vector& controls)
+{
+	writeValue(_out, time);
+	for(int c=0; c<controls.size(); ++c)
+		writeValue(_out, controls[c]);
+}
+
+void ControlTrace::close()
+{
+	if(_out.is_open()){
+		_out.flush();
+		_out.close();
+	}
+}
+
+//=============================================================================
+// REPLAY
+//=============================================================================
+void ControlTrace::load(const string& fileName)
+{
+	ifstream in(fileName.c_str(), ios::in | ios::binary);
+	if(!in.good())
+		throw Exception("ControlTrace: could not open trace file " + fileName + ".");
+
+	char magic[sizeof(TraceMagic)];
+	unsigned int version = 0, numChannels = 0;
+	in.read(magic, sizeof(magic));
+	if(in.gcount() != sizeof(magic) || memcmp(magic, TraceMagic, sizeof(magic))
+		|| !readValue(in, version) || version != TraceVersion
+		|| !readValue(in, numChannels))
+		throw Exception("ControlTrace: " + fileName + " is not a control trace.");
+
+	_channelNames.clear();
+	for(unsigned int c=0; c<numChannels; ++c){
+		unsigned int length = 0;
+		if(!readValue(in, length))
+			throw Exception("ControlTrace: truncated header in " + fileName + ".");
+		string name(length, ' ');
+		in.read(&name[0], length);
+		_channelNames.push_back(name);
+	}
+
+	_times.clear();
+	_values.clear();
+	_historyRows.clear();
+	_historyTimes.clear();
+	_cursor = 0;
+	vector<double> row(numChannels);
+	double time;
+	while(readValue(in, time)){
+		for(unsigned int c=0; c<numChannels; ++c)
+			if(!readValue(in, row[c]))
+				// a partial record at the end of an interrupted recording
+				return;
+
+		// keep the history the simulation actually followed
+		while(!_historyTimes.empty() && _historyTimes.back() >= time){
+			_historyTimes.pop_back();
+			_historyRows.pop_back();
+		}
+		_historyRows.push_back((int)_times.size());
+		_historyTimes.push_back(time);
+
+		_times.push_back(time);
+		_values.insert(_values.end(), row.begin(), row.end());
+	}
+}
+
+void ControlTrace::replay(double time, const vector<int>& channels,
+	SimTK::Vector& controls)
+{
+	int nr = (int)_times.size();
+	if(_cursor < nr && _times[_cursor] != time){
+		// the requests left the recorded sequence: look a little ahead
+		int end = std::min(nr, _cursor + ResyncWindow);
+		int r = _cursor + 1;
+		while(r < end && _times[r] != time)
+			++r;
+		if(r < end)
+			_cursor = r;
+	}
+
+	if(_cursor < nr && _times[_cursor] == time){
+		int n = (int)_channelNames.size();
+		for(size_t i=0; i<channels.size(); ++i)
+			controls[(int)i] = _values[_cursor*n + channels[i]];
+		++_cursor;
+		return;
+	}
+	interpolate(time, channels, controls);
+}
+
+void ControlTrace::interpolate(double time, const vector<int>& channels,
+	SimTK::Vector& controls) const
+{
+	int n = (int)_channelNames.size();
+	int nr = (int)_historyTimes.size();
+	if(nr == 0){
+		controls = 0;
+		return;
+	}
+
+	// hold the end values outside of the recorded interval
+	int h0 = 0, h1 = 0;
+	if(time <= _historyTimes.front())
+		h0 = h1 = 0;
+	else if(time >= _historyTimes.back())
+		h0 = h1 = nr-1;
+	else{
+		h1 = (int)(upper_bound(_historyTimes.begin(), _historyTimes.end(), time)
+			- _historyTimes.begin());
+		h0 = h1-1;
+	}
+
+	double w = (h1 == h0) ? 0.0
+		: (time - _historyTimes[h0])/(_historyTimes[h1] - _historyTimes[h0]);
+	int r0 = _historyRows[h0], r1 = _historyRows[h1];
+	for(size_t i=0; i<channels.size(); ++i){
+		double v0 = _values[r0*n + channels[i]];
+		double v1 = _values[r1*n + channels[i]];
+		controls[(int)i] = v0 + w*(v1 - v0);
+	}
+}
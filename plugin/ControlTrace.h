@@ -0,0 +1,138 @@
+#ifndef OPENSIM_ControlTrace_H_
+#define OPENSIM_ControlTrace_H_
+/* -------------------------------------------------------------------------- *
+ *                         OpenSim:  ControlTrace.h                           *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <SimTKcommon.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+//=============================================================================
+//=============================================================================
+/**
+ * ControlTrace records the controls a reflex controller produces, one row
+ * per evaluated time, to a compact binary file, and plays them back.
+ *
+ * The file holds a header ("RFXTRACE", format version, number of channels
+ * and the channel names, each as a length-prefixed string) followed by
+ * records of the time and one double per channel. All values are written
+ * in the native byte order.
+ *
+ * Records are written in the order the controller was evaluated and are
+ * loaded in that order, so the stages of an integrator step, which share a
+ * time but not their states, each keep their own controls. replay() follows
+ * the recording request by request: the n-th request at a time is served
+ * the n-th record at that time. Requests that leave the recorded sequence
+ * (another integrator, accuracy or model) fall back to interpolate(), which
+ * interpolates linearly along the monotonic history the recording followed
+ * (a record earlier than its predecessor, where the integrator stepped
+ * back, discards the records after it, and the last record at a time
+ * stands for it) and holds the first and last records outside of the
+ * recorded interval.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ControlTrace {
+
+public:
+	ControlTrace();
+	~ControlTrace();
+
+	//--------------------------------------------------------------------------
+	// RECORDING
+	//--------------------------------------------------------------------------
+	/** Create (or truncate) the trace file and write the header. */
+	void openForRecording(const std::string& fileName,
+		const std::vector<std::string>& channelNames);
+	/** Append the controls evaluated at the given time. */
+	void record(double time, const SimTK::Vector& controls);
+	/** Flush and close the trace file. */
+	void close();
+	bool isRecording() const { return _out.is_open(); }
+
+	//--------------------------------------------------------------------------
+	// REPLAY
+	//--------------------------------------------------------------------------
+	/** Read a trace file written by a recording. */
+	void load(const std::string& fileName);
+	const std::vector<std::string>& getChannelNames() const
+	{	return _channelNames; }
+	int getNumRecords() const { return (int)_times.size(); }
+
+	/** Recorded controls of the given channels for the next request, served
+	 * in evaluation order while the requests follow the recording.
+	 *
+	 * @param time		time of the request
+	 * @param channels	trace channel of each entry of controls
+	 * @param controls	played back controls, one per entry of channels
+	 */
+	void replay(double time, const std::vector<int>& channels,
+		SimTK::Vector& controls);
+	/** Replay from the first record again, as for a new simulation. */
+	void rewind() { _cursor = 0; }
+
+	/** Recorded controls of the given channels, interpolated at the time.
+	 *
+	 * @param time		time at which to play back the controls
+	 * @param channels	trace channel of each entry of controls
+	 * @param controls	played back controls, one per entry of channels
+	 */
+	void interpolate(double time, const std::vector<int>& channels,
+		SimTK::Vector& controls) const;
+
+private:
+	// disallow copies: an open trace file has a single writer
+	ControlTrace(const ControlTrace&);
+	ControlTrace& operator=(const ControlTrace&);
+
+	std::vector<std::string> _channelNames;
+	std::ofstream _out;
+	std::string _fileName;
+
+	// loaded records in evaluation order, row-major
+	std::vector<double> _times;
+	std::vector<double> _values;
+	// records of the monotonic history, and their times, for interpolation
+	std::vector<int> _historyRows;
+	std::vector<double> _historyTimes;
+	// next record to replay
+	int _cursor;
+
+};	// END of class ControlTrace
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ControlTrace_H_
@@ -27,7 +27,9 @@
 // INCLUDES
 //=============================================================================
 #include "DelayedPathReflexController.h"
-#include <OpenSim/Simulation/Model/Muscle.h> 
+#include <OpenSim/Simulation/Model/Muscle.h>
+
+#include <algorithm>
 
 // This allows us to use OpenSim functions, classes, etc., without having to
 // prefix the names of those things with "OpenSim::".
@@ -62,6 +64,9 @@ void DelayedPathReflexController::constructProperties()
 {
 	constructProperty_gain(1.0);
 	constructProperty_delay(0.0);
+	constructProperty_muscle_delays();
+	constructProperty_async(false);
+	constructProperty_async_interval(0.0);
 }
 
 void DelayedPathReflexController::addToSystem(SimTK::MultibodySystem& system) const
@@ -79,29 +84,37 @@ void DelayedPathReflexController::connectToModel(Model &model)
 	Super::connectToModel(model);
 	// get the list of actuators assigned to the reflex controller
 	Set<Actuator>& actuators = updActuators();
-	muscleStretchVelocityHistory.setSize(0);
-	muscleStretchVelocityHistory.setMemoryOwner(true);
-
-	int cnt = 0;
-
-	while (cnt < actuators.getSize()){
-		Muscle *musc = dynamic_cast<Muscle*>(&actuators[cnt]);
-		// control muscles only
-		if (!musc){
-			cout << "DelayedPathReflexController:: WARNING- controller assigned a non-muscle actuator ";
-			cout << actuators[cnt].getName() << " which will be ignored." << endl;
-			actuators.remove(cnt);
-		}
-		else
-		{
-			PiecewiseLinearFunction muscleVelocity;
-			muscleVelocity.setName(musc->getName());
-			muscleStretchVelocityHistory.cloneAndAppend(muscleVelocity);
-			cnt++;
-		}
+	_stretchVelocityLine = SignalDelayLine::getShared(model, "path_stretch_velocity");
+	_channels.clear();
+	_delays.clear();
+
+	// only muscles remain in the actuator set
+	for (int i = 0; i < actuators.getSize(); ++i)
+		_channels.push_back(_stretchVelocityLine->addChannel(actuators[i].getName()));
+
+	int nDelays = getProperty_muscle_delays().size();
+	if (nDelays > 0 && nDelays != actuators.getSize())
+		throw Exception("DelayedPathReflexController: muscle_delays must be empty "
+			"or have one delay per controlled muscle.");
+	for (int i = 0; i < actuators.getSize(); ++i){
+		_delays.push_back(nDelays > 0 ? get_muscle_delays(i) : get_delay());
+		// a negative delay would read ahead of the newest sample
+		if (_delays.back() < 0)
+			throw Exception("DelayedPathReflexController: " + getName()
+				+ " has a negative delay for " + actuators[i].getName() + ".");
+		_stretchVelocityLine->requireDelay(_delays.back());
 	}
 
-
+	// a fresh worker for this connection (copies must not share one)
+	_pipeline.reset();
+	if (get_async() && actuators.getSize() > 0) {
+		double interval = get_async_interval();
+		if (interval <= 0)
+			interval = 0.25*(*min_element(_delays.begin(), _delays.end()));
+		_pipeline.reset(new AsyncDelayPipeline(_delays, interval));
+		_sensed.assign(actuators.getSize(), 0.0);
+		_delayed.assign(actuators.getSize(), 0.0);
+	}
 }
 
 //=============================================================================
@@ -120,10 +133,10 @@ void DelayedPathReflexController::connectToModel(Model &model)
 /**
 * Compute the controls for muscles under influence of this reflex controller
 *
-* @param s			current state of the system
-* @param controls	system wide controls to which this controller can add
+* @param s				current state of the system
+* @param muscleControls	reflex control of each muscle
 */
-void DelayedPathReflexController::computeControls(const State& s, Vector &controls) const
+void DelayedPathReflexController::computeMuscleControls(const State& s, Vector &muscleControls) const
 {
 	//this->realizeDynamics(s);
 	// get time
@@ -132,43 +145,86 @@ void DelayedPathReflexController::computeControls(const State& s, Vector &contro
 	// get the list of actuators assigned to the reflex controller
 	const Set<Actuator>& actuators = getActuatorSet();
 
-	/**/
-	// First must determine each muscles lengthening speed and store it in the measure's result
-	//-----------------------------------------------------------------------------------------
+	// scheduled gain
+	double gain = get_gain()*getGainScale(s);
+
+	//reflex control
+	double control = 0;
+
+	// First must determine each muscles lengthening speed and record it
+	senseStretchVelocities(s);
+
+	if (_pipeline) {
+		// fetch the signals computed ahead
+		_pipeline->fetch(time, &_delayed[0]);
+		for (int i = 0; i < actuators.getSize(); ++i)
+			muscleControls[i] = gain*_delayed[i];
+		return;
+	}
+
+	const SignalDelayLine& line = *_stretchVelocityLine;
+
+	for (int i = 0; i < actuators.getSize(); ++i){
+		// if the delayed signal we need occured earlier than our recorded
+		// history, the delay line reports the signal as zero. A muscle that
+		// has not stretched over the whole delay window needs no lookup.
+		if(line.isZeroFrom(_channels[i], time - _delays[i]))
+			control = 0;
+		else
+			control = gain*line.read(_channels[i], time - _delays[i]);
+
+		muscleControls[i] = control;
+	}
+
+	
+}
+
+size_t DelayedPathReflexController::getInternalStateBytes() const
+{
+	return Super::getInternalStateBytes()
+		+ _channels.capacity()*sizeof(int)
+		+ (_delays.capacity() + _sensed.capacity() + _delayed.capacity())*sizeof(double)
+		+ (_pipeline ? _pipeline->getMemoryBytes() : 0);
+}
+
+void DelayedPathReflexController::recordHistory(const State& s) const
+{
+	senseStretchVelocities(s);
+}
+
+void DelayedPathReflexController::senseStretchVelocities(const State& s) const
+{
+	double time = s.getTime();
+	const Set<Actuator>& actuators = getActuatorSet();
+
 	// muscle lengthening speed
 	double speed = 0;
 	// max muscle lengthening (stretch) speed
 	double max_speed = 0;
-	// normalized and positive (lengthening) path speed
-	double normalized_speed;
-	//reflex control
-	double control = 0;
 
-	//SimTK::Vector normalized_speeds(actuators.getSize()), delayed_speeds(actuators.getSize());
-	
+	if (_pipeline) {
+		// sense every muscle and queue the samples for the worker
+		for (int i = 0; i < actuators.getSize(); ++i){
+			const Muscle *musc = static_cast<const Muscle*>(&actuators[i]);
+			speed = musc->getLengtheningSpeed(s);
+			max_speed = musc->getOptimalFiberLength()*musc->getMaxContractionVelocity();
+			_sensed[i] = 0.5*(fabs(speed) + speed) / max_speed;
+		}
+		_pipeline->push(time, &_sensed[0]);
+		return;
+	}
+
+	SignalDelayLine& line = *_stretchVelocityLine;
+
 	for (int i = 0; i < actuators.getSize(); ++i){
-		const Muscle *musc = dynamic_cast<const Muscle*>(&actuators[i]);
+		// written even if another controller or an earlier integrator stage
+		// sensed this muscle at this time, as the state may differ
+		const Muscle *musc = static_cast<const Muscle*>(&actuators[i]);
 		speed = musc->getLengtheningSpeed(s);
 		// unnormalize muscle's maximum contraction velocity (fib_lengths/sec) 
 		max_speed = musc->getOptimalFiberLength()*musc->getMaxContractionVelocity();
 		// only positive (lengthening) velocity produces a stretch signal
-		normalized_speed = 0.5*(fabs(speed) + speed) / max_speed;
-		muscleStretchVelocityHistory.get(musc->getName()).addPoint(time, normalized_speed);
-		// assume that the number and order of muscles does not change
-		
-        if ((time - get_delay()) < muscleStretchVelocityHistory.get(musc->getName()).getXValues()[0]) {
-            // if the delayed signal we need occured earlier than our recorded history, asume the signal is zero
-            control = 0;
-        }
-        else {
-            control = get_gain()*muscleStretchVelocityHistory.get(musc->getName()).calcValue(SimTK::Vector(1, time - get_delay()));
-        }
-
-		SimTK::Vector actControls(1, control);
-		// add reflex controls to whatever controls are already in place.
-		musc->addInControls(actControls, controls);
+		line.write(time, _channels[i], 0.5*(fabs(speed) + speed) / max_speed);
 	}
-
-	
 }
 
@@ -27,12 +27,13 @@
 //============================================================================
 // INCLUDE
 //============================================================================
-#include "OpenSim\Simulation\Control\Controller.h"
-#include "OpenSim\Common\PiecewiseLinearFunction.h"
-#include "OpenSim\Simulation\Model\Model.h"
+#include "OpenSim/Simulation/Model/Model.h"
 
 // to export class as part of a plugin:
 #include "osimReflexesDLL.h" 
+#include "MuscleReflexController.h"
+#include "SignalDelayLine.h"
+#include "AsyncDelayPipeline.h"
 
 namespace OpenSim {
 
@@ -49,10 +50,22 @@ namespace OpenSim {
 	* to implement a controller in OpenSim. It is intended for demonstrative 
 	* purposes only.
 	*
+	* Each muscle may have its own delay (muscle_delays), e.g. short for hip
+	* muscles and long for the distal shank. Stretch velocities are kept in a
+	* SignalDelayLine shared by all controllers of the model, so several
+	* delayed controllers on the same muscles store each signal once.
+	*
+	* In async mode the delayed signals are instead computed ahead of time on
+	* a worker thread (see AsyncDelayPipeline) that overlaps the integrator:
+	* each call only senses and queues the stretch velocities and fetches the
+	* already delayed signals. Every delay must then be positive. The signals
+	* are published every async_interval and interpolated in between, and
+	* they are not shared with other controllers.
+	*
 	* @author  Matt DeMers
 	*/
-	class OSIMREFLEXES_API DelayedPathReflexController : public Controller {
-		OpenSim_DECLARE_CONCRETE_OBJECT(DelayedPathReflexController, Controller);
+	class OSIMREFLEXES_API DelayedPathReflexController : public MuscleReflexController {
+		OpenSim_DECLARE_CONCRETE_OBJECT(DelayedPathReflexController, MuscleReflexController);
 
 	public:
 		//=============================================================================
@@ -65,6 +78,15 @@ namespace OpenSim {
 			"Factor by which the stretch reflex is scaled.");
 		OpenSim_DECLARE_PROPERTY(delay, double,
 			"Time delay (seconds) between the musle stretch and the stretch reflex signal");
+		OpenSim_DECLARE_LIST_PROPERTY(muscle_delays, double,
+			"Per muscle time delays (seconds), in actuator order, overriding delay."
+			" Leave empty to apply delay to every muscle.");
+		OpenSim_DECLARE_PROPERTY(async, bool,
+			"Compute the delayed signals on a worker thread while the integrator "
+			"advances.");
+		OpenSim_DECLARE_PROPERTY(async_interval, double,
+			"Spacing (seconds) of the signals computed ahead in async mode, no "
+			"longer than the shortest delay. 0 uses a quarter of the shortest delay.");
 
 		//=============================================================================
 		// METHODS
@@ -84,13 +106,29 @@ namespace OpenSim {
 		*/
 		DelayedPathReflexController(double gain, double delay);
 
-		/** Compute the controls for actuators (muscles)
+		/** Compute the controls for muscles
 		*  This method defines the behavior of the DelayedPathReflexController
 		*
-		* @param s			system state
-		* @param controls	writable model controls
+		* @param s					system state
+		* @param muscleControls	reflex control of each muscle
 		*/
-		void computeControls(const SimTK::State& s, SimTK::Vector &controls) const override;
+		void computeMuscleControls(const SimTK::State& s,
+			SimTK::Vector &muscleControls) const OVERRIDE_11;
+
+		/** Controls are read from the stretch velocity history. */
+		bool dependsOnHistory() const OVERRIDE_11 { return true; }
+
+		/** Sense the stretch velocities into the history only. */
+		void recordHistory(const SimTK::State& s) const OVERRIDE_11;
+
+		/** The shared stretch velocity line (none in async mode, where the
+		 * worker keeps the history). */
+		SignalDelayLine* getSensorHistory() const OVERRIDE_11
+		{	return _pipeline ? NULL : _stretchVelocityLine.get(); }
+
+		/** Delay (seconds) of the index-th muscle, in actuator order, once
+		 * connected to the model. */
+		double getMuscleDelay(int index) const { return _delays[index]; }
 
 
 	private:
@@ -100,11 +138,24 @@ namespace OpenSim {
 		void addToSystem(SimTK::MultibodySystem& system) const;
 		// ModelComponent interface to connect this component to its model
 		void connectToModel(Model& aModel);
+		// write the sensed stretch velocities to the delay line, or queue
+		// them for the async worker
+		void senseStretchVelocities(const SimTK::State& s) const;
+		// per-muscle buffers and the async queue
+		size_t getInternalStateBytes() const OVERRIDE_11;
 		//=============================================================================
 		// Private Members
 		//=============================================================================
-		mutable OpenSim::Set<PiecewiseLinearFunction> muscleStretchVelocityHistory;
-        //mutable OpenSim::Set<PiecewiseLinearFunction> delayedMuscleStretchVelocityHistory;
+		// normalized stretch velocity history shared with other controllers
+		std::shared_ptr<SignalDelayLine> _stretchVelocityLine;
+		// delay line channel and delay of each muscle, in actuator order
+		std::vector<int> _channels;
+		std::vector<double> _delays;
+
+		// async mode worker, and the sensed and delayed signals of a call
+		std::shared_ptr<AsyncDelayPipeline> _pipeline;
+		mutable std::vector<double> _sensed;
+		mutable std::vector<double> _delayed;
 		
 		//=============================================================================
 	};	// END of class DelayedPathReflexController
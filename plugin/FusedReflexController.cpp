@@ -0,0 +1,370 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  FusedReflexController.cpp                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "FusedReflexController.h"
+#include "ReflexController.h"
+#include "MusclePathStretchController.h"
+#include "MuscleFiberStretchController.h"
+
+#include <algorithm>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// positive part of a signal
+	inline double positive(double x) { return 0.5*(fabs(x) + x); }
+
+	// name of the FusedReflexController a controller is fused into, or empty
+	const string& fusedIntoName(const Controller& controller)
+	{
+		static const string none;
+		if(const MuscleReflexController* reflex =
+				dynamic_cast<const MuscleReflexController*>(&controller))
+			return reflex->getFusedInto();
+		if(const FusedPrescribedController* prescribed =
+				dynamic_cast<const FusedPrescribedController*>(&controller))
+			return prescribed->getFusedInto();
+		return none;
+	}
+
+	void markFused(Controller& controller, const Controller* fused)
+	{
+		if(MuscleReflexController* reflex =
+				dynamic_cast<MuscleReflexController*>(&controller))
+			reflex->setFusedInto(fused);
+		else if(FusedPrescribedController* prescribed =
+				dynamic_cast<FusedPrescribedController*>(&controller))
+			prescribed->setFusedInto(fused);
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+//_____________________________________________________________________________
+/* Default constructor. */
+FusedReflexController::FusedReflexController()
+{
+	constructProperties();
+}
+
+
+/*
+ * Construct Properties
+ */
+void FusedReflexController::constructProperties()
+{
+	constructProperty_controller_list();
+}
+
+bool FusedReflexController::dependsOnAuxiliaryStates() const
+{
+	return find(_sensesFiber.begin(), _sensesFiber.end(), true) != _sensesFiber.end();
+}
+
+bool FusedReflexController::isFusable(const Controller& controller,
+	const Model& model)
+{
+	const string& type = controller.getConcreteClassName();
+
+	if(type == "ReflexController" || type == "MusclePathStretchController"
+		|| type == "MuscleFiberStretchController"){
+		// the per-controller options would change the summed controls
+		const MuscleReflexController& reflex =
+			static_cast<const MuscleReflexController&>(controller);
+		if(reflex.get_update_interval() != 0 || reflex.get_trace_mode() != "off"
+			|| reflex.getProperty_gate_forces().size() > 0
+			|| reflex.getProperty_gain_schedule().size() > 0)
+			return false;
+		if(type == "ReflexController")
+			return !static_cast<const ReflexController&>(controller)
+				.get_use_path_surrogate();
+		if(type == "MuscleFiberStretchController")
+			return static_cast<const MuscleFiberStretchController&>(controller)
+				.get_spindle_sensor().empty();
+		return !static_cast<const MusclePathStretchController&>(controller)
+			.get_use_path_surrogate();
+	}
+
+	if(type == "PrescribedController"){
+		// constant controls of muscles only, added as fixed offsets
+		const PrescribedController& prescribed =
+			static_cast<const PrescribedController&>(controller);
+		const FunctionSet& functions = prescribed.get_ControlFunctions();
+		int n = prescribed.getProperty_actuator_list().size();
+		if(n == 0 || functions.getSize() != n)
+			return false;
+		for(int i=0; i<n; ++i){
+			if(!model.getMuscles().contains(prescribed.get_actuator_list(i)))
+				return false;
+			if(!dynamic_cast<const Constant*>(&functions[i]))
+				return false;
+		}
+		return true;
+	}
+
+	return false;
+}
+
+void FusedReflexController::findControlledMuscles(const Controller& controller,
+	const Model& model, vector<string>& names)
+{
+	const Set<Muscle>& muscles = model.getMuscles();
+	names.clear();
+
+	int n = controller.getProperty_actuator_list().size();
+	for(int i=0; i<n; ++i){
+		const string& name = controller.get_actuator_list(i);
+		if(name == "ALL"){
+			names.clear();
+			for(int m=0; m<muscles.getSize(); ++m)
+				names.push_back(muscles[m].getName());
+			return;
+		}
+		// reflex controllers ignore non-muscle actuators
+		if(muscles.contains(name))
+			names.push_back(name);
+	}
+}
+
+void FusedReflexController::connectToModel(Model &model)
+{
+	ControllerSet& controllers = model.updControllerSet();
+
+	if(getProperty_actuator_list().size() > 0)
+		throw Exception("FusedReflexController: actuator_list must be empty; "
+			"the controller acts on the muscles of the controllers it fuses.");
+
+	// release the controllers taken over when last connected
+	for(int c=0; c<controllers.getSize(); ++c){
+		if(fusedIntoName(controllers[c]) == getName())
+			markFused(controllers[c], NULL);
+	}
+
+	// pick every compatible controller unless told which to fuse
+	vector<string> names;
+	if(getProperty_controller_list().size() == 0){
+		// a disabled controller takes over nothing it was not told to
+		for(int c=0; c<controllers.getSize() && !isDisabled(); ++c){
+			if(&controllers[c] != this && !controllers[c].isDisabled()
+				&& isFusable(controllers[c], model)
+				&& fusedIntoName(controllers[c]).empty())
+				names.push_back(controllers[c].getName());
+		}
+	}
+	else{
+		for(int c=0; c<getProperty_controller_list().size(); ++c)
+			names.push_back(get_controller_list(c));
+	}
+
+	_sources.clear();
+	_kinds.clear();
+	vector<Controller*> sources;
+	vector<vector<string> > sourceMuscles;
+	for(size_t c=0; c<names.size(); ++c){
+		const string& name = names[c];
+		if(!controllers.contains(name))
+			throw Exception("FusedReflexController: controller " + name
+				+ " not found in the model.");
+		Controller* controller = &controllers.get(name);
+		if(controller == this || !isFusable(*controller, model))
+			throw Exception("FusedReflexController: controller " + name
+				+ " cannot be fused.");
+		if(!fusedIntoName(*controller).empty())
+			throw Exception("FusedReflexController: controller " + name
+				+ " is already fused into " + fusedIntoName(*controller) + ".");
+
+		string type = controller->getConcreteClassName();
+		if(type == "PrescribedController"
+			&& !dynamic_cast<FusedPrescribedController*>(controller)){
+			// put a controller that can be marked in its place; the set
+			// deletes the original
+			FusedPrescribedController* prescribed = new FusedPrescribedController(
+				static_cast<const PrescribedController&>(*controller));
+			controllers.set(controllers.getIndex(name), prescribed);
+			controller = prescribed;
+		}
+
+		sources.push_back(controller);
+		_sources.push_back(controller);
+		if(type == "ReflexController")
+			_kinds.push_back(PathVelocity);
+		else if(type == "MusclePathStretchController")
+			_kinds.push_back(PathStretch);
+		else if(type == "MuscleFiberStretchController")
+			_kinds.push_back(FiberStretch);
+		else
+			_kinds.push_back(Prescribed);
+
+		sourceMuscles.push_back(vector<string>());
+		findControlledMuscles(*controller, model, sourceMuscles.back());
+	}
+
+	// act on the union of the sources' muscles, in model order. The set
+	// does not own them, and with actuator_list empty the base class keeps it.
+	Set<Actuator>& fusedActuators = updActuators();
+	fusedActuators.setMemoryOwner(false);
+	fusedActuators.setSize(0);
+	const Set<Muscle>& muscles = model.getMuscles();
+	for(int m=0; m<muscles.getSize(); ++m){
+		const string& name = muscles[m].getName();
+		for(size_t c=0; c<sourceMuscles.size(); ++c){
+			if(find(sourceMuscles[c].begin(), sourceMuscles[c].end(), name)
+				!= sourceMuscles[c].end()){
+				fusedActuators.adoptAndAppend(&model.updActuators().get(name));
+				break;
+			}
+		}
+	}
+
+	Super::connectToModel(model);
+
+	// the fused pass replaces the sources' own evaluation while this
+	// controller is enabled
+	for(size_t c=0; c<sources.size(); ++c)
+		markFused(*sources[c], this);
+
+	const Set<Actuator>& actuators = getActuatorSet();
+	int nm = actuators.getSize();
+	int ns = (int)_sources.size();
+
+	_muscles.resize(nm);
+	_optimalLength.resize(nm);
+	_tendonSlackLength.resize(nm);
+	_maxSpeed.resize(nm);
+	_constant.assign(nm, 0.0);
+	_sensesPath.assign(nm, false);
+	_sensesFiber.assign(nm, false);
+	for(int i=0; i<nm; ++i){
+		const Muscle& musc = static_cast<const Muscle&>(actuators[i]);
+		_muscles[i] = &musc;
+		_optimalLength[i] = musc.getOptimalFiberLength();
+		_tendonSlackLength[i] = musc.getTendonSlackLength();
+		// unnormalize muscle's maximum contraction velocity (fib_lengths/sec)
+		_maxSpeed[i] = _optimalLength[i]*musc.getMaxContractionVelocity();
+	}
+
+	// contributions of each source onto each muscle, sorted by muscle while
+	// keeping the source order
+	vector<int> count(nm, 0);
+	vector<pair<int,int> > pairs;
+	for(int c=0; c<ns; ++c){
+		for(size_t k=0; k<sourceMuscles[c].size(); ++k){
+			int i = actuators.getIndex(sourceMuscles[c][k]);
+			if(_kinds[c] == Prescribed){
+				const PrescribedController& prescribed =
+					static_cast<const PrescribedController&>(*_sources[c]);
+				_constant[i] += prescribed.get_ControlFunctions()[(int)k]
+					.calcValue(SimTK::Vector(1, 0.0));
+				continue;
+			}
+			pairs.push_back(make_pair(i, c));
+			++count[i];
+			if(_kinds[c] == FiberStretch)
+				_sensesFiber[i] = true;
+			else
+				_sensesPath[i] = true;
+		}
+	}
+
+	_offsets.assign(nm+1, 0);
+	for(int i=0; i<nm; ++i)
+		_offsets[i+1] = _offsets[i] + count[i];
+	_contributions.resize(pairs.size());
+	vector<int> next(_offsets.begin(), _offsets.end()-1);
+	for(size_t p=0; p<pairs.size(); ++p)
+		_contributions[next[pairs[p].first]++] = pairs[p].second;
+}
+
+//=============================================================================
+// COMPUTATIONS
+//=============================================================================
+//_____________________________________________________________________________
+/**
+ * Compute the summed controls of the fused controllers
+ *
+ * @param s				current state of the system
+ * @param muscleControls	summed control of each muscle
+ */
+void FusedReflexController::computeMuscleControls(const State& s, Vector &muscleControls) const
+{
+	int nm = (int)_muscles.size();
+
+	for(int i=0; i<nm; ++i){
+		double control = _constant[i];
+
+		if(_offsets[i] != _offsets[i+1]){
+			const Muscle& musc = *_muscles[i];
+			double f_o = _optimalLength[i];
+
+			// read each sensor of the muscle once
+			double pathLength = 0, pathSpeed = 0;
+			double fiberLength = 0, fiberSpeed = 0;
+			if(_sensesPath[i]){
+				pathLength = musc.getLength(s);
+				pathSpeed = positive(musc.getLengtheningSpeed(s))/_maxSpeed[i];
+			}
+			if(_sensesFiber[i]){
+				fiberLength = musc.getFiberLength(s);
+				fiberSpeed = positive(musc.getFiberVelocity(s))/_maxSpeed[i];
+			}
+
+			for(int k=_offsets[i]; k<_offsets[i+1]; ++k){
+				int c = _contributions[k];
+				// parameters are read from the source, nothing is written, so
+				// the controls can be computed at several states at once
+				if(_kinds[c] == PathVelocity){
+					control += static_cast<const ReflexController*>(_sources[c])
+						->get_gain()*pathSpeed;
+					continue;
+				}
+				const MusclePathStretchController& stretch =
+					*static_cast<const MusclePathStretchController*>(_sources[c]);
+				double rest = stretch.get_normalized_rest_length();
+				if(_kinds[c] == PathStretch)
+					control += stretch.get_gain_length()
+						*positive(pathLength - rest*(f_o + _tendonSlackLength[i]))/f_o
+						+ stretch.get_gain_velocity()*pathSpeed;
+				else
+					control += stretch.get_gain_length()*positive(fiberLength - rest*f_o)/f_o
+						+ stretch.get_gain_velocity()*fiberSpeed;
+			}
+		}
+
+		muscleControls[i] = control;
+	}
+}
@@ -0,0 +1,216 @@
+#ifndef OPENSIM_FusedReflexController_H_
+#define OPENSIM_FusedReflexController_H_
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  FusedReflexController.h                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <OpenSim/Simulation/Control/PrescribedController.h>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+#include "MuscleReflexController.h"
+
+namespace OpenSim {
+
+class Muscle;
+
+//=============================================================================
+//=============================================================================
+/**
+ * FusedReflexController evaluates several controllers of the model in a
+ * single pass over their muscles.
+ *
+ * When connected to the model it takes over the other controllers of the
+ * ControllerSet named in controller_list, or, if the list is empty, every
+ * enabled controller that it can fuse. It acts on the union of their
+ * muscles and each call reads the sensors of each muscle once and adds up
+ * the contributions of every fused controller, instead of each controller
+ * walking its own actuators and adding in its controls separately.
+ *
+ * The fused plan is kept in the controller; the model's properties are left
+ * as they were, so a model printed after initSystem() reads back the same.
+ * The fused controllers stay enabled but are marked as evaluated by this
+ * controller (see MuscleReflexController::isFused()) and add nothing of
+ * their own while it is enabled. The mark is checked on every call, so
+ * disabling this controller hands the muscles back to them at once.
+ * actuator_list must be left empty. If controller_list is empty and this
+ * controller is disabled when connected, it fuses nothing.
+ *
+ * Controllers that can be fused:
+ *  - ReflexController without a path surrogate,
+ *  - MusclePathStretchController without a path surrogate,
+ *  - MuscleFiberStretchController without a spindle sensor,
+ * each with update_interval 0, trace_mode off, no gate_forces and no
+ * gain_schedule,
+ *  - PrescribedController with a Constant function for each of its
+ *    actuators, all of them muscles,
+ * and not fused into another FusedReflexController.
+ *
+ * Reflex gains and rest lengths are read from the fused controllers on
+ * every call, so changing them later still takes effect. The constants of
+ * the prescribed controllers are read when connected and added to their
+ * muscles as fixed offsets. To be marked, a fused PrescribedController is
+ * replaced in the ControllerSet by a FusedPrescribedController with the
+ * same name and properties, so references to it taken before initSystem()
+ * are no longer valid.
+ *
+ * @author  Matt DeMers
+ * @version 1.0
+ */
+class OSIMREFLEXES_API FusedReflexController : public MuscleReflexController {
+OpenSim_DECLARE_CONCRETE_OBJECT(FusedReflexController, MuscleReflexController);
+
+public:
+//=============================================================================
+// PROPERTIES
+//=============================================================================
+    /** @name Property declarations
+    These are the serializable properties associated with a FusedReflexController.*/
+    /**@{**/
+	OpenSim_DECLARE_LIST_PROPERTY(controller_list, std::string,
+		"Names of the controllers evaluated by this controller. Leave empty to "
+		"fuse every compatible enabled controller of the model.");
+
+//=============================================================================
+// METHODS
+//=============================================================================
+	//--------------------------------------------------------------------------
+	// CONSTRUCTION AND DESTRUCTION
+	//--------------------------------------------------------------------------
+	/** Default constructor. */
+	FusedReflexController();
+	// Uses default (compiler-generated) destructor, copy constructor and copy
+    // assignment operator.
+
+	/** Compute the controls for muscles
+	 *  This method defines the behavior for FusedReflexController controller
+	 *
+	 * @param s					system state
+	 * @param muscleControls	summed control of each muscle
+	 */
+	void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector &muscleControls) const OVERRIDE_11;
+
+	/** True if any fused controller senses fibers, which are
+	 *  auxiliary states. */
+	bool dependsOnAuxiliaryStates() const OVERRIDE_11;
+
+	/** True if the controller can be fused into a FusedReflexController. */
+	static bool isFusable(const Controller& controller, const Model& model);
+
+	/** Number of controllers fused, once connected to the model. */
+	int getNumFusedControllers() const { return (int)_sources.size(); }
+	/** Name of the index-th fused controller, once connected to the model. */
+	const std::string& getFusedControllerName(int index) const
+	{	return _sources[index]->getName(); }
+
+private:
+	// Connect properties to local pointers.  */
+	void constructProperties();
+	// ModelComponent interface to connect this component to its model
+	void connectToModel(Model& aModel);
+
+	enum SourceKind { PathVelocity, PathStretch, FiberStretch, Prescribed };
+
+	// names of the model muscles a controller acts on
+	static void findControlledMuscles(const Controller& controller,
+		const Model& model, std::vector<std::string>& names);
+
+	//=============================================================================
+	// Private Members
+	//=============================================================================
+	// fused controllers
+	std::vector<const Controller*> _sources;
+	std::vector<SourceKind> _kinds;
+
+	// per muscle constants
+	std::vector<const Muscle*> _muscles;
+	std::vector<double> _optimalLength;
+	std::vector<double> _tendonSlackLength;
+	std::vector<double> _maxSpeed;
+	std::vector<double> _constant;
+	std::vector<bool> _sensesPath;
+	std::vector<bool> _sensesFiber;
+
+	// reflex contributions onto each muscle in compressed row form: the
+	// sources acting on muscle i are _contributions[_offsets[i].._offsets[i+1])
+	std::vector<int> _offsets;
+	std::vector<int> _contributions;
+
+	//=============================================================================
+};	// END of class FusedReflexController
+
+//=============================================================================
+//=============================================================================
+/**
+ * FusedPrescribedController is the PrescribedController a
+ * FusedReflexController puts in place of one it fuses. It adds no controls
+ * while marked as evaluated by an enabled FusedReflexController, and
+ * otherwise behaves as the controller it replaces.
+ *
+ * It is not a concrete object of its own: it prints, reads back and clones
+ * as a plain PrescribedController, so a copy of the model is fused anew
+ * when connected.
+ */
+class OSIMREFLEXES_API FusedPrescribedController : public PrescribedController {
+public:
+	/** Take the place of prescribed, which must have been connected to the
+	 *  model already or be connected through this controller. */
+	explicit FusedPrescribedController(const PrescribedController& prescribed) :
+		PrescribedController(prescribed),
+		_fusedController(NULL)
+	{
+		setActuators(prescribed.getActuatorSet());
+	}
+
+	/** Prescribed controls, unless fused. */
+	void computeControls(const SimTK::State& s,
+		SimTK::Vector& controls) const OVERRIDE_11
+	{
+		if(!isFused())
+			PrescribedController::computeControls(s, controls);
+	}
+
+	/** Name of the FusedReflexController evaluating this controller, or
+	 *  empty. */
+	const std::string& getFusedInto() const { return _fusedInto; }
+	void setFusedInto(const Controller* fused)
+	{	_fusedInto = fused ? fused->getName() : ""; _fusedController = fused; }
+	/** True while the FusedReflexController evaluating this controller is
+	 *  enabled. */
+	bool isFused() const
+	{	return _fusedController && !_fusedController->isDisabled(); }
+
+private:
+	std::string _fusedInto;
+	const Controller* _fusedController;
+};	// END of class FusedPrescribedController
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_FusedReflexController_H_
@@ -0,0 +1,76 @@
+/* -------------------------------------------------------------------------- *
+ *                         OpenSim:  GainSchedule.cpp                         *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <OpenSim/OpenSim.h>
+#include "GainSchedule.h"
+
+using namespace OpenSim;
+using namespace std;
+
+
+//=============================================================================
+// CONSTRUCTOR(S)
+//=============================================================================
+GainSchedule::GainSchedule() :
+	_start(0),
+	_end(0),
+	_inverseSpacing(0),
+	_last(0)
+{
+}
+
+//=============================================================================
+// TABULATION
+//=============================================================================
+void GainSchedule::sample(const Function& function, double start, double end,
+	int numSamples)
+{
+	if(!(end > start))
+		throw Exception("GainSchedule: the schedule interval is empty.");
+	if(numSamples < 2)
+		throw Exception("GainSchedule: a schedule needs at least 2 samples.");
+
+	_start = start;
+	_end = end;
+	_last = numSamples - 1;
+	_inverseSpacing = _last/(end - start);
+
+	_values.resize(numSamples);
+	SimTK::Vector x(1);
+	for(int i=0; i<numSamples; ++i){
+		// the last sample lands exactly on end
+		x[0] = i < numSamples-1 ? start + i/_inverseSpacing : end;
+		_values[i] = function.calcValue(x);
+	}
+}
+
+void GainSchedule::clear()
+{
+	_values.clear();
+	_start = _end = _inverseSpacing = _last = 0;
+}
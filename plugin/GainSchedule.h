@@ -0,0 +1,95 @@
+#ifndef OPENSIM_GainSchedule_H_
+#define OPENSIM_GainSchedule_H_
+/* -------------------------------------------------------------------------- *
+ *                          OpenSim:  GainSchedule.h                          *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+class Function;
+
+//=============================================================================
+//=============================================================================
+/**
+ * GainSchedule is a gain profile tabulated for fast lookup during a
+ * simulation. A Function of a schedule variable (time, gait or landing
+ * phase, a joint angle) is sampled once, at uniformly spaced values of the
+ * variable, so that a lookup is an indexed linear interpolation instead of
+ * a Function evaluation. Outside the tabulated interval the end values hold.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API GainSchedule {
+
+public:
+	GainSchedule();
+
+	/** Tabulate the function at numSamples uniformly spaced values of the
+	 * schedule variable from start to end. */
+	void sample(const Function& function, double start, double end,
+		int numSamples);
+	/** Discard the table. */
+	void clear();
+	/** True if no function has been tabulated. */
+	bool empty() const { return _values.empty(); }
+
+	/** Scheduled value at x. */
+	double getValue(double x) const
+	{
+		double u = (x - _start)*_inverseSpacing;
+		if(!(u > 0))
+			return _values.front();
+		if(u >= _last)
+			return _values.back();
+		int i = (int)u;
+		double w = u - i;
+		return (1 - w)*_values[i] + w*_values[i+1];
+	}
+
+	double getStart() const { return _start; }
+	double getEnd() const { return _end; }
+	int getNumSamples() const { return (int)_values.size(); }
+
+private:
+	double _start;
+	double _end;
+	double _inverseSpacing;
+	// index of the last sample, as a double
+	double _last;
+	std::vector<double> _values;
+
+};	// END of class GainSchedule
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_GainSchedule_H_
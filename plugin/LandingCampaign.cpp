@@ -0,0 +1,401 @@
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  LandingCampaign.cpp                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "LandingCampaign.h"
+#include "MuscleReflexController.h"
+#include "ReflexEquilibriumSolver.h"
+#include "SpinalNetworkReflexController.h"
+
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// splitmix64 finalizer: a bijective mix of a 64 bit counter
+	unsigned long long splitmix64(unsigned long long x)
+	{
+		x += 0x9E3779B97F4A7C15ULL;
+		x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ULL;
+		x = (x ^ (x >> 27))*0x94D049BB133111EBULL;
+		return x ^ (x >> 31);
+	}
+
+	// order of the random draws of a scenario
+	enum Draw { DrawPlatformRX, DrawPlatformRZ, DrawDropHeight, DrawGainScale };
+
+	// reflex gain properties scaled by the campaign
+	const char* GainProperties[] = { "gain", "gain_length", "gain_velocity" };
+
+	// set a coordinate even if it is locked, keeping it locked at the new value
+	void setCoordinate(const Coordinate& coord, State& s, double value)
+	{
+		bool locked = coord.getLocked(s);
+		if(locked)
+			coord.setLocked(s, false);
+		coord.setValue(s, value, false);
+		if(locked)
+			coord.setLocked(s, true);
+	}
+}
+
+
+//=============================================================================
+// WORKER
+//=============================================================================
+// scenarios waiting to be run by a worker
+struct LandingCampaign::Queue {
+	std::mutex mutex;
+	std::deque<int> scenarios;
+};
+
+// A worker's own copy of the model and the handles it needs to set up and
+// measure a landing.
+class LandingCampaign::Worker {
+public:
+	Worker(const Model& model, const LandingCampaign& campaign, int index) :
+		_campaign(campaign),
+		_model(model.clone())
+	{
+		// workers recording control traces each write their own files
+		ControllerSet& controllers = _model->updControllerSet();
+		for(int i=0; i<controllers.getSize(); ++i)
+			if(MuscleReflexController* reflex =
+					dynamic_cast<MuscleReflexController*>(&controllers[i]))
+				reflex->tagTraceFile("worker" + to_string(index));
+
+		_defaultState = _model->initSystem();
+
+		_rx = &_model->getCoordinateSet().get(campaign._rxCoordinate);
+		_rz = &_model->getCoordinateSet().get(campaign._rzCoordinate);
+		_height = &_model->getCoordinateSet().get(campaign._heightCoordinate);
+		_defaultHeight = _height->getValue(_defaultState);
+
+		for(size_t i=0; i<campaign._contactForces.size(); ++i)
+			_contacts.push_back(&_model->getForceSet().get(campaign._contactForces[i]));
+
+		// remember the nominal gains of every reflex
+		for(int i=0; i<controllers.getSize(); ++i){
+			if(const MuscleReflexController* reflex =
+					dynamic_cast<const MuscleReflexController*>(&controllers[i]))
+				_reflexes.push_back(reflex);
+			// network couplings are scaled through their weight scale
+			if(SpinalNetworkReflexController* network =
+					dynamic_cast<SpinalNetworkReflexController*>(&controllers[i]))
+				_networks.push_back(network);
+			for(size_t g=0; g<sizeof(GainProperties)/sizeof(GainProperties[0]); ++g){
+				if(!controllers[i].hasProperty(GainProperties[g]))
+					continue;
+				Property<double>& gain =
+					Property<double>::updAs(controllers[i].updPropertyByName(GainProperties[g]));
+				_gains.push_back(&gain);
+				_nominalGains.push_back(gain.getValue());
+			}
+		}
+
+		if(campaign._reflexEquilibrium)
+			_equilibrium.reset(new ReflexEquilibriumSolver(*_model));
+	}
+
+	Summary simulate(const Scenario& scenario)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		Summary summary;
+		summary.scenario = scenario;
+		summary.completed = false;
+		summary.finalTime = 0;
+		summary.minHeight = SimTK::Infinity;
+		summary.peakDescentSpeed = 0;
+		summary.peakContactForce = 0;
+		summary.evaluations = 0;
+		summary.avoidedEvaluations = 0;
+		summary.activeFraction = 0;
+		summary.memoryBytes = 0;
+		summary.peakMemoryBytes = 0;
+		// the model is reused: nothing of the last scenario may carry over
+		for(size_t r=0; r<_reflexes.size(); ++r){
+			_reflexes[r]->resetCounters();
+			_reflexes[r]->resetSimulationState();
+		}
+
+		try{
+			for(size_t g=0; g<_gains.size(); ++g)
+				_gains[g]->setValue(scenario.gainScale*_nominalGains[g]);
+			for(size_t n=0; n<_networks.size(); ++n)
+				_networks[n]->setWeightScale(scenario.gainScale);
+
+			State s = _defaultState;
+			setCoordinate(*_rx, s, scenario.platformRX);
+			setCoordinate(*_rz, s, scenario.platformRZ);
+			_height->setValue(s, _defaultHeight + scenario.dropHeight);
+			_model->equilibrateMuscles(s);
+			if(_equilibrium)
+				_equilibrium->solve(s);
+
+			const MultibodySystem& system = _model->getMultibodySystem();
+			RungeKuttaMersonIntegrator integrator(system);
+			integrator.setAccuracy(_campaign._accuracy);
+			TimeStepper stepper(system, integrator);
+			stepper.initialize(s);
+
+			double dt = _campaign._reportingInterval;
+			int numSteps = (int)ceil(_campaign._duration/dt - 1e-9);
+			measure(integrator.getState(), summary);
+			for(int k=1; k<=numSteps; ++k){
+				stepper.stepTo(std::min(k*dt, _campaign._duration));
+				measure(integrator.getState(), summary);
+			}
+			summary.completed = true;
+		}
+		catch(const std::exception& x){
+			cout << "LandingCampaign: scenario " << scenario.number
+				<< " failed: " << x.what() << endl;
+		}
+
+		summary.wallTime = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		for(size_t r=0; r<_reflexes.size(); ++r){
+			summary.evaluations += _reflexes[r]->getNumEvaluations();
+			summary.avoidedEvaluations += _reflexes[r]->getNumAvoidedEvaluations();
+			summary.activeFraction += _reflexes[r]->getAverageActiveFraction();
+			summary.memoryBytes += _reflexes[r]->getMemoryBytes();
+			summary.peakMemoryBytes += _reflexes[r]->getPeakMemoryBytes();
+		}
+		if(!_reflexes.empty())
+			summary.activeFraction /= _reflexes.size();
+		return summary;
+	}
+
+private:
+	void measure(const State& s, Summary& summary) const
+	{
+		_model->getMultibodySystem().realize(s, Stage::Dynamics);
+
+		summary.finalTime = s.getTime();
+		summary.minHeight = std::min(summary.minHeight, _height->getValue(s));
+		summary.peakDescentSpeed = std::max(summary.peakDescentSpeed, -_height->getSpeedValue(s));
+
+		// the first three record values are the force on the contact body
+		double force = 0;
+		for(size_t i=0; i<_contacts.size(); ++i){
+			Array<double> values = _contacts[i]->getRecordValues(s);
+			force += Vec3(values[0], values[1], values[2]).norm();
+		}
+		summary.peakContactForce = std::max(summary.peakContactForce, force);
+	}
+
+	const LandingCampaign& _campaign;
+	std::unique_ptr<Model> _model;
+	State _defaultState;
+
+	const Coordinate* _rx;
+	const Coordinate* _rz;
+	const Coordinate* _height;
+	double _defaultHeight;
+	std::vector<const Force*> _contacts;
+
+	std::vector<Property<double>*> _gains;
+	// reflexes whose evaluation counters are reported
+	std::vector<const MuscleReflexController*> _reflexes;
+	std::vector<double> _nominalGains;
+	std::vector<SpinalNetworkReflexController*> _networks;
+	// reflex equilibrium of the initial muscle states, if requested
+	std::unique_ptr<ReflexEquilibriumSolver> _equilibrium;
+};
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+LandingCampaign::LandingCampaign(const string& modelFile) :
+	_model(new Model(modelFile)),
+	_seed(0),
+	_numThreads(0),
+	_platformRX(-0.1, 0.1),
+	_platformRZ(-0.1, 0.1),
+	_dropHeight(0.0, 0.3),
+	_gainScale(0.5, 1.5),
+	_duration(0.5),
+	_reportingInterval(0.001),
+	_accuracy(1e-4),
+	_reflexEquilibrium(false),
+	_rxCoordinate("platform_rx"),
+	_rzCoordinate("platform_rz"),
+	_heightCoordinate("pelvis_ty")
+{
+	_contactForces.push_back("foot_r");
+	_contactForces.push_back("foot_l");
+}
+
+LandingCampaign::~LandingCampaign()
+{
+}
+
+//=============================================================================
+// SCENARIOS
+//=============================================================================
+double LandingCampaign::uniform(int scenario, int draw) const
+{
+	// counter-based: the value depends only on (seed, scenario, draw)
+	unsigned long long key = splitmix64(_seed ^ splitmix64((unsigned long long)scenario));
+	unsigned long long bits = splitmix64(key + (unsigned long long)draw);
+	// top 53 bits as a double in [0,1)
+	return (bits >> 11)*(1.0/9007199254740992.0);
+}
+
+LandingCampaign::Scenario LandingCampaign::drawScenario(int number) const
+{
+	Scenario scenario;
+	scenario.number = number;
+	scenario.platformRX = _platformRX.min
+		+ (_platformRX.max - _platformRX.min)*uniform(number, DrawPlatformRX);
+	scenario.platformRZ = _platformRZ.min
+		+ (_platformRZ.max - _platformRZ.min)*uniform(number, DrawPlatformRZ);
+	scenario.dropHeight = _dropHeight.min
+		+ (_dropHeight.max - _dropHeight.min)*uniform(number, DrawDropHeight);
+	scenario.gainScale = _gainScale.min
+		+ (_gainScale.max - _gainScale.min)*uniform(number, DrawGainScale);
+	return scenario;
+}
+
+//=============================================================================
+// EXECUTION
+//=============================================================================
+bool LandingCampaign::nextScenario(int worker, int& number)
+{
+	int n = (int)_queues.size();
+	{
+		Queue& own = *_queues[worker];
+		lock_guard<std::mutex> lock(own.mutex);
+		if(!own.scenarios.empty()){
+			number = own.scenarios.back();
+			own.scenarios.pop_back();
+			return true;
+		}
+	}
+	// steal the oldest work of another worker
+	for(int k=1; k<n; ++k){
+		Queue& victim = *_queues[(worker + k) % n];
+		lock_guard<std::mutex> lock(victim.mutex);
+		if(!victim.scenarios.empty()){
+			number = victim.scenarios.front();
+			victim.scenarios.pop_front();
+			return true;
+		}
+	}
+	// scenarios are never added once running, so no work is left
+	return false;
+}
+
+void LandingCampaign::run(int numScenarios, ostream& out)
+{
+	if(_duration <= 0 || _reportingInterval <= 0)
+		throw Exception("LandingCampaign: duration and reporting interval must be positive.");
+
+	int numThreads = _numThreads > 0 ? _numThreads : (int)std::thread::hardware_concurrency();
+	numThreads = std::max(1, std::min(numThreads, numScenarios));
+
+	// deal the scenarios out in contiguous blocks
+	_queues.clear();
+	for(int w=0; w<numThreads; ++w){
+		_queues.push_back(std::unique_ptr<Queue>(new Queue()));
+		int first = (int)((long long)numScenarios*w/numThreads);
+		int last = (int)((long long)numScenarios*(w+1)/numThreads);
+		for(int i=first; i<last; ++i)
+			_queues[w]->scenarios.push_back(i);
+	}
+
+	// copy and initialize the models up front, one thread at a time
+	vector<std::unique_ptr<Worker> > workers;
+	for(int w=0; w<numThreads; ++w)
+		workers.push_back(std::unique_ptr<Worker>(new Worker(*_model, *this, w)));
+
+	out << getSummaryHeader() << endl;
+	std::mutex outMutex;
+
+	vector<std::thread> threads;
+	for(int w=0; w<numThreads; ++w){
+		threads.push_back(std::thread([this, w, &workers, &out, &outMutex]() {
+			int number;
+			while(nextScenario(w, number)){
+				Summary summary = workers[w]->simulate(drawScenario(number));
+				string line = formatSummary(summary);
+				lock_guard<std::mutex> lock(outMutex);
+				out << line << endl;
+			}
+		}));
+	}
+	for(size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+
+	_queues.clear();
+}
+
+string LandingCampaign::getSummaryHeader()
+{
+	return "scenario\tplatform_rx\tplatform_rz\tdrop_height\tgain_scale\t"
+		"completed\tfinal_time\tmin_height\tpeak_descent_speed\t"
+		"peak_contact_force\twall_time\tevaluations\tavoided_evaluations\tactive_fraction\t"
+		"memory_bytes\tpeak_memory_bytes";
+}
+
+string LandingCampaign::formatSummary(const Summary& summary)
+{
+	ostringstream line;
+	line << setprecision(10)
+		<< summary.scenario.number << '\t'
+		<< summary.scenario.platformRX << '\t'
+		<< summary.scenario.platformRZ << '\t'
+		<< summary.scenario.dropHeight << '\t'
+		<< summary.scenario.gainScale << '\t'
+		<< (summary.completed ? 1 : 0) << '\t'
+		<< summary.finalTime << '\t'
+		<< summary.minHeight << '\t'
+		<< summary.peakDescentSpeed << '\t'
+		<< summary.peakContactForce << '\t'
+		<< summary.wallTime << '\t'
+		<< summary.evaluations << '\t'
+		<< summary.avoidedEvaluations << '\t'
+		<< summary.activeFraction << '\t'
+		<< summary.memoryBytes << '\t'
+		<< summary.peakMemoryBytes;
+	return line.str();
+}
@@ -0,0 +1,188 @@
+#ifndef OPENSIM_LandingCampaign_H_
+#define OPENSIM_LandingCampaign_H_
+/* -------------------------------------------------------------------------- *
+ *                        OpenSim:  LandingCampaign.h                         *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+class Model;
+
+//=============================================================================
+//=============================================================================
+/**
+ * LandingCampaign runs a Monte Carlo campaign of landings on a model such as
+ * examples/LandingModel/LandingReflexesModel.osim. Each scenario randomizes
+ * the platform orientation, the drop height and a scale applied to the
+ * gains of every reflex controller (and the weights of spinal networks),
+ * lands the model and reports a one-line summary of the run. The reflexes'
+ * sensor histories and active sets are reset before every scenario.
+ *
+ * The model file is parsed once. Each worker thread simulates its own copy
+ * of the model, initialized before any thread starts, and scenarios are
+ * distributed with work stealing: every worker owns a deque of scenario
+ * numbers, takes work from the back of its own deque and, once it runs dry,
+ * steals from the front of the others'. Reflexes recording a control trace
+ * write one file per worker (name.worker<N>.ctrace).
+ *
+ * Random draws come from a counter-based generator keyed on the campaign
+ * seed, the scenario number and the draw number, so a scenario is identical
+ * however many threads run the campaign and in whatever order. Summaries are
+ * streamed as runs complete (one tab-separated line per scenario, tagged
+ * with its number); full trajectories are never stored.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API LandingCampaign {
+
+public:
+	/** Range [min, max] from which a scenario parameter is drawn uniformly. */
+	struct Range {
+		Range(double aMin = 0, double aMax = 0) : min(aMin), max(aMax) {}
+		double min;
+		double max;
+	};
+
+	/** Randomized parameters of one landing. */
+	struct Scenario {
+		int number;
+		double platformRX;	// platform rotation about x (radians)
+		double platformRZ;	// platform rotation about z (radians)
+		double dropHeight;	// added to the default pelvis height (meters)
+		double gainScale;	// scale on every reflex gain
+	};
+
+	/** Summary of one landing. */
+	struct Summary {
+		Scenario scenario;
+		bool completed;			// false if the simulation failed
+		double finalTime;		// time reached
+		double minHeight;		// lowest pelvis height
+		double peakDescentSpeed;	// fastest pelvis descent
+		double peakContactForce;	// largest total foot contact force
+		double wallTime;		// seconds spent on the run
+		long evaluations;		// reflex evaluations
+		long avoidedEvaluations;	// repeat requests served from memoized controls
+		double activeFraction;	// mean fraction of reflex muscles active
+		double memoryBytes;		// held by the reflex controllers at the end
+		double peakMemoryBytes;	// and at most so far
+	};
+
+	/** Parse the model file. The plugin's types must be registered. */
+	explicit LandingCampaign(const std::string& modelFile);
+	~LandingCampaign();
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	void setSeed(unsigned long long seed) { _seed = seed; }
+	/** Number of worker threads; 0 uses one per hardware thread. */
+	void setNumThreads(int numThreads) { _numThreads = numThreads; }
+
+	void setPlatformRXRange(const Range& range) { _platformRX = range; }
+	void setPlatformRZRange(const Range& range) { _platformRZ = range; }
+	void setDropHeightRange(const Range& range) { _dropHeight = range; }
+	void setGainScaleRange(const Range& range) { _gainScale = range; }
+
+	/** Simulated duration of each landing (seconds). */
+	void setDuration(double duration) { _duration = duration; }
+	/** Interval (seconds) at which the summary metrics are sampled. */
+	void setReportingInterval(double interval) { _reportingInterval = interval; }
+	void setIntegratorAccuracy(double accuracy) { _accuracy = accuracy; }
+	/** Start each landing with the muscles in equilibrium with the reflexes
+	 * (see ReflexEquilibriumSolver), rather than only with the default
+	 * activations. */
+	void setReflexEquilibrium(bool solve) { _reflexEquilibrium = solve; }
+
+	/** Names of the coordinates and contact forces the campaign drives and
+	 * measures. Defaults match the landing example model. */
+	void setPlatformCoordinates(const std::string& rx, const std::string& rz)
+	{	_rxCoordinate = rx; _rzCoordinate = rz; }
+	void setHeightCoordinate(const std::string& name) { _heightCoordinate = name; }
+	void setContactForces(const std::vector<std::string>& names) { _contactForces = names; }
+
+	//--------------------------------------------------------------------------
+	// EXECUTION
+	//--------------------------------------------------------------------------
+	/** Scenario drawn for the given number. Depends only on the seed. */
+	Scenario drawScenario(int number) const;
+
+	/** Run scenarios 0 to numScenarios-1, writing a header and then one
+	 * summary line per run to out as runs complete. */
+	void run(int numScenarios, std::ostream& out);
+
+	/** Column header of the summary lines. */
+	static std::string getSummaryHeader();
+	/** Tab-separated summary line. */
+	static std::string formatSummary(const Summary& summary);
+
+private:
+	class Worker;
+
+	// uniform draw in [0,1) for the given scenario and draw number
+	double uniform(int scenario, int draw) const;
+	// next scenario for a worker, from its own deque or stolen; false if none
+	bool nextScenario(int worker, int& number);
+
+	std::unique_ptr<Model> _model;
+
+	unsigned long long _seed;
+	int _numThreads;
+
+	Range _platformRX;
+	Range _platformRZ;
+	Range _dropHeight;
+	Range _gainScale;
+
+	double _duration;
+	double _reportingInterval;
+	double _accuracy;
+	bool _reflexEquilibrium;
+
+	std::string _rxCoordinate;
+	std::string _rzCoordinate;
+	std::string _heightCoordinate;
+	std::vector<std::string> _contactForces;
+
+	// per-worker scenario deques
+	struct Queue;
+	std::vector<std::unique_ptr<Queue> > _queues;
+
+};	// END of class LandingCampaign
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_LandingCampaign_H_
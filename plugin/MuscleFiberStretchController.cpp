@@ -44,12 +44,11 @@ using namespace SimTK;
 //=============================================================================
 //_____________________________________________________________________________
 /* Default constructor. */
-/*
-MuscleFiberStretchController::MuscleFiberStretchController()
+MuscleFiberStretchController::MuscleFiberStretchController() :
+	_spindles(NULL)
 {
-	//constructProperties();
+	constructProperties();
 }
-*/
 
 /* Convenience constructor. */
 /*
@@ -80,20 +79,39 @@ MuscleFiberStretchController::MuscleFiberStretchController(double gain)
  /**
  * Construct Properties
  */
-/*
 void MuscleFiberStretchController::constructProperties()
 {
-	
+	constructProperty_spindle_sensor("");
 }
-*/
 
-/*
 void MuscleFiberStretchController::connectToModel(Model &model)
 {
 	Super::connectToModel(model);
 
+	_spindles = NULL;
+	_spindleIndex.clear();
+	if(get_spindle_sensor().empty())
+		return;
+
+	const ModelComponentSet& misc = model.getMiscModelComponentSet();
+	if(!misc.contains(get_spindle_sensor()))
+		throw Exception("MuscleFiberStretchController: spindle sensor "
+			+ get_spindle_sensor() + " not found in the model.");
+	_spindles = dynamic_cast<const MuscleSpindleSensor*>(&misc.get(get_spindle_sensor()));
+	if(!_spindles)
+		throw Exception("MuscleFiberStretchController: " + get_spindle_sensor()
+			+ " is not a MuscleSpindleSensor.");
+
+	// each controlled muscle needs a spindle
+	const Set<Actuator>& actuators = getActuatorSet();
+	for(int i=0; i<actuators.getSize(); ++i){
+		int index = _spindles->getMuscleIndex(actuators[i].getName());
+		if(index < 0)
+			throw Exception("MuscleFiberStretchController: " + get_spindle_sensor()
+				+ " has no spindle for muscle " + actuators[i].getName() + ".");
+		_spindleIndex.push_back(index);
+	}
 }
-*/
 
 //=============================================================================
 // COMPUTATIONS
@@ -102,10 +120,10 @@ void MuscleFiberStretchController::connectToModel(Model &model)
 /**
  * Compute the controls for muscles under influence of this reflex controller
  *
- * @param s			current state of the system
- * @param controls	system wide controls to which this controller can add
+ * @param s				current state of the system
+ * @param muscleControls	reflex control of each muscle
  */
-void MuscleFiberStretchController::computeControls(const State& s, Vector &controls) const
+void MuscleFiberStretchController::computeMuscleControls(const State& s, Vector &muscleControls) const
 {	
 	// get time
 	double time = s.getTime();
@@ -115,8 +133,9 @@ void MuscleFiberStretchController::computeControls(const State& s, Vector &contr
 
 	// save resused controller parameter
 	double rest_length = get_normalized_rest_length();
-	double k_l = get_gain_length();
-	double k_v = get_gain_velocity();
+	double scale = getGainScale(s);
+	double k_l = scale*get_gain_length();
+	double k_v = scale*get_gain_velocity();
 
 	// muscle optimal fiber length
 	double f_o = 1;
@@ -131,21 +150,68 @@ void MuscleFiberStretchController::computeControls(const State& s, Vector &contr
 	//reflex control
 	double control = 0;
 
+	if(_spindles){
+		// length response from the secondary afferent, velocity response from
+		// the dynamic part of the primary afferent
+		for (int i = 0; i < actuators.getSize(); ++i){
+			double secondary = _spindles->getSecondaryAfferent(s, _spindleIndex[i]);
+			double primary = _spindles->getPrimaryAfferent(s, _spindleIndex[i]);
+			muscleControls[i] = k_l*secondary + k_v*(primary - secondary);
+		}
+		return;
+	}
+
 	for (int i = 0; i < actuators.getSize(); ++i){
 		const Muscle *musc = dynamic_cast<const Muscle*>(&actuators[i]);
 		f_o = musc->getOptimalFiberLength();
 		length = musc->getFiberLength(s);
 		stretch = length - get_normalized_rest_length()*f_o;
 		// only positive stretch, normalized by optimal fiber length is used
-		control = get_gain_length() * 0.5*(fabs(stretch) + stretch) / f_o;
+		control = k_l * 0.5*(fabs(stretch) + stretch) / f_o;
 		speed = musc->getFiberVelocity(s);
 		// unnormalize muscle's maximum contraction velocity (fib_lengths/sec) 
 		max_speed = f_o*musc->getMaxContractionVelocity();
-		control += 0.5*get_gain_velocity()*(fabs(speed) + speed) / max_speed;
+		control += 0.5*k_v*(fabs(speed) + speed) / max_speed;
+
+		muscleControls[i] = control;
+	}
+}
+
+void MuscleFiberStretchController::computeMuscleControlsFromSensors(
+	const double* lengths, const double* speeds, int numFrames,
+	double* muscleControls) const
+{
+	if(_spindles)
+		throw Exception("MuscleFiberStretchController: " + getName()
+			+ " senses through spindle states, not sensor arrays.");
+	if(hasGainSchedule())
+		throw Exception("MuscleFiberStretchController: " + getName()
+			+ " follows a gain_schedule, which needs the state.");
+
+	const Set<Actuator>& actuators = getActuatorSet();
+	int nm = actuators.getSize();
+	double k_l = get_gain_length();
+	double k_v = get_gain_velocity();
+
+	// rest length and the length and speed normalizations, per muscle
+	vector<double> rest(nm), lengthScale(nm), speedScale(nm);
+	for(int i=0; i<nm; ++i){
+		const Muscle& musc = static_cast<const Muscle&>(actuators[i]);
+		double f_o = musc.getOptimalFiberLength();
+		rest[i] = get_normalized_rest_length()*f_o;
+		lengthScale[i] = 0.5*k_l/f_o;
+		speedScale[i] = 0.5*k_v/(f_o*musc.getMaxContractionVelocity());
+	}
 
-		SimTK::Vector actControls(1, control);
-		// add reflex controls to whatever controls are already in place.
-		musc->addInControls(actControls, controls);
+	for(int f=0; f<numFrames; ++f){
+		const double* length = lengths + (size_t)f*nm;
+		const double* speed = speeds + (size_t)f*nm;
+		double* control = muscleControls + (size_t)f*nm;
+		for(int i=0; i<nm; ++i){
+			double stretch = length[i] - rest[i];
+			control[i] = lengthScale[i]*(fabs(stretch) + stretch)
+				+ speedScale[i]*(fabs(speed[i]) + speed[i]);
+		}
 	}
 }
 
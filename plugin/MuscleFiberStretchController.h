@@ -29,6 +29,7 @@
 //============================================================================
 #include <OpenSim/Simulation/Control/Controller.h>
 #include "MusclePathStretchController.h"
+#include "MuscleSpindleSensor.h"
 
 // to export class as part of a plugin:
 #include "osimReflexesDLL.h" 
@@ -45,7 +46,13 @@ namespace OpenSim {
  * beyond the specified normalized_rest_length.  Since this controller monitors the 
  * muscle fiber only, the provided rest length is interpretted as a ratio of 
  * desired fiber rest length to optimal fiber length.
-
+ *
+ * When spindle_sensor names a MuscleSpindleSensor in the model, the
+ * instantaneous stretch signals are replaced by the spindle afferents: the
+ * length gain applies to the secondary (static) afferent and the velocity
+ * gain to the dynamic part of the primary afferent. normalized_rest_length
+ * is then set on the sensor instead. Fiber stretch is not a path quantity, so
+ * use_path_surrogate has no effect here and no surrogate is built.
  *
  * @author  Matt DeMers
  * @version 1.0
@@ -64,6 +71,9 @@ public:
 	OpenSim_DECLARE_PROPERTY(gain, double, 
 		"Factor by which the stretch response is scaled." );
 	*/
+	OpenSim_DECLARE_PROPERTY(spindle_sensor, std::string,
+		"Name of a MuscleSpindleSensor providing the stretch afferents. Leave "
+		"empty to respond to the instantaneous fiber stretch.");
 
 //=============================================================================
 // METHODS
@@ -72,27 +82,46 @@ public:
 	// CONSTRUCTION AND DESTRUCTION
 	//--------------------------------------------------------------------------
 	/** Default constructor. */
-	//MuscleFiberStretchController();
+	MuscleFiberStretchController();
 	// Uses default (compiler-generated) destructor, copy constructor and copy 
     // assignment operator.
 	
 
-	/** Compute the controls for actuators (muscles)
+	/** Compute the controls for muscles
 	 *  This method defines the behavior for MuscleFiberStretchController controller 
 	 *
-	 * @param s			system state 
-	 * @param controls	writable model controls
+	 * @param s					system state 
+	 * @param muscleControls	reflex control of each muscle
 	 */
-	void computeControls(const SimTK::State& s, SimTK::Vector &controls) const OVERRIDE_11;
+	void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector &muscleControls) const OVERRIDE_11;
+
+	/** Batch controls from fiber lengths and lengthening velocities. Not
+	 * available with a spindle sensor, whose afferents are states. */
+	void computeMuscleControlsFromSensors(const double* lengths,
+		const double* speeds, int numFrames, double* muscleControls) const OVERRIDE_11;
+
+	/** Fiber lengths and spindle afferents are auxiliary states. */
+	bool dependsOnAuxiliaryStates() const OVERRIDE_11 { return true; }
+
+protected:
+	// fibers, not paths, are sensed: no path surrogate is built
+	bool sensesPaths() const OVERRIDE_11 { return false; }
 
 
 private:
 	// Connect properties to local pointers.  */
-	//void constructProperties();
-	/*
+	void constructProperties();
 	// ModelComponent interface to connect this component to its model
 	void connectToModel(Model& aModel);
-	*/
+
+	//=============================================================================
+	// Private Members
+	//=============================================================================
+	// spindles of the controlled muscles, if any, and each muscle's index in
+	// the sensor
+	const MuscleSpindleSensor* _spindles;
+	std::vector<int> _spindleIndex;
 
 	//=============================================================================
 };	// END of class MuscleFiberStretchController
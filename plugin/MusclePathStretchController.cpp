@@ -84,27 +84,14 @@ void MusclePathStretchController::constructProperties()
 	constructProperty_gain_length(1.0);
 	constructProperty_gain_velocity(1.0);
 	constructProperty_normalized_rest_length(1.0);
+	constructProperty_use_path_surrogate(false);
 }
 
 void MusclePathStretchController::connectToModel(Model &model)
 {
 	Super::connectToModel(model);
 
-	// get the list of actuators assigned to the reflex controller
-	Set<Actuator>& actuators = updActuators();
-
-	int cnt=0;
- 
-	while(cnt < actuators.getSize()){
-		Muscle *musc = dynamic_cast<Muscle*>(&actuators[cnt]);
-		// control muscles only
-		if(!musc){
-			cout << "WARNING - controller named " << this->getName() << " assigned a non-muscle actuator";
-			cout << actuators[cnt].getName() << " which will be ignored." << endl;
-			actuators.remove(cnt);
-		}else
-			cnt++;
-	}
+	usePathSurrogate(model, get_use_path_surrogate() && sensesPaths());
 }
 
 //=============================================================================
@@ -114,10 +101,10 @@ void MusclePathStretchController::connectToModel(Model &model)
 /**
  * Compute the controls for muscles under influence of this reflex controller
  *
- * @param s			current state of the system
- * @param controls	system wide controls to which this controller can add
+ * @param s				current state of the system
+ * @param muscleControls	reflex control of each muscle
  */
-void MusclePathStretchController::computeControls(const State& s, Vector &controls) const
+void MusclePathStretchController::computeMuscleControls(const State& s, Vector &muscleControls) const
 {	
 	// get time
 	double time = s.getTime();
@@ -127,8 +114,9 @@ void MusclePathStretchController::computeControls(const State& s, Vector &contro
 
 	// save resused controller parameter
 	double rest_length = get_normalized_rest_length();
-	double k_l = get_gain_length();
-	double k_v = get_gain_velocity();
+	double scale = getGainScale(s);
+	double k_l = scale*get_gain_length();
+	double k_v = scale*get_gain_velocity();
 
 	// muscle optimal fiber length
 	double f_o = 1;
@@ -146,19 +134,51 @@ void MusclePathStretchController::computeControls(const State& s, Vector &contro
 	for(int i=0; i<actuators.getSize(); ++i){
 		const Muscle *musc = dynamic_cast<const Muscle*>(&actuators[i]);
 		f_o = musc->getOptimalFiberLength();
-		length = musc->getLength(s);
+		calcPathLengthAndSpeed(s, i, length, speed);
 		// compute stretch beyond desired muscle-tendon length
 		stretch = length - rest_length*(f_o + musc->getTendonSlackLength());
 		// only positive stretch, normalized by optimal fiber length is used
 		control = k_l * 0.5*(fabs(stretch) + stretch) / f_o;
-		speed = musc->getLengtheningSpeed(s);
 		// unnormalize muscle's maximum contraction velocity (fib_lengths/sec) 
 		max_speed = f_o*musc->getMaxContractionVelocity();
 		control += 0.5*k_v*(fabs(speed)+speed)/max_speed;
 
-		SimTK::Vector actControls(1,control);
-		// add reflex controls to whatever controls are already in place.
-		musc->addInControls(actControls, controls);
+		muscleControls[i] = control;
+	}
+}
+
+void MusclePathStretchController::computeMuscleControlsFromSensors(
+	const double* lengths, const double* speeds, int numFrames,
+	double* muscleControls) const
+{
+	if(hasGainSchedule())
+		throw Exception("MusclePathStretchController: " + getName()
+			+ " follows a gain_schedule, which needs the state.");
+
+	const Set<Actuator>& actuators = getActuatorSet();
+	int nm = actuators.getSize();
+	double k_l = get_gain_length();
+	double k_v = get_gain_velocity();
+
+	// rest length and the length and speed normalizations, per muscle
+	vector<double> rest(nm), lengthScale(nm), speedScale(nm);
+	for(int i=0; i<nm; ++i){
+		const Muscle& musc = static_cast<const Muscle&>(actuators[i]);
+		double f_o = musc.getOptimalFiberLength();
+		rest[i] = get_normalized_rest_length()*(f_o + musc.getTendonSlackLength());
+		lengthScale[i] = 0.5*k_l/f_o;
+		speedScale[i] = 0.5*k_v/(f_o*musc.getMaxContractionVelocity());
+	}
+
+	for(int f=0; f<numFrames; ++f){
+		const double* length = lengths + (size_t)f*nm;
+		const double* speed = speeds + (size_t)f*nm;
+		double* control = muscleControls + (size_t)f*nm;
+		for(int i=0; i<nm; ++i){
+			double stretch = length[i] - rest[i];
+			control[i] = lengthScale[i]*(fabs(stretch) + stretch)
+				+ speedScale[i]*(fabs(speed[i]) + speed[i]);
+		}
 	}
 }
 
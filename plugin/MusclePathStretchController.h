@@ -27,7 +27,7 @@
 //============================================================================
 // INCLUDE
 //============================================================================
-#include <OpenSim/Simulation/Control/Controller.h>
+#include "MuscleReflexController.h"
 
 // to export class as part of a plugin:
 #include "osimReflexesDLL.h" 
@@ -50,8 +50,8 @@ namespace OpenSim {
  * @author  Matt DeMers
  * @version 1.0
  */
-class OSIMREFLEXES_API MusclePathStretchController : public Controller {
-OpenSim_DECLARE_CONCRETE_OBJECT(MusclePathStretchController, Controller);
+class OSIMREFLEXES_API MusclePathStretchController : public MuscleReflexController {
+OpenSim_DECLARE_CONCRETE_OBJECT(MusclePathStretchController, MuscleReflexController);
 
 public:
 //=============================================================================
@@ -68,6 +68,10 @@ public:
 		"The intended rest length of the muscle, after which the,"
 		" controller responds to stretch. Rest length is interpreted as a "
 		"ratio of the muscle rest length to the muscle neutral length.");
+	OpenSim_DECLARE_PROPERTY(use_path_surrogate, bool,
+		"Sense path length and lengthening speed with a fitted polynomial of "
+		"the spanned coordinates (see MusclePathSurrogate) instead of the "
+		"geometry path.");
 
 //=============================================================================
 // METHODS
@@ -87,22 +91,31 @@ public:
 	*/
 	MusclePathStretchController(double rest_length, double gain_l, double gain_v);
 
-	/** Compute the controls for actuators (muscles)
+	/** Compute the controls for muscles
 	 *  This method defines the behavior for MusclePathStretchController controller 
 	 *
-	 * @param s			system state 
-	 * @param controls	writable model controls
+	 * @param s					system state 
+	 * @param muscleControls	reflex control of each muscle
 	 */
-	void computeControls(const SimTK::State& s, SimTK::Vector &controls) const OVERRIDE_11;
+	void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector &muscleControls) const OVERRIDE_11;
 
+	/** Batch controls from path lengths and lengthening speeds. */
+	void computeMuscleControlsFromSensors(const double* lengths,
+		const double* speeds, int numFrames, double* muscleControls) const OVERRIDE_11;
+
+
+protected:
+	// ModelComponent interface to connect this component to its model
+	void connectToModel(Model& aModel) OVERRIDE_11;
+	// true if the reflexes sense the muscle-tendon path, so the path
+	// surrogate is worth building
+	virtual bool sensesPaths() const { return true; }
 
 private:
 	// Connect properties to local pointers.  */
 	void constructProperties();
 
-	// ModelComponent interface to connect this component to its model
-	void connectToModel(Model& aModel);
-
 	//=============================================================================
 };	// END of class MusclePathStretchController
 
@@ -0,0 +1,634 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  MusclePathSurrogate.cpp                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "MusclePathSurrogate.h"
+
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <sstream>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// limits that keep evaluation on the stack
+	const int MaxCoordinates = 16;
+	const int MaxDegree = 7;
+
+	// change in path length (m) below which a coordinate is not spanned
+	const double SpanTolerance = 1e-9;
+
+	// cache file format
+	const int CacheVersion = 2;
+
+	// poses at which a fit's path lengths are recorded, and the difference
+	// (m) above which a cached fit no longer matches the model
+	const int NumProbes = 4;
+	const int ProbeSeed = 1871;
+	const double ProbeTolerance = 1e-9;
+
+	// 64 bit FNV-1a hash of a string
+	unsigned long long hashString(const string& text)
+	{
+		unsigned long long hash = 14695981039346656037ULL;
+		for(size_t i=0; i<text.size(); ++i)
+			hash = (hash ^ (unsigned char)text[i])*1099511628211ULL;
+		return hash;
+	}
+
+	// stable seed from a name, so fits do not depend on the run
+	int seedFromName(const string& name)
+	{
+		unsigned int hash = 2166136261u;
+		for(size_t i=0; i<name.size(); ++i)
+			hash = (hash ^ (unsigned char)name[i])*16777619u;
+		return (int)(hash & 0x7fffffff);
+	}
+
+	// exponents of every monomial of total degree <= degree, lowest first
+	void enumerateTerms(int numCoords, int degree, vector<int>& exponents)
+	{
+		exponents.clear();
+		vector<int> e(numCoords, 0);
+		for(int total=0; total<=degree; ++total){
+			// every composition of total into numCoords parts
+			std::function<void(int, int)> place = [&](int j, int left) {
+				if(j == numCoords-1){
+					e[j] = left;
+					exponents.insert(exponents.end(), e.begin(), e.end());
+					return;
+				}
+				for(int p=left; p>=0; --p){
+					e[j] = p;
+					place(j+1, left-p);
+				}
+			};
+			// with no coordinates the constant is the only term
+			if(numCoords > 0)
+				place(0, total);
+		}
+	}
+
+	typedef map<const Model*, weak_ptr<MusclePathSurrogate> > SurrogateRegistry;
+
+	SurrogateRegistry& sharedSurrogates()
+	{
+		static SurrogateRegistry registry;
+		return registry;
+	}
+
+	mutex& sharedSurrogatesMutex()
+	{
+		static mutex m;
+		return m;
+	}
+
+	// Lock of a cache file, shared by every surrogate of the process that
+	// uses it. The surrogates of copies of a model (one per worker thread)
+	// read, fit and write the same file in turn.
+	mutex& cacheFileMutex(const string& fileName)
+	{
+		static map<string, mutex> mutexes;
+		static mutex m;
+		lock_guard<mutex> lock(m);
+		return mutexes[fileName];
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+MusclePathSurrogate::MusclePathSurrogate(const Model& model) :
+	_model(model),
+	_degree(3),
+	_samplesPerTerm(4),
+	_cacheFile(model.getName() + ".pathfit")
+{
+}
+
+shared_ptr<MusclePathSurrogate> MusclePathSurrogate::getShared(const Model& model)
+{
+	lock_guard<mutex> lock(sharedSurrogatesMutex());
+	SurrogateRegistry& registry = sharedSurrogates();
+
+	// forget surrogates whose controllers have all been destroyed
+	for(SurrogateRegistry::iterator it = registry.begin(); it != registry.end();){
+		if(it->second.expired())
+			registry.erase(it++);
+		else
+			++it;
+	}
+
+	weak_ptr<MusclePathSurrogate>& entry = registry[&model];
+	shared_ptr<MusclePathSurrogate> surrogate = entry.lock();
+	if(!surrogate){
+		surrogate.reset(new MusclePathSurrogate(model));
+		entry = surrogate;
+	}
+	return surrogate;
+}
+
+int MusclePathSurrogate::getIndex(const string& muscleName) const
+{
+	map<string, int>::const_iterator it = _index.find(muscleName);
+	return it == _index.end() ? -1 : it->second;
+}
+
+//=============================================================================
+// FITTING
+//=============================================================================
+void MusclePathSurrogate::prepare(const State& s, const vector<const Muscle*>& muscles)
+{
+	lock_guard<mutex> lock(_mutex);
+
+	bool missing = false;
+	for(size_t m=0; m<muscles.size() && !missing; ++m)
+		missing = getIndex(muscles[m]->getName()) < 0;
+	if(!missing)
+		return;
+
+	// load what is in the cache file by now, perhaps written by another
+	// surrogate of the process, and keep it locked until updated
+	unique_lock<mutex> fileLock;
+	if(!_cacheFile.empty())
+		fileLock = unique_lock<mutex>(cacheFileMutex(_cacheFile));
+	readCache(s);
+
+	bool fitted = false;
+	for(size_t m=0; m<muscles.size(); ++m){
+		if(getIndex(muscles[m]->getName()) >= 0)
+			continue;
+		Fit fit;
+		fitMuscle(s, *muscles[m], fit);
+		_index[fit.muscle] = (int)_fits.size();
+		_fits.push_back(fit);
+		fitted = true;
+	}
+
+	if(fitted)
+		writeCache();
+}
+
+void MusclePathSurrogate::findSpannedCoordinates(State& w, const Muscle& muscle,
+	Fit& fit) const
+{
+	const CoordinateSet& coords = _model.getCoordinateSet();
+	const MultibodySystem& system = _model.getMultibodySystem();
+
+	fit.coordinates.clear();
+	fit.coordinateNames.clear();
+
+	// probe the base pose and a few random ones
+	SimTK::Random::Uniform rng(-1.0, 1.0);
+	rng.setSeed(seedFromName(muscle.getName()));
+	State base = w;
+	vector<bool> spanned(coords.getSize(), false);
+	for(int probe=0; probe<3; ++probe){
+		w = base;
+		if(probe > 0){
+			for(int c=0; c<coords.getSize(); ++c){
+				if(coords[c].getLocked(w) || coords[c].isConstrained(w))
+					continue;
+				double mid = 0.5*(coords[c].getRangeMax() + coords[c].getRangeMin());
+				double half = 0.5*(coords[c].getRangeMax() - coords[c].getRangeMin());
+				coords[c].setValue(w, mid + half*rng.getValue(), false);
+			}
+		}
+		for(int c=0; c<coords.getSize(); ++c){
+			if(spanned[c] || coords[c].getLocked(w) || coords[c].isConstrained(w))
+				continue;
+			double q = coords[c].getValue(w);
+			double h = 1e-3*std::max(1e-3, coords[c].getRangeMax() - coords[c].getRangeMin());
+			coords[c].setValue(w, q + h, false);
+			system.realize(w, Stage::Position);
+			double lengthUp = muscle.getLength(w);
+			coords[c].setValue(w, q - h, false);
+			system.realize(w, Stage::Position);
+			double lengthDown = muscle.getLength(w);
+			coords[c].setValue(w, q, false);
+			if(fabs(lengthUp - lengthDown) > SpanTolerance)
+				spanned[c] = true;
+		}
+	}
+	w = base;
+
+	for(int c=0; c<coords.getSize(); ++c){
+		if(!spanned[c])
+			continue;
+		fit.coordinates.push_back(&coords[c]);
+		fit.coordinateNames.push_back(coords[c].getName());
+	}
+}
+
+void MusclePathSurrogate::fitMuscle(const State& s, const Muscle& muscle, Fit& fit) const
+{
+	if(_degree < 0 || _degree > MaxDegree)
+		throw Exception("MusclePathSurrogate: polynomial degree must be between 0 and 7.");
+
+	State w = s;
+	const MultibodySystem& system = _model.getMultibodySystem();
+
+	fit.muscle = muscle.getName();
+	fit.degree = _degree;
+	findSpannedCoordinates(w, muscle, fit);
+
+	int nc = (int)fit.coordinates.size();
+	if(nc > MaxCoordinates)
+		throw Exception("MusclePathSurrogate: " + fit.muscle
+			+ " spans too many coordinates for a polynomial fit.");
+
+	fit.center.resize(nc);
+	fit.invHalfRange.resize(nc);
+	for(int j=0; j<nc; ++j){
+		const Coordinate& coord = *fit.coordinates[j];
+		fit.center[j] = 0.5*(coord.getRangeMax() + coord.getRangeMin());
+		fit.invHalfRange[j] = 2.0/std::max(1e-6, coord.getRangeMax() - coord.getRangeMin());
+	}
+
+	enumerateTerms(nc, fit.degree, fit.exponents);
+	int nt = nc ? (int)fit.exponents.size()/nc : 1;
+
+	// sample poses uniformly within the coordinate ranges
+	int ns = std::max(_samplesPerTerm*nt, nt + 1);
+	SimTK::Random::Uniform rng(-1.0, 1.0);
+	rng.setSeed(seedFromName(fit.muscle) + 1);
+
+	Matrix A(ns, nt);
+	Vector b(ns);
+	vector<double> x(nc);
+	for(int k=0; k<ns; ++k){
+		for(int j=0; j<nc; ++j){
+			x[j] = rng.getValue();
+			fit.coordinates[j]->setValue(w, fit.center[j] + x[j]/fit.invHalfRange[j], false);
+		}
+		system.realize(w, Stage::Position);
+		b[k] = muscle.getLength(w);
+
+		for(int t=0; t<nt; ++t){
+			double term = 1.0;
+			for(int j=0; j<nc; ++j)
+				for(int p=0; p<fit.exponents[t*nc + j]; ++p)
+					term *= x[j];
+			A(k, t) = term;
+		}
+	}
+
+	// least squares coefficients
+	Vector c;
+	FactorQTZ qtz(A);
+	qtz.solve(b, c);
+	fit.coefficients.resize(nt);
+	for(int t=0; t<nt; ++t)
+		fit.coefficients[t] = c[t];
+
+	calcSignature(s, muscle, fit);
+}
+
+void MusclePathSurrogate::calcSignature(const State& s, const Muscle& muscle,
+	Fit& fit) const
+{
+	ostringstream settings;
+	settings << setprecision(17) << fit.muscle << ' ' << _degree << ' ' << _samplesPerTerm;
+	for(size_t j=0; j<fit.coordinates.size(); ++j)
+		settings << ' ' << fit.coordinateNames[j] << ' '
+			<< fit.coordinates[j]->getRangeMin() << ' ' << fit.coordinates[j]->getRangeMax();
+	fit.settingsHash = hashString(settings.str());
+
+	// the same poses for every muscle and every run
+	const CoordinateSet& coords = _model.getCoordinateSet();
+	const MultibodySystem& system = _model.getMultibodySystem();
+	SimTK::Random::Uniform rng(-1.0, 1.0);
+	rng.setSeed(ProbeSeed);
+	State w = s;
+	fit.probeLengths.resize(NumProbes);
+	for(int probe=0; probe<NumProbes; ++probe){
+		for(int c=0; c<coords.getSize(); ++c){
+			double x = rng.getValue();
+			if(coords[c].getLocked(w) || coords[c].isConstrained(w))
+				continue;
+			double mid = 0.5*(coords[c].getRangeMax() + coords[c].getRangeMin());
+			double half = 0.5*(coords[c].getRangeMax() - coords[c].getRangeMin());
+			coords[c].setValue(w, mid + half*x, false);
+		}
+		system.realize(w, Stage::Position);
+		fit.probeLengths[probe] = muscle.getLength(w);
+	}
+}
+
+//=============================================================================
+// EVALUATION
+//=============================================================================
+double MusclePathSurrogate::evaluate(const Fit& fit, const State& s,
+	vector<double>* gradient) const
+{
+	int nc = (int)fit.coordinates.size();
+	int nt = (int)fit.coefficients.size();
+	int stride = fit.degree + 1;
+
+	// powers of every scaled coordinate
+	double powers[MaxCoordinates*(MaxDegree+1)];
+	for(int j=0; j<nc; ++j){
+		double x = (fit.coordinates[j]->getValue(s) - fit.center[j])*fit.invHalfRange[j];
+		double* pw = powers + j*stride;
+		pw[0] = 1.0;
+		for(int p=1; p<stride; ++p)
+			pw[p] = pw[p-1]*x;
+	}
+
+	double value = 0;
+	double grad[MaxCoordinates];
+	for(int j=0; j<nc; ++j)
+		grad[j] = 0;
+
+	for(int t=0; t<nt; ++t){
+		const int* e = nc ? &fit.exponents[t*nc] : NULL;
+		double term = fit.coefficients[t];
+		for(int j=0; j<nc; ++j)
+			term *= powers[j*stride + e[j]];
+		value += term;
+
+		if(!gradient)
+			continue;
+		for(int j=0; j<nc; ++j){
+			if(e[j] == 0)
+				continue;
+			double partial = fit.coefficients[t]*e[j]*powers[j*stride + e[j] - 1];
+			for(int i=0; i<nc; ++i)
+				if(i != j)
+					partial *= powers[i*stride + e[i]];
+			grad[j] += partial;
+		}
+	}
+
+	if(gradient){
+		gradient->resize(nc);
+		// chain rule through the coordinate scaling
+		for(int j=0; j<nc; ++j)
+			(*gradient)[j] = grad[j]*fit.invHalfRange[j];
+	}
+	return value;
+}
+
+double MusclePathSurrogate::calcLength(const State& s, int index) const
+{
+	return evaluate(_fits[index], s, NULL);
+}
+
+void MusclePathSurrogate::calcLengthAndSpeed(const State& s, int index,
+	double& length, double& speed) const
+{
+	const Fit& fit = _fits[index];
+	// one gradient buffer per thread, so evaluation does not allocate
+	static thread_local vector<double> gradient;
+	length = evaluate(fit, s, &gradient);
+	speed = 0;
+	for(size_t j=0; j<fit.coordinates.size(); ++j)
+		speed += gradient[j]*fit.coordinates[j]->getSpeedValue(s);
+}
+
+//=============================================================================
+// ACCURACY
+//=============================================================================
+void MusclePathSurrogate::printAccuracyReport(const State& s, ostream& out,
+	int numSamples) const
+{
+	lock_guard<mutex> lock(_mutex);
+
+	typedef chrono::steady_clock Clock;
+	const MultibodySystem& system = _model.getMultibodySystem();
+	SimTK::Random::Uniform rng(-1.0, 1.0);
+	rng.setSeed(12345);
+
+	out << "muscle\tcoordinates\tterms\trms_length_mm\tmax_length_mm\t"
+		"rms_speed_mm_s\tmax_speed_mm_s\texact_us\tsurrogate_us" << endl;
+
+	double exactTotal = 0, surrogateTotal = 0;
+	for(size_t f=0; f<_fits.size(); ++f){
+		const Fit& fit = _fits[f];
+		const Muscle& muscle = _model.getMuscles().get(fit.muscle);
+		int nc = (int)fit.coordinates.size();
+
+		State w = s;
+		double sumL = 0, maxL = 0, sumV = 0, maxV = 0;
+		double exactTime = 0, surrogateTime = 0;
+		for(int k=0; k<numSamples; ++k){
+			for(int j=0; j<nc; ++j){
+				fit.coordinates[j]->setValue(w,
+					fit.center[j] + rng.getValue()/fit.invHalfRange[j], false);
+				fit.coordinates[j]->setSpeedValue(w, 2.0*rng.getValue());
+			}
+
+			// the exact path is computed on first use after each realization
+			system.realize(w, Stage::Position);
+			Clock::time_point t0 = Clock::now();
+			double length = muscle.getLength(w);
+			exactTime += chrono::duration<double>(Clock::now() - t0).count();
+			system.realize(w, Stage::Velocity);
+			t0 = Clock::now();
+			double speed = muscle.getLengtheningSpeed(w);
+			exactTime += chrono::duration<double>(Clock::now() - t0).count();
+
+			double fitLength, fitSpeed;
+			t0 = Clock::now();
+			calcLengthAndSpeed(w, (int)f, fitLength, fitSpeed);
+			surrogateTime += chrono::duration<double>(Clock::now() - t0).count();
+
+			double dL = fabs(fitLength - length), dV = fabs(fitSpeed - speed);
+			sumL += dL*dL;
+			sumV += dV*dV;
+			maxL = std::max(maxL, dL);
+			maxV = std::max(maxV, dV);
+		}
+
+		int n = std::max(1, numSamples);
+		out << fit.muscle << '\t' << nc << '\t' << fit.coefficients.size() << '\t'
+			<< 1000*sqrt(sumL/n) << '\t' << 1000*maxL << '\t'
+			<< 1000*sqrt(sumV/n) << '\t' << 1000*maxV << '\t'
+			<< 1e6*exactTime/n << '\t' << 1e6*surrogateTime/n << endl;
+		exactTotal += exactTime;
+		surrogateTotal += surrogateTime;
+	}
+
+	if(surrogateTotal > 0)
+		out << "# exact/surrogate evaluation time: " << exactTotal/surrogateTotal << endl;
+}
+
+//=============================================================================
+// CACHE
+//=============================================================================
+bool MusclePathSurrogate::resolveCoordinates(Fit& fit) const
+{
+	const CoordinateSet& coords = _model.getCoordinateSet();
+	fit.coordinates.clear();
+	for(size_t j=0; j<fit.coordinateNames.size(); ++j){
+		if(!coords.contains(fit.coordinateNames[j]))
+			return false;
+		fit.coordinates.push_back(&coords.get(fit.coordinateNames[j]));
+	}
+	return true;
+}
+
+void MusclePathSurrogate::readCache(const State& s)
+{
+	if(_cacheFile.empty())
+		return;
+	ifstream in(_cacheFile.c_str());
+	if(!in.good())
+		return;
+
+	// pathfit <version>
+	// muscle <name> <degree> <coordinates> <terms>
+	// signature <settings hash> <probes> <probe lengths...>
+	// coordinate <name> <center> <1/half range>	(one per coordinate)
+	// <exponents...> <coefficient>					(one per term)
+	string keyword;
+	int version = 0;
+	if(!(in >> keyword >> version) || keyword != "pathfit" || version != CacheVersion){
+		// an older format without signatures: fit everything again
+		cout << "MusclePathSurrogate: " << _cacheFile << " has an older format "
+			"and will be replaced." << endl;
+		return;
+	}
+
+	int numStale = 0;
+	while(in >> keyword){
+		if(keyword != "muscle")
+			throw Exception("MusclePathSurrogate: unexpected '" + keyword
+				+ "' in " + _cacheFile + ".");
+		Fit fit;
+		int nc, nt, np;
+		in >> fit.muscle >> fit.degree >> nc >> nt;
+		in >> keyword >> fit.settingsHash >> np;
+		if(keyword != "signature" || np < 0 || np > NumProbes)
+			throw Exception("MusclePathSurrogate: missing signature in " + _cacheFile + ".");
+		fit.probeLengths.resize(np);
+		for(int p=0; p<np; ++p)
+			in >> fit.probeLengths[p];
+		fit.coordinateNames.resize(nc);
+		fit.center.resize(nc);
+		fit.invHalfRange.resize(nc);
+		for(int j=0; j<nc; ++j)
+			in >> keyword >> fit.coordinateNames[j] >> fit.center[j] >> fit.invHalfRange[j];
+		fit.exponents.resize((size_t)nt*nc);
+		fit.coefficients.resize(nt);
+		for(int t=0; t<nt; ++t){
+			for(int j=0; j<nc; ++j)
+				in >> fit.exponents[t*nc + j];
+			in >> fit.coefficients[t];
+		}
+		if(!in)
+			throw Exception("MusclePathSurrogate: " + _cacheFile + " is truncated.");
+
+		// skip muscles already fit, those the model no longer has, and those
+		// whose coordinates changed
+		if(getIndex(fit.muscle) >= 0
+			|| !_model.getMuscles().contains(fit.muscle) || !resolveCoordinates(fit)
+			|| fit.degree > MaxDegree || nc > MaxCoordinates)
+			continue;
+
+		// and fits made from other settings, ranges or path geometry
+		Fit current = fit;
+		calcSignature(s, _model.getMuscles().get(fit.muscle), current);
+		bool matches = current.settingsHash == fit.settingsHash
+			&& current.probeLengths.size() == fit.probeLengths.size();
+		for(size_t p=0; matches && p<fit.probeLengths.size(); ++p)
+			matches = fabs(current.probeLengths[p] - fit.probeLengths[p]) <= ProbeTolerance;
+		if(!matches){
+			++numStale;
+			continue;
+		}
+
+		_index[fit.muscle] = (int)_fits.size();
+		_fits.push_back(fit);
+	}
+
+	if(numStale > 0)
+		cout << "MusclePathSurrogate: " << numStale << " fits in " << _cacheFile
+			<< " no longer match the model and will be made again." << endl;
+}
+
+void MusclePathSurrogate::writeCache() const
+{
+	if(_cacheFile.empty())
+		return;
+
+	// write a file of its own and rename it over the cache, so the cache is
+	// never seen half written, even by another process
+	ostringstream tempName;
+	tempName << _cacheFile << ".tmp" << hex
+		<< chrono::steady_clock::now().time_since_epoch().count();
+	ofstream out(tempName.str().c_str());
+	if(!out.good()){
+		cout << "WARNING - MusclePathSurrogate could not write " << _cacheFile << endl;
+		return;
+	}
+
+	out << setprecision(17);
+	out << "pathfit " << CacheVersion << '\n';
+	for(size_t f=0; f<_fits.size(); ++f){
+		const Fit& fit = _fits[f];
+		int nc = (int)fit.coordinates.size();
+		int nt = (int)fit.coefficients.size();
+		out << "muscle " << fit.muscle << ' ' << fit.degree << ' ' << nc << ' ' << nt << '\n';
+		out << "signature " << fit.settingsHash << ' ' << fit.probeLengths.size();
+		for(size_t p=0; p<fit.probeLengths.size(); ++p)
+			out << ' ' << fit.probeLengths[p];
+		out << '\n';
+		for(int j=0; j<nc; ++j)
+			out << "coordinate " << fit.coordinateNames[j] << ' ' << fit.center[j]
+				<< ' ' << fit.invHalfRange[j] << '\n';
+		for(int t=0; t<nt; ++t){
+			for(int j=0; j<nc; ++j)
+				out << fit.exponents[t*nc + j] << ' ';
+			out << fit.coefficients[t] << '\n';
+		}
+	}
+
+	out.close();
+	bool written = !out.fail();
+	if(written && rename(tempName.str().c_str(), _cacheFile.c_str()) != 0){
+		// not every platform renames over an existing file
+		remove(_cacheFile.c_str());
+		written = rename(tempName.str().c_str(), _cacheFile.c_str()) == 0;
+	}
+	if(!written){
+		remove(tempName.str().c_str());
+		cout << "WARNING - MusclePathSurrogate could not write " << _cacheFile << endl;
+	}
+}
@@ -0,0 +1,172 @@
+#ifndef OPENSIM_MusclePathSurrogate_H_
+#define OPENSIM_MusclePathSurrogate_H_
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  MusclePathSurrogate.h                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace SimTK {
+class State;
+}
+
+namespace OpenSim {
+
+class Model;
+class Muscle;
+class Coordinate;
+
+//=============================================================================
+//=============================================================================
+/**
+ * MusclePathSurrogate approximates muscle-tendon path lengths by polynomials
+ * of the coordinates each path spans, so that path reflexes can sense length
+ * and lengthening speed without evaluating the geometry path and its
+ * wrapping objects.
+ *
+ * For each muscle, the spanned coordinates are those that change the path
+ * length when perturbed. Locked and constrained coordinates are left out, so
+ * the surrogate is not suited to paths crossing coupled coordinates. The
+ * length is fit by least squares, over poses sampled uniformly within the
+ * coordinate ranges, with a polynomial of total degree getDegree() in the
+ * coordinates scaled to [-1, 1]. The lengthening speed is the analytic time
+ * derivative of the polynomial, from the coordinate speeds.
+ *
+ * Fits are made once per model and cached in a text file (by default
+ * <model name>.pathfit in the working directory). The file is replaced
+ * whole through a rename, and the surrogates of a process that share it
+ * (e.g. of copies of a model run in parallel) read and update it in turn.
+ * Muscles already in the file are loaded rather than fit again, provided
+ * the fit still matches the model: each fit is stored with a hash of the
+ * fit settings (degree and samples per term) and of the names and ranges
+ * of its coordinates, and with the path lengths at a few fixed probe poses
+ * spread over the ranges of all free coordinates. A change of path points,
+ * wrap objects, joints or coordinate ranges changes those lengths, and a
+ * fit that does not match is made again.
+ *
+ * Controllers of the same model share a surrogate through getShared().
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API MusclePathSurrogate {
+
+public:
+	explicit MusclePathSurrogate(const Model& model);
+
+	/** Total degree of the polynomials fit from now on (default 3). */
+	void setDegree(int degree) { _degree = degree; }
+	int getDegree() const { return _degree; }
+	/** Number of sampled poses per polynomial term (default 4). */
+	void setSamplesPerTerm(int samples) { _samplesPerTerm = samples; }
+	/** Cache file. Set empty to neither read nor write a cache. */
+	void setCacheFile(const std::string& fileName) { _cacheFile = fileName; }
+	const std::string& getCacheFile() const { return _cacheFile; }
+
+	/** Make sure every listed muscle has a fit, loading the cache file or
+	 * fitting (and updating the cache) as needed. Safe to call from several
+	 * threads.
+	 *
+	 * @param s			a state of the model, used as the base pose
+	 * @param muscles	muscles to be sensed through the surrogate
+	 */
+	void prepare(const SimTK::State& s, const std::vector<const Muscle*>& muscles);
+
+	/** Index of the muscle's fit, or -1 if it has none. */
+	int getIndex(const std::string& muscleName) const;
+
+	/** Path length and lengthening speed of a fitted muscle. */
+	void calcLengthAndSpeed(const SimTK::State& s, int index,
+		double& length, double& speed) const;
+	double calcLength(const SimTK::State& s, int index) const;
+
+	/** Compare the fits with the exact paths at random poses and speeds,
+	 * printing the length and speed errors and the evaluation time of both
+	 * for every fitted muscle. */
+	void printAccuracyReport(const SimTK::State& s, std::ostream& out,
+		int numSamples = 200) const;
+
+	/** Get the surrogate shared by all controllers of the model. */
+	static std::shared_ptr<MusclePathSurrogate> getShared(const Model& model);
+
+private:
+	// polynomial fit of one muscle's path length
+	struct Fit {
+		std::string muscle;
+		std::vector<const Coordinate*> coordinates;
+		std::vector<std::string> coordinateNames;
+		std::vector<double> center;		// middle of each coordinate range
+		std::vector<double> invHalfRange;	// 1/half of each coordinate range
+		int degree;
+		// exponents of each term (term-major) and their coefficients
+		std::vector<int> exponents;
+		std::vector<double> coefficients;
+		// what the fit was made from: hashed settings and coordinate ranges,
+		// and the path lengths at the probe poses
+		unsigned long long settingsHash;
+		std::vector<double> probeLengths;
+	};
+
+	// coordinates the muscle's path length depends on
+	void findSpannedCoordinates(SimTK::State& s, const Muscle& muscle,
+		Fit& fit) const;
+	// least squares fit of the muscle's path length
+	void fitMuscle(const SimTK::State& s, const Muscle& muscle, Fit& fit) const;
+	// polynomial value and gradient with respect to the coordinates
+	double evaluate(const Fit& fit, const SimTK::State& s,
+		std::vector<double>* gradient) const;
+	// resolve the coordinate names of a fit in the model
+	bool resolveCoordinates(Fit& fit) const;
+	// signature of the fit's muscle and coordinates under the current settings
+	void calcSignature(const SimTK::State& s, const Muscle& muscle, Fit& fit) const;
+
+	// read the fits that still match the model at the state
+	void readCache(const SimTK::State& s);
+	void writeCache() const;
+
+	const Model& _model;
+	int _degree;
+	int _samplesPerTerm;
+	std::string _cacheFile;
+
+	std::vector<Fit> _fits;
+	std::map<std::string, int> _index;
+	mutable std::mutex _mutex;
+
+};	// END of class MusclePathSurrogate
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_MusclePathSurrogate_H_
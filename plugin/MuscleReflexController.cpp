@@ -0,0 +1,605 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  MuscleReflexController.cpp                    *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "MuscleReflexController.h"
+#include "ReflexTracer.h"
+#include "SignalDelayLine.h"
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// names of the cache variables holding decimated controls
+	const string HeldControls = "held_controls";
+	const string HeldInterval = "held_interval";
+	// name of the cache variable memoizing the controls of a realization
+	const string MemoControls = "memo_controls";
+	// name of the discrete variable latching the contact gate open
+	const string GateLatched = "gate_latched";
+	// names of the trace tracks
+	const string SimTimeTrack = "sim_time";
+
+	// evaluations a muscle stays in the active set after its reflex has
+	// fallen to zero, so that muscles hovering at threshold do not churn
+	const int ActiveSetHold = 8;
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+//_____________________________________________________________________________
+/* Default constructor. */
+MuscleReflexController::MuscleReflexController() :
+	_numRequests(0),
+	_numEvaluations(0),
+	_numMemoHits(0),
+	_activeSum(0),
+	_traceMode(TraceOff),
+	_scheduleVariable(ScheduleTime),
+	_scheduleCoordinate(NULL),
+	_fusedController(NULL)
+{
+	constructProperties();
+}
+
+
+/*
+ * Construct Properties
+ */
+void MuscleReflexController::constructProperties()
+{
+	constructProperty_update_interval(0.0);
+	constructProperty_trace_mode("off");
+	constructProperty_trace_file("");
+	constructProperty_gate_forces();
+	constructProperty_gate_threshold(10.0);
+	constructProperty_gate_latch(true);
+	constructProperty_gate_warmup(true);
+	constructProperty_gain_schedule();
+	constructProperty_schedule_variable("time");
+	constructProperty_schedule_period(1.0);
+	Array<double> range(0.0, 2);
+	range[1] = 1.0;
+	constructProperty_schedule_range(range);
+	constructProperty_schedule_samples(256);
+	constructProperty_memory_budget(0.0);
+}
+
+void MuscleReflexController::connectToModel(Model &model)
+{
+	ReflexTraceScope traceScope("setup", getName());
+	Super::connectToModel(model);
+
+	// get the list of actuators assigned to the reflex controller
+	Set<Actuator>& actuators = updActuators();
+
+	int cnt=0;
+
+	while(cnt < actuators.getSize()){
+		Muscle *musc = dynamic_cast<Muscle*>(&actuators[cnt]);
+		// control muscles only
+		if(!musc){
+			cout << "WARNING - controller named " << getName() << " (" << getConcreteClassName();
+			cout << ") assigned a non-muscle actuator " << actuators[cnt].getName();
+			cout << " which will be ignored." << endl;
+			actuators.remove(cnt);
+		}else
+			cnt++;
+	}
+
+	if(get_update_interval() < 0)
+		throw Exception("MuscleReflexController: update_interval cannot be negative.");
+	if(get_memory_budget() < 0)
+		throw Exception("MuscleReflexController: memory_budget cannot be negative.");
+
+	// a copy of the model has its own fused controller, or may have lost it
+	const ControllerSet& controllers = model.getControllerSet();
+	if(!_fusedInto.empty() && controllers.contains(_fusedInto))
+		_fusedController = &controllers.get(_fusedInto);
+	else
+		setFusedInto(NULL);
+
+	_muscleControls.resize(actuators.getSize());
+	_activeSet.clear();
+	_idleCount.assign(actuators.getSize(), ActiveSetHold);
+
+	setupTrace();
+	setupGate(model);
+	setupSchedule(model);
+}
+
+string MuscleReflexController::getTraceFileName() const
+{
+	return get_trace_file().empty() ? getName() + ".ctrace" : get_trace_file();
+}
+
+void MuscleReflexController::tagTraceFile(const string& tag)
+{
+	if(get_trace_mode() != "record")
+		return;
+	string fileName = getTraceFileName();
+	size_t slash = fileName.find_last_of("/\\");
+	size_t dot = fileName.find_last_of('.');
+	if(dot == string::npos || (slash != string::npos && dot < slash))
+		dot = fileName.size();
+	set_trace_file(fileName.substr(0, dot) + "." + tag + fileName.substr(dot));
+}
+
+void MuscleReflexController::setupTrace()
+{
+	const Set<Actuator>& actuators = getActuatorSet();
+
+	_trace.reset();
+	_traceChannels.clear();
+
+	if(get_trace_mode() == "off"){
+		_traceMode = TraceOff;
+	}
+	else if(get_trace_mode() == "record"){
+		_traceMode = TraceRecord;
+		vector<string> names;
+		for(int i=0; i<actuators.getSize(); ++i)
+			names.push_back(actuators[i].getName());
+		_trace.reset(new ControlTrace());
+		_trace->openForRecording(getTraceFileName(), names);
+	}
+	else if(get_trace_mode() == "replay"){
+		_traceMode = TraceReplay;
+		_trace.reset(new ControlTrace());
+		_trace->load(getTraceFileName());
+		// match the recorded channels to our muscles by name
+		const vector<string>& names = _trace->getChannelNames();
+		for(int i=0; i<actuators.getSize(); ++i){
+			vector<string>::const_iterator it =
+				find(names.begin(), names.end(), actuators[i].getName());
+			if(it == names.end())
+				throw Exception("MuscleReflexController: " + getTraceFileName()
+					+ " has no recorded controls for " + actuators[i].getName() + ".");
+			_traceChannels.push_back((int)(it - names.begin()));
+		}
+	}
+	else
+		throw Exception("MuscleReflexController: unknown trace_mode '"
+			+ get_trace_mode() + "'.");
+}
+
+void MuscleReflexController::setupGate(const Model& model)
+{
+	_gateForces.clear();
+
+	const ForceSet& forces = model.getForceSet();
+	for(int i=0; i<getProperty_gate_forces().size(); ++i){
+		int index = forces.getIndex(get_gate_forces(i));
+		if(index < 0)
+			throw Exception("MuscleReflexController: gate force '"
+				+ get_gate_forces(i) + "' not found in the model.");
+		_gateForces.push_back(&forces[index]);
+	}
+	if(!_gateForces.empty() && get_gate_threshold() <= 0)
+		throw Exception("MuscleReflexController: gate_threshold must be positive.");
+}
+
+//=============================================================================
+// CONTACT GATE
+//=============================================================================
+/**
+ * Triggers when the contact force rises through the gate threshold and
+ * latches the gate open. Once latched the witness stays positive.
+ */
+class MuscleReflexController::GateHandler : public SimTK::TriggeredEventHandler {
+public:
+	GateHandler(const MuscleReflexController& controller) :
+		TriggeredEventHandler(Stage::Velocity), _controller(controller)
+	{
+		getTriggerInfo().setTriggerOnFallingSignTransition(false);
+	}
+
+	Real getValue(const State& s) const
+	{
+		if(_controller.getDiscreteVariable(s, GateLatched) > 0.5)
+			return 1.0;
+		return _controller.getGateContactForce(s) - _controller.get_gate_threshold();
+	}
+
+	void handleEvent(State& s, Real accuracy, bool& shouldTerminate) const
+	{
+		shouldTerminate = false;
+		_controller.setDiscreteVariable(s, GateLatched, 1.0);
+	}
+
+private:
+	const MuscleReflexController& _controller;
+};
+
+double MuscleReflexController::getGateContactForce(const State& s) const
+{
+	double total = 0;
+	for(size_t k=0; k<_gateForces.size(); ++k){
+		// the first record values are the force on the first contact body
+		Array<double> values = _gateForces[k]->getRecordValues(s);
+		if(values.getSize() >= 3)
+			total += sqrt(values[0]*values[0] + values[1]*values[1] + values[2]*values[2]);
+	}
+	return total;
+}
+
+bool MuscleReflexController::isGateOpen(const State& s) const
+{
+	if(_gateForces.empty())
+		return true;
+	if(get_gate_latch() && getDiscreteVariable(s, GateLatched) > 0.5)
+		return true;
+	// also covers states the event handler never saw, e.g. offline
+	// evaluation, and an unlatched gate
+	return getGateContactForce(s) >= get_gate_threshold();
+}
+
+bool MuscleReflexController::isGateLatched(const State& s) const
+{
+	return getDiscreteVariable(s, GateLatched) > 0.5;
+}
+
+void MuscleReflexController::setGateLatched(State& s, bool latched) const
+{
+	setDiscreteVariable(s, GateLatched, latched ? 1.0 : 0.0);
+}
+
+void MuscleReflexController::setupSchedule(const Model& model)
+{
+	_gainSchedule.clear();
+	_scheduleVariable = ScheduleTime;
+	_scheduleCoordinate = NULL;
+
+	if(getProperty_gain_schedule().size() == 0)
+		return;
+
+	const string& variable = get_schedule_variable();
+	double start = get_schedule_range(0);
+	double end = get_schedule_range(1);
+	if(variable == "phase"){
+		if(get_schedule_period() <= 0)
+			throw Exception("MuscleReflexController: schedule_period must be positive.");
+		_scheduleVariable = SchedulePhase;
+		start = 0;
+		end = 1;
+	}
+	else if(variable != "time"){
+		if(!model.getCoordinateSet().contains(variable))
+			throw Exception("MuscleReflexController: schedule_variable " + variable
+				+ " is neither time, phase nor a coordinate of the model.");
+		_scheduleVariable = ScheduleCoordinate;
+		_scheduleCoordinate = &model.getCoordinateSet().get(variable);
+	}
+
+	_gainSchedule.sample(get_gain_schedule(), start, end, get_schedule_samples());
+}
+
+double MuscleReflexController::getGainScale(const State& s) const
+{
+	if(_gainSchedule.empty())
+		return 1.0;
+
+	double x = s.getTime();
+	if(_scheduleVariable == SchedulePhase){
+		x /= get_schedule_period();
+		x -= std::floor(x);
+	}
+	else if(_scheduleVariable == ScheduleCoordinate)
+		x = _scheduleCoordinate->getValue(s);
+	return _gainSchedule.getValue(x);
+}
+
+void MuscleReflexController::addToSystem(SimTK::MultibodySystem& system) const
+{
+	Super::addToSystem(system);
+
+	// Held controls must survive across time steps, so they depend only on
+	// the Model stage; they are replaced whenever a new update interval is
+	// entered.
+	addCacheVariable<SimTK::Vector>(HeldControls,
+		SimTK::Vector(getActuatorSet().getSize(), 0.0), Stage::Model);
+	addCacheVariable<double>(HeldInterval, -1.0, Stage::Model);
+	// Controls of kinematics-only reflexes are fixed for a realization of
+	// the velocities; changing time, q or u invalidates them.
+	addCacheVariable<SimTK::Vector>(MemoControls,
+		SimTK::Vector(getActuatorSet().getSize(), 0.0), Stage::Velocity);
+
+	// the latched gate changes the controls
+	Array<string> gateVariables;
+	gateVariables.append(GateLatched);
+	addDiscreteVariables(gateVariables, Stage::Velocity);
+	if(!_gateForces.empty() && get_gate_latch())
+		system.addEventHandler(new GateHandler(*this));
+
+	applyMemoryBudget();
+}
+
+void MuscleReflexController::initStateFromProperties(State& s) const
+{
+	Super::initStateFromProperties(s);
+	resetSimulationState();
+
+	// fit (or load) the muscles' paths now rather than in the first
+	// simulation
+	if(_pathSurrogate)
+		preparePathSurrogate(s);
+}
+
+void MuscleReflexController::resetSimulationState() const
+{
+	// samples of an earlier simulation would be read as this one's past
+	if(SignalDelayLine* history = getSensorHistory())
+		history->clear();
+	_activeSet.clear();
+	_idleCount.assign(_idleCount.size(), ActiveSetHold);
+	// and a replay starts again from the first recorded request
+	if(_traceMode == TraceReplay)
+		_trace->rewind();
+}
+
+void MuscleReflexController::invalidateHeldControls(const State& s) const
+{
+	setCacheVariable<double>(s, HeldInterval, -1.0);
+}
+
+//=============================================================================
+// MEMORY
+//=============================================================================
+size_t MuscleReflexController::getInternalStateBytes() const
+{
+	return _muscleControls.size()*sizeof(double)
+		+ (_activeSet.capacity() + _idleCount.capacity()
+			+ _traceChannels.capacity() + _surrogateIndex.capacity())*sizeof(int)
+		+ _gateForces.capacity()*sizeof(const Force*);
+}
+
+size_t MuscleReflexController::getMemoryBytes() const
+{
+	const SignalDelayLine* history = getSensorHistory();
+	return getInternalStateBytes() + (history ? history->getMemoryBytes() : 0);
+}
+
+size_t MuscleReflexController::getPeakMemoryBytes() const
+{
+	// the internal state is sized when connecting; only the history grows
+	const SignalDelayLine* history = getSensorHistory();
+	return getInternalStateBytes() + (history ? history->getPeakMemoryBytes() : 0);
+}
+
+size_t MuscleReflexController::getHistoryBytesPerMuscle() const
+{
+	const SignalDelayLine* history = getSensorHistory();
+	return history ? history->getChannelMemoryBytes() : 0;
+}
+
+void MuscleReflexController::applyMemoryBudget() const
+{
+	SignalDelayLine* history = getSensorHistory();
+	if(get_memory_budget() <= 0 || !history)
+		return;
+
+	double remaining = get_memory_budget() - (double)getInternalStateBytes();
+	history->limitMemory(remaining > 0 ? (size_t)remaining : 0);
+}
+
+//=============================================================================
+// COMPUTATIONS
+//=============================================================================
+//_____________________________________________________________________________
+/**
+ * Compute the controls for muscles under influence of this reflex controller
+ *
+ * @param s			current state of the system
+ * @param controls	system wide controls to which this controller can add
+ */
+void MuscleReflexController::computeControls(const State& s, Vector &controls) const
+{
+	// an enabled FusedReflexController adds in this controller's controls
+	if(isFused())
+		return;
+
+	++_numRequests;
+	ReflexTraceScope traceScope("controller", getName(), s.getTime());
+	ReflexTracer::counter(SimTimeTrack, s.getTime());
+
+	if(_traceMode == TraceReplay){
+		// substitute the recorded controls for the reflexes
+		_trace->replay(s.getTime(), _traceChannels, _muscleControls);
+		addInMuscleControls(_muscleControls, controls);
+		return;
+	}
+
+	if(!isGateOpen(s)){
+		// reflexes off: no controls, but keep the sensor history current
+		if(get_gate_warmup() && dependsOnHistory())
+			recordHistory(s);
+		if(_traceMode == TraceRecord){
+			_muscleControls = 0;
+			_trace->record(s.getTime(), _muscleControls);
+		}
+		// held controls predate the gate closing
+		if(get_update_interval() > 0)
+			setCacheVariable<double>(s, HeldInterval, -1.0);
+		return;
+	}
+
+	double interval = get_update_interval();
+	if(interval <= 0 && !dependsOnAuxiliaryStates()
+		&& s.getSystemStage() >= Stage::Velocity){
+		// repeated requests at the same realization copy the first result
+		if(isCacheVariableValid(s, MemoControls))
+			++_numMemoHits;
+		else{
+			Vector& memo = updCacheVariable<SimTK::Vector>(s, MemoControls);
+			memo = 0;
+			computeMuscleControls(s, memo);
+			++_numEvaluations;
+			markCacheVariableValid(s, MemoControls);
+			updateActiveSet(memo);
+			if(_traceMode == TraceRecord)
+				_trace->record(s.getTime(), memo);
+			addInMuscleControls(memo, controls, &_activeSet);
+			return;
+		}
+		const Vector& memo = getCacheVariable<SimTK::Vector>(s, MemoControls);
+		if(_traceMode == TraceRecord)
+			_trace->record(s.getTime(), memo);
+		addInMuscleControls(memo, controls);
+		return;
+	}
+
+	if(interval <= 0){
+		_muscleControls = 0;
+		computeMuscleControls(s, _muscleControls);
+		++_numEvaluations;
+		updateActiveSet(_muscleControls);
+		if(_traceMode == TraceRecord)
+			_trace->record(s.getTime(), _muscleControls);
+		addInMuscleControls(_muscleControls, controls, &_activeSet);
+		return;
+	}
+
+	// index of the update interval containing the current time
+	double current = floor(s.getTime()/interval);
+
+	if(!isCacheVariableValid(s, HeldInterval)
+		|| getCacheVariable<double>(s, HeldInterval) != current){
+		// entered a new update interval (or stepped back into an earlier one)
+		Vector& held = updCacheVariable<SimTK::Vector>(s, HeldControls);
+		held = 0;
+		computeMuscleControls(s, held);
+		++_numEvaluations;
+		updateActiveSet(held);
+		markCacheVariableValid(s, HeldControls);
+		setCacheVariable<double>(s, HeldInterval, current);
+	}
+
+	const Vector& held = getCacheVariable<SimTK::Vector>(s, HeldControls);
+	if(_traceMode == TraceRecord)
+		_trace->record(s.getTime(), held);
+	addInMuscleControls(held, controls);
+}
+
+void MuscleReflexController::computeMuscleControlsFromSensors(
+	const double* lengths, const double* speeds, int numFrames,
+	double* muscleControls) const
+{
+	throw Exception("MuscleReflexController: " + getConcreteClassName()
+		+ " controls cannot be computed from sensor arrays.");
+}
+
+void MuscleReflexController::usePathSurrogate(const Model& model, bool use)
+{
+	_surrogateIndex.clear();
+	if(use)
+		_pathSurrogate = MusclePathSurrogate::getShared(model);
+	else
+		_pathSurrogate.reset();
+}
+
+void MuscleReflexController::calcPathLengthAndSpeed(const State& s, int index,
+	double& length, double& speed) const
+{
+	const Set<Actuator>& actuators = getActuatorSet();
+
+	if(!_pathSurrogate){
+		const Muscle& musc = static_cast<const Muscle&>(actuators[index]);
+		length = musc.getLength(s);
+		speed = musc.getLengtheningSpeed(s);
+		return;
+	}
+
+	// prepared with the default state, unless that was made otherwise
+	if((int)_surrogateIndex.size() != actuators.getSize())
+		preparePathSurrogate(s);
+	_pathSurrogate->calcLengthAndSpeed(s, _surrogateIndex[index], length, speed);
+}
+
+void MuscleReflexController::preparePathSurrogate(const State& s) const
+{
+	const Set<Actuator>& actuators = getActuatorSet();
+	vector<const Muscle*> muscles;
+	for(int i=0; i<actuators.getSize(); ++i)
+		muscles.push_back(static_cast<const Muscle*>(&actuators[i]));
+	_pathSurrogate->prepare(s, muscles);
+	_surrogateIndex.resize(muscles.size());
+	for(size_t i=0; i<muscles.size(); ++i)
+		_surrogateIndex[i] = _pathSurrogate->getIndex(muscles[i]->getName());
+}
+
+void MuscleReflexController::updateActiveSet(const Vector& muscleControls) const
+{
+	int nm = muscleControls.size();
+
+	// rebuild the set in muscle order: muscles with a reflex, and those
+	// whose reflex ended less than ActiveSetHold evaluations ago
+	_activeSet.clear();
+	for(int i=0; i<nm; ++i){
+		if(muscleControls[i] != 0)
+			_idleCount[i] = 0;
+		else if(_idleCount[i] < ActiveSetHold)
+			++_idleCount[i];
+		if(_idleCount[i] < ActiveSetHold)
+			_activeSet.push_back(i);
+	}
+	if(nm > 0)
+		_activeSum += (double)_activeSet.size()/nm;
+}
+
+double MuscleReflexController::getAverageActiveFraction() const
+{
+	return _numEvaluations > 0 ? _activeSum/_numEvaluations : 0.0;
+}
+
+void MuscleReflexController::addInMuscleControls(const Vector& muscleControls,
+	Vector& controls, const vector<int>* active) const
+{
+	const Set<Actuator>& actuators = getActuatorSet();
+
+	// add reflex controls to whatever controls are already in place; muscles
+	// without a reflex add nothing
+	if(active){
+		for(size_t k=0; k<active->size(); ++k){
+			int i = (*active)[k];
+			if(muscleControls[i] != 0)
+				actuators[i].addInControls(Vector(1, &muscleControls[i], true), controls);
+		}
+		return;
+	}
+	for(int i=0; i<actuators.getSize(); ++i)
+		if(muscleControls[i] != 0)
+			actuators[i].addInControls(Vector(1, &muscleControls[i], true), controls);
+}
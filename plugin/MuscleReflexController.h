@@ -0,0 +1,376 @@
+#ifndef OPENSIM_MuscleReflexController_H_
+#define OPENSIM_MuscleReflexController_H_
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  MuscleReflexController.h                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <OpenSim/Simulation/Control/Controller.h>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+#include "ControlTrace.h"
+#include "MusclePathSurrogate.h"
+#include "GainSchedule.h"
+
+#include <memory>
+#include <vector>
+
+
+namespace OpenSim {
+
+class Coordinate;
+class Force;
+class SignalDelayLine;
+
+//=============================================================================
+//=============================================================================
+/**
+ * MuscleReflexController is the abstract base of the reflex controllers in
+ * this plugin. A reflex controller drives only muscles, producing one control
+ * per muscle; non-muscle actuators assigned to it are ignored.
+ *
+ * Concrete controllers implement computeMuscleControls() to compute the
+ * reflex control of each of their muscles. This class adds those controls to
+ * the model controls, and provides the behavior common to all reflexes:
+ *
+ * - Control-rate decimation. Integrators ask for controls at every stage of
+ *   every trial step, but reflexes need not be updated faster than the
+ *   neural update rate. With a positive update_interval the reflexes are
+ *   only recomputed when simulated time enters a new update interval, and
+ *   the last controls, cached in the State, are held in between.
+ *
+ * - Deterministic replay. In "record" trace mode every control request is
+ *   appended to a binary ControlTrace. In "replay" mode the recorded
+ *   controls, served request by request in the recorded order, are
+ *   substituted for the reflexes, which are not evaluated at all. This takes the reflexes out of the loop when
+ *   bisecting integrator or contact problems.
+ *
+ * - Contact gating. With gate_forces naming contact forces (e.g. foot_r and
+ *   foot_l), the reflexes are off, and their controls zero, until the total
+ *   contact force reaches gate_threshold. A Simbody event localizes the
+ *   first contact and latches the gate open for the rest of the simulation
+ *   (unless gate_latch is off). While the gate is closed, controllers with a
+ *   sensor history only record their sensors, so the delayed signals are
+ *   ready when the gate opens; the delay lines keep no more history than
+ *   the delays require.
+ *
+ * - Gain scheduling. A gain_schedule Function scales the controller's reflex
+ *   gains with time, a cyclic phase (e.g. of the gait cycle) or a coordinate
+ *   (e.g. knee flexion through a landing). The function is tabulated when
+ *   the controller connects to its model, so during a simulation the gains
+ *   of all the controller's muscles cost one table lookup per evaluation.
+ *
+ * - Memory accounting. getMemoryBytes() reports the bytes held by the
+ *   controller's internal state and sensor history, with its peak. With a
+ *   positive memory_budget the sensor history is limited to what remains of
+ *   the budget, and decimates its older samples instead of growing further.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API MuscleReflexController : public Controller {
+OpenSim_DECLARE_ABSTRACT_OBJECT(MuscleReflexController, Controller);
+
+public:
+//=============================================================================
+// PROPERTIES
+//=============================================================================
+    /** @name Property declarations
+    These are the serializable properties associated with a MuscleReflexController.*/
+    /**@{**/
+	OpenSim_DECLARE_PROPERTY(update_interval, double,
+		"Interval (seconds) at which the reflexes are recomputed, holding the "
+		"controls in between (e.g. 0.001 for a 1 kHz neural update rate). "
+		"0 recomputes the reflexes every time controls are requested.");
+	OpenSim_DECLARE_PROPERTY(trace_mode, std::string,
+		"Control trace mode: off, record (write the controls to trace_file) or "
+		"replay (substitute the controls recorded in trace_file).");
+	OpenSim_DECLARE_PROPERTY(trace_file, std::string,
+		"Binary control trace file. Defaults to <controller name>.ctrace.");
+	OpenSim_DECLARE_LIST_PROPERTY(gate_forces, std::string,
+		"Names of the contact forces that switch the reflexes on. Empty "
+		"(default) leaves the reflexes on throughout.");
+	OpenSim_DECLARE_PROPERTY(gate_threshold, double,
+		"Total contact force (N) at which the reflexes switch on.");
+	OpenSim_DECLARE_PROPERTY(gate_latch, bool,
+		"Keep the reflexes on once they have switched on (default true).");
+	OpenSim_DECLARE_PROPERTY(gate_warmup, bool,
+		"Record the sensor history of delayed reflexes while switched off "
+		"(default true). Otherwise the delayed signals read zero until they "
+		"reach back past the switch.");
+	OpenSim_DECLARE_OPTIONAL_PROPERTY(gain_schedule, Function,
+		"Factor on the reflex gains as a function of schedule_variable. "
+		"Absent (default) leaves the gains constant.");
+	OpenSim_DECLARE_PROPERTY(schedule_variable, std::string,
+		"Variable of the gain_schedule: time (default), phase (time within "
+		"schedule_period, from 0 to 1) or the name of a coordinate.");
+	OpenSim_DECLARE_PROPERTY(schedule_period, double,
+		"Period (seconds) of the phase schedule variable.");
+	OpenSim_DECLARE_LIST_PROPERTY_SIZE(schedule_range, double, 2,
+		"Interval of time or of the coordinate over which the gain_schedule "
+		"is tabulated; the end values hold outside it.");
+	OpenSim_DECLARE_PROPERTY(schedule_samples, int,
+		"Number of uniformly spaced samples tabulating the gain_schedule.");
+	OpenSim_DECLARE_PROPERTY(memory_budget, double,
+		"Bytes of internal state, sensor history included, the controller "
+		"may hold; older sensor history is decimated to stay within it. "
+		"0 (default) sets no limit.");
+
+//=============================================================================
+// METHODS
+//=============================================================================
+	//--------------------------------------------------------------------------
+	// CONSTRUCTION AND DESTRUCTION
+	//--------------------------------------------------------------------------
+	/** Default constructor. */
+	MuscleReflexController();
+	// Uses default (compiler-generated) destructor, copy constructor and copy
+    // assignment operator.
+
+	/** Compute the controls for actuators (muscles). Evaluates (or holds) the
+	 * reflex controls and adds them to the model controls.
+	 *
+	 * @param s			system state
+	 * @param controls	writable model controls
+	 */
+	void computeControls(const SimTK::State& s, SimTK::Vector &controls) const OVERRIDE_11;
+
+	/** Compute the reflex control of each muscle controlled by this
+	 *  controller. This method defines the behavior of a concrete reflex.
+	 *
+	 * @param s					system state
+	 * @param muscleControls	reflex controls, one per muscle in actuator
+	 *							order, sized and zeroed by the caller
+	 */
+	virtual void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector& muscleControls) const = 0;
+
+	/** True if the controls depend on earlier evaluations, e.g. through a
+	 *  delayed sensor history, so that evaluations must proceed in time
+	 *  order. Controllers without history can be evaluated at many states
+	 *  concurrently. */
+	virtual bool dependsOnHistory() const { return false; }
+
+	/** Reflex controls computed directly from arrays of sensed signals,
+	 *  for batch evaluation outside a simulation. Arrays are frame-major,
+	 *  numFrames rows of one value per muscle (in actuator order).
+	 *
+	 * @param lengths			sensed lengths (path or fiber, per controller)
+	 * @param speeds			sensed lengthening speeds
+	 * @param numFrames			number of frames
+	 * @param muscleControls	filled with the controls, same layout
+	 *
+	 * Controllers that do not sense lengths and speeds alone throw. */
+	virtual void computeMuscleControlsFromSensors(const double* lengths,
+		const double* speeds, int numFrames, double* muscleControls) const;
+
+	/** History buffer of this controller's sensors, if it has one. */
+	virtual SignalDelayLine* getSensorHistory() const { return NULL; }
+
+	/** True if the controls read auxiliary states (fiber lengths, sensor
+	 *  states), which can change without invalidating the velocity stage.
+	 *  Other controllers' controls are memoized per velocity realization,
+	 *  so repeated requests for the same state (force evaluation, analyses,
+	 *  reporters) cost a copy. */
+	virtual bool dependsOnAuxiliaryStates() const { return false; }
+
+	/** Record this controller's sensors in its history without computing
+	 *  controls, while contact gating keeps the reflexes off. Controllers
+	 *  without history need not implement it. */
+	virtual void recordHistory(const SimTK::State& s) const {}
+
+	/** Muscles (indices in actuator order) whose present sensor signals the
+	 *  control of the index-th muscle reads, appended to muscles. By default
+	 *  a muscle's reflex senses only that muscle. */
+	virtual void getSensedMuscles(int index, std::vector<int>& muscles) const
+	{	muscles.push_back(index); }
+
+	/** Discard the controls held for the current update interval, so that
+	 *  the next request evaluates the reflexes again, e.g. after the muscle
+	 *  states were changed in place. */
+	void invalidateHeldControls(const SimTK::State& s) const;
+
+	/** True if the reflexes are on: always, without gate_forces. */
+	bool isGateOpen(const SimTK::State& s) const;
+	/** Total magnitude (N) of the gate_forces acting in the state. */
+	double getGateContactForce(const SimTK::State& s) const;
+	/** True if first contact latched the gate open in the state. */
+	bool isGateLatched(const SimTK::State& s) const;
+	/** Latch or release the gate, e.g. to carry a state over to a copy of
+	 *  the model. */
+	void setGateLatched(SimTK::State& s, bool latched) const;
+
+	/** True if the gains follow a gain_schedule. */
+	bool hasGainSchedule() const { return !_gainSchedule.empty(); }
+	/** Factor on the reflex gains in the state: 1 without a gain_schedule. */
+	double getGainScale(const SimTK::State& s) const;
+
+	/** Bytes currently held by the controller, its sensor history included.
+	 *  A history shared by several controllers counts toward each. */
+	size_t getMemoryBytes() const;
+	/** Largest getMemoryBytes() since the controller connected. */
+	size_t getPeakMemoryBytes() const;
+	/** Bytes of sensor history held per muscle. */
+	size_t getHistoryBytesPerMuscle() const;
+
+	/** Number of times controls were requested from this controller. */
+	long getNumControlRequests() const { return _numRequests; }
+	/** Number of times the reflexes were actually evaluated. */
+	long getNumEvaluations() const { return _numEvaluations; }
+	/** Number of evaluations avoided by reusing the memoized controls of
+	 *  the same realization. */
+	long getNumAvoidedEvaluations() const { return _numMemoHits; }
+	/** Muscles (indices in actuator order) whose reflex was active at the
+	 *  last evaluation, or ended within the last few evaluations. */
+	const std::vector<int>& getActiveMuscles() const { return _activeSet; }
+	/** Average fraction of the muscles in the active set per evaluation. */
+	double getAverageActiveFraction() const;
+
+	/** Name of the FusedReflexController evaluating this controller, or
+	 *  empty. Set when the fused controller is connected to the model; not
+	 *  a property. */
+	const std::string& getFusedInto() const { return _fusedInto; }
+	void setFusedInto(const Controller* fused)
+	{	_fusedInto = fused ? fused->getName() : ""; _fusedController = fused; }
+	/** True while the FusedReflexController evaluating this controller is
+	 *  enabled. The controller then adds no controls of its own. Checked on
+	 *  every call, so disabling the fused controller takes effect at once. */
+	bool isFused() const
+	{	return _fusedController && !_fusedController->isDisabled(); }
+
+	/** Forget the sensor history, active set and replay position of the
+	 *  last simulation, so a model reused without initSystem() (e.g. from a
+	 *  copied default state) starts the next one afresh. */
+	void resetSimulationState() const;
+
+	/** Reset the request and evaluation counters. */
+	void resetCounters() const
+	{	_numRequests = 0; _numEvaluations = 0; _numMemoHits = 0; _activeSum = 0; }
+
+	/** Name of the control trace file used in record and replay modes. */
+	std::string getTraceFileName() const;
+	/** Insert a tag before the extension of the trace file being recorded
+	 *  (name.ctrace becomes name.<tag>.ctrace), so copies of the model
+	 *  recording at the same time write separate files. Takes effect when
+	 *  the controller is next connected to its model. */
+	void tagTraceFile(const std::string& tag);
+
+protected:
+	// ModelComponent interface to connect this component to its model.
+	// Removes any non-muscle actuators from the actuator set.
+	void connectToModel(Model& aModel) OVERRIDE_11;
+	// ModelComponent interface to add computational elements to the SimTK system
+	void addToSystem(SimTK::MultibodySystem& system) const OVERRIDE_11;
+	// ModelComponent interface to initialize a new default state. A sensor
+	// history shared through the model outlives initSystem(), so it is
+	// cleared here for the new simulation, and the path surrogate is fit.
+	void initStateFromProperties(SimTK::State& s) const OVERRIDE_11;
+
+	// Sense path length and lengthening speed through the model's shared
+	// MusclePathSurrogate rather than the geometry path. Call after
+	// connecting to the model.
+	void usePathSurrogate(const Model& model, bool use);
+	// path length and lengthening speed of the index-th muscle
+	void calcPathLengthAndSpeed(const SimTK::State& s, int index,
+		double& length, double& speed) const;
+	// fit or load the surrogate paths of the muscles
+	void preparePathSurrogate(const SimTK::State& s) const;
+	// Bytes of internal state other than the sensor history. Controllers
+	// with per-muscle buffers add theirs to the base class count.
+	virtual size_t getInternalStateBytes() const;
+
+private:
+	// Connect properties to local pointers.  */
+	void constructProperties();
+	// add the muscle controls to the model controls, visiting only the
+	// active muscles if given
+	void addInMuscleControls(const SimTK::Vector& muscleControls,
+		SimTK::Vector& controls, const std::vector<int>* active = NULL) const;
+	// track the muscles with a reflex after an evaluation
+	void updateActiveSet(const SimTK::Vector& muscleControls) const;
+	// open the trace for record or replay, per trace_mode
+	void setupTrace();
+	// find the gate_forces in the model
+	void setupGate(const Model& model);
+	// tabulate the gain_schedule
+	void setupSchedule(const Model& model);
+	// limit the sensor history to what the memory_budget leaves
+	void applyMemoryBudget() const;
+
+	// event handler latching the gate open at first contact
+	class GateHandler;
+	friend class GateHandler;
+
+	enum TraceMode { TraceOff, TraceRecord, TraceReplay };
+	enum ScheduleVariable { ScheduleTime, SchedulePhase, ScheduleCoordinate };
+
+	//=============================================================================
+	// Private Members
+	//=============================================================================
+	// controls of the current evaluation, reused between calls
+	mutable SimTK::Vector _muscleControls;
+
+	// usage counters
+	mutable long _numRequests;
+	mutable long _numEvaluations;
+	mutable long _numMemoHits;
+
+	// active set of the last evaluation, evaluations since each muscle's
+	// reflex was last non-zero, and the summed active fraction
+	mutable std::vector<int> _activeSet;
+	mutable std::vector<int> _idleCount;
+	mutable double _activeSum;
+
+	// control trace being recorded or replayed, and the trace channel of
+	// each muscle
+	TraceMode _traceMode;
+	std::shared_ptr<ControlTrace> _trace;
+	std::vector<int> _traceChannels;
+
+	// FusedReflexController evaluating this controller, if any
+	std::string _fusedInto;
+	const Controller* _fusedController;
+
+	// contact forces gating the reflexes
+	std::vector<const Force*> _gateForces;
+
+	// tabulated gain_schedule and its variable
+	GainSchedule _gainSchedule;
+	ScheduleVariable _scheduleVariable;
+	const Coordinate* _scheduleCoordinate;
+
+	// path surrogate, if used, and the fit index of each muscle (found when
+	// the default state is initialized)
+	std::shared_ptr<MusclePathSurrogate> _pathSurrogate;
+	mutable std::vector<int> _surrogateIndex;
+
+	//=============================================================================
+};	// END of class MuscleReflexController
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_MuscleReflexController_H_
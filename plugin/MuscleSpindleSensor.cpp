@@ -0,0 +1,221 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  MuscleSpindleSensor.cpp                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "MuscleSpindleSensor.h"
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	string staticStateName(const string& muscle)
+	{	return muscle + "_spindle_static"; }
+
+	string dynamicStateName(const string& muscle)
+	{	return muscle + "_spindle_dynamic"; }
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+//_____________________________________________________________________________
+/* Default constructor. */
+MuscleSpindleSensor::MuscleSpindleSensor()
+{
+	constructProperties();
+}
+
+
+/*
+ * Construct Properties
+ */
+void MuscleSpindleSensor::constructProperties()
+{
+	constructProperty_muscle_list();
+	constructProperty_normalized_rest_length(1.0);
+	constructProperty_static_time_constant(0.05);
+	constructProperty_dynamic_time_constant(0.01);
+	constructProperty_static_gain(1.0);
+	constructProperty_dynamic_gain(1.0);
+}
+
+void MuscleSpindleSensor::connectToModel(Model &model)
+{
+	Super::connectToModel(model);
+
+	if(get_static_time_constant() <= 0 || get_dynamic_time_constant() <= 0)
+		throw Exception("MuscleSpindleSensor: time constants must be positive.");
+
+	int nm = getNumMuscles();
+	_muscles.resize(nm);
+	_restLength.resize(nm);
+	_invOptimalLength.resize(nm);
+	_invMaxSpeed.resize(nm);
+	_fiberLength.assign(nm, 0.0);
+	_fiberVelocity.assign(nm, 0.0);
+	_staticIndex.clear();
+	_dynamicIndex.clear();
+
+	for(int i=0; i<nm; ++i){
+		const Muscle& musc = model.getMuscles().get(get_muscle_list(i));
+		double f_o = musc.getOptimalFiberLength();
+		_muscles[i] = &musc;
+		_restLength[i] = get_normalized_rest_length()*f_o;
+		_invOptimalLength[i] = 1.0/f_o;
+		// unnormalize muscle's maximum contraction velocity (fib_lengths/sec)
+		_invMaxSpeed[i] = 1.0/(f_o*musc.getMaxContractionVelocity());
+	}
+}
+
+void MuscleSpindleSensor::addToSystem(SimTK::MultibodySystem& system) const
+{
+	Super::addToSystem(system);
+
+	// The afferents only feed controls, which are computed from the Velocity
+	// stage. All static states precede all dynamic states.
+	int nm = getNumMuscles();
+	for(int i=0; i<nm; ++i)
+		addStateVariable(staticStateName(get_muscle_list(i)), Stage::Velocity);
+	for(int i=0; i<nm; ++i)
+		addStateVariable(dynamicStateName(get_muscle_list(i)), Stage::Velocity);
+}
+
+void MuscleSpindleSensor::initStateFromProperties(SimTK::State& s) const
+{
+	Super::initStateFromProperties(s);
+
+	// spindles start unstretched
+	int nm = getNumMuscles();
+	for(int i=0; i<nm; ++i){
+		setStateVariable(s, staticStateName(get_muscle_list(i)), 0.0);
+		setStateVariable(s, dynamicStateName(get_muscle_list(i)), 0.0);
+	}
+}
+
+void MuscleSpindleSensor::findStateIndices() const
+{
+	int nm = getNumMuscles();
+	_staticIndex.resize(nm);
+	_dynamicIndex.resize(nm);
+	for(int i=0; i<nm; ++i){
+		_staticIndex[i] = getStateVariableSystemIndex(staticStateName(get_muscle_list(i)));
+		_dynamicIndex[i] = getStateVariableSystemIndex(dynamicStateName(get_muscle_list(i)));
+	}
+}
+
+int MuscleSpindleSensor::getMuscleIndex(const string& muscleName) const
+{
+	return getProperty_muscle_list().findIndex(muscleName);
+}
+
+//=============================================================================
+// COMPUTATIONS
+//=============================================================================
+//_____________________________________________________________________________
+/**
+ * Intrafusal fiber dynamics of every spindle. Returns the derivatives of all
+ * static states followed by those of all dynamic states.
+ *
+ * @param s			current state of the system
+ */
+Vector MuscleSpindleSensor::computeStateVariableDerivatives(const State& s) const
+{
+	int nm = getNumMuscles();
+	if(nm == 0)
+		return Vector();
+	if((int)_staticIndex.size() != nm)
+		findStateIndices();
+
+	// gather the fiber kinematics into contiguous arrays
+	for(int i=0; i<nm; ++i){
+		_fiberLength[i] = _muscles[i]->getFiberLength(s);
+		_fiberVelocity[i] = _muscles[i]->getFiberVelocity(s);
+	}
+
+	const Vector& y = s.getY();
+	double invTauS = 1.0/get_static_time_constant();
+	double invTauD = 1.0/get_dynamic_time_constant();
+
+	Vector derivs(2*nm);
+	double* ds = &derivs[0];
+	double* dd = ds + nm;
+
+	// one pass over the structure of arrays for the whole muscle list
+	for(int i=0; i<nm; ++i){
+		double stretch = (_fiberLength[i] - _restLength[i])*_invOptimalLength[i];
+		double speed = _fiberVelocity[i]*_invMaxSpeed[i];
+		ds[i] = (stretch - y[_staticIndex[i]])*invTauS;
+		dd[i] = (speed - y[_dynamicIndex[i]])*invTauD;
+	}
+	return derivs;
+}
+
+double MuscleSpindleSensor::getSecondaryAfferent(const State& s, int index) const
+{
+	if((int)_staticIndex.size() != getNumMuscles())
+		findStateIndices();
+
+	double x_s = s.getY()[_staticIndex[index]];
+	return get_static_gain()*0.5*(fabs(x_s) + x_s);
+}
+
+double MuscleSpindleSensor::getPrimaryAfferent(const State& s, int index) const
+{
+	// getSecondaryAfferent() finds the state indices if needed
+	double secondary = getSecondaryAfferent(s, index);
+	double x_d = s.getY()[_dynamicIndex[index]];
+	return secondary + get_dynamic_gain()*0.5*(fabs(x_d) + x_d);
+}
+
+void MuscleSpindleSensor::getAfferents(const State& s, Vector& primary,
+	Vector& secondary) const
+{
+	int nm = getNumMuscles();
+	if((int)_staticIndex.size() != nm)
+		findStateIndices();
+
+	const Vector& y = s.getY();
+	double k_s = get_static_gain();
+	double k_d = get_dynamic_gain();
+
+	primary.resize(nm);
+	secondary.resize(nm);
+	for(int i=0; i<nm; ++i){
+		double x_s = y[_staticIndex[i]];
+		double x_d = y[_dynamicIndex[i]];
+		secondary[i] = k_s*0.5*(fabs(x_s) + x_s);
+		primary[i] = secondary[i] + k_d*0.5*(fabs(x_d) + x_d);
+	}
+}
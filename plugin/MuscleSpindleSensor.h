@@ -0,0 +1,156 @@
+#ifndef OPENSIM_MuscleSpindleSensor_H_
+#define OPENSIM_MuscleSpindleSensor_H_
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  MuscleSpindleSensor.h                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <OpenSim/Simulation/Model/ModelComponent.h>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+#include <vector>
+
+namespace OpenSim {
+
+class Muscle;
+
+//=============================================================================
+//=============================================================================
+/**
+ * MuscleSpindleSensor models the muscle spindles of a list of muscles, each
+ * with two intrafusal fiber states of its own:
+ *
+ *  - a static (nuclear chain) response x_s that follows normalized fiber
+ *    stretch beyond the rest length with time constant static_time_constant,
+ *  - a dynamic (nuclear bag) response x_d that follows normalized fiber
+ *    lengthening velocity with time constant dynamic_time_constant.
+ *
+ * The secondary (group II) afferent is static_gain*max(x_s,0) and the
+ * primary (group Ia) afferent adds dynamic_gain*max(x_d,0) to it.
+ *
+ * The states are registered through addToSystem(). All static states come
+ * first, followed by all dynamic states, so the derivatives of the whole
+ * muscle list are computed by one structure-of-arrays kernel: fiber lengths
+ * and velocities are gathered once into contiguous arrays, and a single
+ * branch-free loop over those arrays and the per-muscle constants produces
+ * every derivative.
+ *
+ * Add the sensor to the model as a miscellaneous model component; reflex
+ * controllers refer to it by name.
+ *
+ * @author  Matt DeMers
+ * @version 1.0
+ */
+class OSIMREFLEXES_API MuscleSpindleSensor : public ModelComponent {
+OpenSim_DECLARE_CONCRETE_OBJECT(MuscleSpindleSensor, ModelComponent);
+
+public:
+//=============================================================================
+// PROPERTIES
+//=============================================================================
+    /** @name Property declarations
+    These are the serializable properties associated with a MuscleSpindleSensor.*/
+    /**@{**/
+	OpenSim_DECLARE_LIST_PROPERTY(muscle_list, std::string,
+		"Names of the muscles whose spindles are modeled.");
+	OpenSim_DECLARE_PROPERTY(normalized_rest_length, double,
+		"Fiber length, as a ratio of optimal fiber length, beyond which the "
+		"spindle responds to stretch.");
+	OpenSim_DECLARE_PROPERTY(static_time_constant, double,
+		"Time constant (seconds) of the static (nuclear chain) response.");
+	OpenSim_DECLARE_PROPERTY(dynamic_time_constant, double,
+		"Time constant (seconds) of the dynamic (nuclear bag) response.");
+	OpenSim_DECLARE_PROPERTY(static_gain, double,
+		"Afferent gain on the static response.");
+	OpenSim_DECLARE_PROPERTY(dynamic_gain, double,
+		"Afferent gain on the dynamic response.");
+
+//=============================================================================
+// METHODS
+//=============================================================================
+	//--------------------------------------------------------------------------
+	// CONSTRUCTION AND DESTRUCTION
+	//--------------------------------------------------------------------------
+	/** Default constructor. */
+	MuscleSpindleSensor();
+	// Uses default (compiler-generated) destructor, copy constructor and copy
+    // assignment operator.
+
+	/** Number of muscles with spindles. */
+	int getNumMuscles() const { return getProperty_muscle_list().size(); }
+	/** Index of the named muscle in the muscle list, or -1. */
+	int getMuscleIndex(const std::string& muscleName) const;
+
+	/** Primary (Ia) afferent of the indexed muscle. */
+	double getPrimaryAfferent(const SimTK::State& s, int index) const;
+	/** Secondary (II) afferent of the indexed muscle. */
+	double getSecondaryAfferent(const SimTK::State& s, int index) const;
+	/** Afferents of every muscle, in muscle list order. */
+	void getAfferents(const SimTK::State& s, SimTK::Vector& primary,
+		SimTK::Vector& secondary) const;
+
+protected:
+	// ModelComponent interface for the intrafusal fiber states
+	SimTK::Vector computeStateVariableDerivatives(const SimTK::State& s) const OVERRIDE_11;
+	void initStateFromProperties(SimTK::State& s) const OVERRIDE_11;
+	// ModelComponent interface to connect this component to its model
+	void connectToModel(Model& aModel) OVERRIDE_11;
+	// ModelComponent interface to add computational elements to the SimTK system
+	void addToSystem(SimTK::MultibodySystem& system) const OVERRIDE_11;
+
+private:
+	// Connect properties to local pointers.  */
+	void constructProperties();
+	// system indices of the states, found once the system is built
+	void findStateIndices() const;
+
+	//=============================================================================
+	// Private Members
+	//=============================================================================
+	std::vector<const Muscle*> _muscles;
+
+	// per-muscle constants, structure of arrays
+	std::vector<double> _restLength;		// rest fiber length
+	std::vector<double> _invOptimalLength;	// 1/optimal fiber length
+	std::vector<double> _invMaxSpeed;		// 1/max contraction velocity
+
+	// system (Y) indices of the static and dynamic states
+	mutable std::vector<int> _staticIndex;
+	mutable std::vector<int> _dynamicIndex;
+
+	// gathered fiber kinematics, reused between calls
+	mutable std::vector<double> _fiberLength;
+	mutable std::vector<double> _fiberVelocity;
+
+	//=============================================================================
+};	// END of class MuscleSpindleSensor
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_MuscleSpindleSensor_H_
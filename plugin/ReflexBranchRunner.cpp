@@ -0,0 +1,337 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  ReflexBranchRunner.cpp                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexBranchRunner.h"
+#include "MuscleReflexController.h"
+#include "SignalDelayLine.h"
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// double properties the controllers read only when they connect to the
+	// model (delays size the delay lines); varying one takes a new system
+	const char* const ConnectedProperties[] = {
+		"delay", "async_interval", "sensor_time_constant", "memory_budget" };
+
+	bool isReadAtConnection(const string& property)
+	{
+		for(size_t k=0; k<sizeof(ConnectedProperties)/sizeof(ConnectedProperties[0]); ++k)
+			if(property == ConnectedProperties[k])
+				return true;
+		return false;
+	}
+
+	// Model::initSystem() is not documented as thread-safe, so workers that
+	// must reconnect their model do so one at a time
+	std::mutex initSystemMutex;
+}
+
+
+//=============================================================================
+// BRANCH
+//=============================================================================
+// State and reflex histories at the branch time, shared read-only by every
+// variant.
+class ReflexBranchRunner::Branch {
+public:
+	State state;
+	// gate latch and history of each reflex controller, by name
+	map<string, bool> gateLatched;
+	map<string, shared_ptr<const SignalDelayLine::Snapshot> > histories;
+};
+
+// A worker's own copy of the model, initialized when the worker is built,
+// and the properties its variants set. Gains are read as the controllers
+// evaluate, so most variants reuse the worker's system; only a variant of a
+// property read at connection initializes the system again.
+class ReflexBranchRunner::Worker {
+public:
+	Worker(const Model& model, const ReflexBranchRunner& runner) :
+		_runner(runner),
+		_model(model.clone()),
+		_reconnect(false)
+	{
+		ControllerSet& controllers = _model->updControllerSet();
+		for(size_t p=0; p<runner._controllers.size(); ++p){
+			_parameters.push_back(&Property<double>::updAs(
+				controllers.get(runner._controllers[p]).updPropertyByName(runner._properties[p])));
+			_reconnect = _reconnect || isReadAtConnection(runner._properties[p]);
+		}
+		_initialState = _model->initSystem();
+	}
+
+	Result simulate(int variant)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		const Branch& branch = *_runner._branch;
+
+		Result result;
+		result.variant = variant;
+		result.completed = false;
+		result.finalTime = branch.state.getTime();
+		result.numSteps = 0;
+
+		try{
+			const vector<double>& values = _runner._variants[variant];
+			for(size_t p=0; p<_parameters.size(); ++p)
+				_parameters[p]->setValue(values[p]);
+
+			if(_reconnect){
+				std::lock_guard<std::mutex> lock(initSystemMutex);
+				_initialState = _model->initSystem();
+			}
+			State s = _initialState;
+			if(s.getNY() != branch.state.getNY())
+				throw Exception("ReflexBranchRunner: the variant changes the model's states.");
+			s.setTime(branch.state.getTime());
+			s.updY() = branch.state.getY();
+
+			// nothing of the worker's previous variant carries over
+			const ControllerSet& controllers = _model->getControllerSet();
+			for(int i=0; i<controllers.getSize(); ++i)
+				if(const MuscleReflexController* reflex =
+					dynamic_cast<const MuscleReflexController*>(&controllers[i]))
+					reflex->resetSimulationState();
+
+			// reflexes continue from the histories and gates of the branch;
+			// controllers sharing a line restore it once
+			set<SignalDelayLine*> restored;
+			for(int i=0; i<controllers.getSize(); ++i){
+				const MuscleReflexController* reflex =
+					dynamic_cast<const MuscleReflexController*>(&controllers[i]);
+				if(!reflex)
+					continue;
+				reflex->setGateLatched(s, branch.gateLatched.at(reflex->getName()));
+				SignalDelayLine* line = reflex->getSensorHistory();
+				map<string, shared_ptr<const SignalDelayLine::Snapshot> >::const_iterator
+					history = branch.histories.find(reflex->getName());
+				if(line && history != branch.histories.end() && restored.insert(line).second)
+					line->restore(history->second);
+			}
+
+			const MultibodySystem& system = _model->getMultibodySystem();
+			RungeKuttaMersonIntegrator integrator(system);
+			integrator.setAccuracy(_runner._accuracy);
+			TimeStepper stepper(system, integrator);
+			stepper.initialize(s);
+
+			double t0 = branch.state.getTime();
+			double dt = _runner._reportingInterval;
+			int numSteps = (int)ceil((_runner._finalTime - t0)/dt - 1e-9);
+			for(int k=1; k<=numSteps; ++k){
+				stepper.stepTo(std::min(t0 + k*dt, _runner._finalTime));
+				if(_runner._observer)
+					_runner._observer(variant, *_model, integrator.getState());
+			}
+			result.finalTime = integrator.getState().getTime();
+			result.numSteps = integrator.getNumStepsTaken();
+			result.completed = true;
+		}
+		catch(const std::exception& x){
+			cout << "ReflexBranchRunner: variant " << variant
+				<< " failed: " << x.what() << endl;
+		}
+
+		result.wallTime = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+		return result;
+	}
+
+private:
+	const ReflexBranchRunner& _runner;
+	std::unique_ptr<Model> _model;
+	std::vector<Property<double>*> _parameters;
+	// varied properties are read at connection
+	bool _reconnect;
+	State _initialState;
+};
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ReflexBranchRunner::ReflexBranchRunner(const string& modelFile) :
+	_model(new Model(modelFile)),
+	_branchTime(0.1),
+	_finalTime(0.5),
+	_reportingInterval(0.001),
+	_accuracy(1e-4),
+	_numThreads(0),
+	_historyWindow(0),
+	_prefixWallTime(0)
+{
+}
+
+ReflexBranchRunner::~ReflexBranchRunner()
+{
+}
+
+//=============================================================================
+// CONFIGURATION
+//=============================================================================
+void ReflexBranchRunner::addParameter(const string& controller, const string& property)
+{
+	const ControllerSet& controllers = _model->getControllerSet();
+	if(!controllers.contains(controller))
+		throw Exception("ReflexBranchRunner: controller '" + controller
+			+ "' not found in the model.");
+	const Controller& c = controllers.get(controller);
+	if(!c.hasProperty(property)
+		|| !Property<double>::isA(c.getPropertyByName(property)))
+		throw Exception("ReflexBranchRunner: " + controller
+			+ " has no double property '" + property + "'.");
+	if(!_variants.empty())
+		throw Exception("ReflexBranchRunner: add the parameters before the variants.");
+
+	_controllers.push_back(controller);
+	_properties.push_back(property);
+}
+
+void ReflexBranchRunner::addVariant(const vector<double>& values)
+{
+	if(values.size() != _controllers.size())
+		throw Exception("ReflexBranchRunner: a variant needs one value per parameter.");
+	_variants.push_back(values);
+}
+
+//=============================================================================
+// EXECUTION
+//=============================================================================
+void ReflexBranchRunner::simulatePrefix()
+{
+	if(_branchTime < 0 || _reportingInterval <= 0)
+		throw Exception("ReflexBranchRunner: the branch time must not be negative "
+			"and the reporting interval must be positive.");
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+	State s = _model->initSystem();
+	const ControllerSet& controllers = _model->getControllerSet();
+	vector<const MuscleReflexController*> reflexes;
+	for(int i=0; i<controllers.getSize(); ++i){
+		const MuscleReflexController* reflex =
+			dynamic_cast<const MuscleReflexController*>(&controllers[i]);
+		if(!reflex)
+			continue;
+		if(reflex->dependsOnHistory() && !reflex->getSensorHistory())
+			throw Exception("ReflexBranchRunner: " + reflex->getName()
+				+ " keeps its history outside a delay line and cannot be branched.");
+		if(reflex->get_trace_mode() == "record")
+			throw Exception("ReflexBranchRunner: " + reflex->getName()
+				+ " records a control trace and cannot be branched.");
+		if(_historyWindow > 0 && reflex->getSensorHistory())
+			reflex->getSensorHistory()->requireDelay(_historyWindow);
+		reflexes.push_back(reflex);
+	}
+	_model->equilibrateMuscles(s);
+
+	const MultibodySystem& system = _model->getMultibodySystem();
+	RungeKuttaMersonIntegrator integrator(system);
+	integrator.setAccuracy(_accuracy);
+	TimeStepper stepper(system, integrator);
+	stepper.initialize(s);
+	if(_branchTime > s.getTime())
+		stepper.stepTo(_branchTime);
+
+	_branch.reset(new Branch());
+	_branch->state = integrator.getState();
+	system.realize(_branch->state, Stage::Velocity);
+
+	// one snapshot per line, however many controllers share it
+	map<SignalDelayLine*, shared_ptr<const SignalDelayLine::Snapshot> > snapshots;
+	for(size_t r=0; r<reflexes.size(); ++r){
+		const MuscleReflexController& reflex = *reflexes[r];
+		_branch->gateLatched[reflex.getName()] = reflex.isGateLatched(_branch->state);
+		if(SignalDelayLine* line = reflex.getSensorHistory()){
+			shared_ptr<const SignalDelayLine::Snapshot>& snapshot = snapshots[line];
+			if(!snapshot)
+				snapshot = line->takeSnapshot();
+			_branch->histories[reflex.getName()] = snapshot;
+		}
+	}
+
+	// varied reflexes that already act make the variants start off a
+	// prefix that does not match them
+	for(size_t p=0; p<_controllers.size(); ++p){
+		const MuscleReflexController* reflex =
+			dynamic_cast<const MuscleReflexController*>(&controllers.get(_controllers[p]));
+		if(reflex && reflex->isGateOpen(_branch->state))
+			cout << "WARNING - ReflexBranchRunner: " << _controllers[p]
+				<< " is active before the branch; its variants share a prefix "
+				"simulated with the model's own " << _properties[p] << "." << endl;
+	}
+
+	_prefixWallTime = chrono::duration<double>(
+		chrono::steady_clock::now() - start).count();
+}
+
+vector<ReflexBranchRunner::Result> ReflexBranchRunner::run()
+{
+	if(_reportingInterval <= 0)
+		throw Exception("ReflexBranchRunner: the reporting interval must be positive.");
+	if(!_branch)
+		simulatePrefix();
+	if(_finalTime < _branch->state.getTime())
+		throw Exception("ReflexBranchRunner: the final time precedes the branch time.");
+
+	int numVariants = (int)_variants.size();
+	int numThreads = _numThreads > 0 ? _numThreads : (int)std::thread::hardware_concurrency();
+	numThreads = std::max(1, std::min(numThreads, numVariants));
+
+	// copy and initialize the models up front, one thread at a time
+	vector<std::unique_ptr<Worker> > workers;
+	for(int w=0; w<numThreads; ++w)
+		workers.push_back(std::unique_ptr<Worker>(new Worker(*_model, *this)));
+
+	vector<Result> results(numVariants);
+	std::atomic<int> next(0);
+	vector<std::thread> threads;
+	for(int w=0; w<numThreads; ++w){
+		threads.push_back(std::thread([w, numVariants, &workers, &results, &next]() {
+			for(int v = next++; v < numVariants; v = next++)
+				results[v] = workers[w]->simulate(v);
+		}));
+	}
+	for(size_t t=0; t<threads.size(); ++t)
+		threads[t].join();
+
+	return results;
+}
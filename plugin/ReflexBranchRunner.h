@@ -0,0 +1,160 @@
+#ifndef OPENSIM_ReflexBranchRunner_H_
+#define OPENSIM_ReflexBranchRunner_H_
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  ReflexBranchRunner.h                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace SimTK {
+class State;
+}
+
+namespace OpenSim {
+
+class Model;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexBranchRunner simulates many variants of a landing's reflexes from a
+ * shared start. The model is simulated once, with its own parameters, up to
+ * the branch time (e.g. just before contact); each variant then sets its
+ * values of the varied controller parameters and continues from the state
+ * and reflex histories reached there, so the common prefix is simulated only
+ * once.
+ *
+ * The varied parameters must not act before the branch time, as with
+ * reflexes gated by gate_forces that open after it; a warning is printed if
+ * a varied controller's gate is already open at the branch. The state is
+ * carried over as time, continuous states and gate latches. The sensor
+ * histories are snapshotted at the branch and shared by every variant: a
+ * variant's delay lines read the shared snapshot and keep only what they
+ * record after the branch, until the snapshot falls out of their delay
+ * window (see SignalDelayLine::restore()). Variants that lengthen a delay
+ * need a history window at least as long (setHistoryWindow()).
+ *
+ * Variants are run in parallel, each thread on its own copy of the model,
+ * since the controllers keep evaluation state. The copies are made and
+ * initialized before the threads start, one at a time. Gains are read as
+ * the reflexes evaluate, so a variant reuses its worker's system; varying
+ * a property read only at connection (a delay) initializes the worker's
+ * system again, serialized with the other workers. Controllers whose history
+ * is not kept in a delay line (async DelayedPathReflexController) or that
+ * record a control trace cannot be branched.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexBranchRunner {
+
+public:
+	/** Outcome of one variant. */
+	struct Result {
+		int variant;
+		bool completed;		// false if the simulation failed
+		double finalTime;	// time reached
+		int numSteps;		// integration steps after the branch
+		double wallTime;	// seconds spent on the variant
+	};
+
+	/** Called with the variant number, its model and state at every
+	 * reporting interval after the branch, from the variant's thread. */
+	typedef std::function<void(int, const Model&, const SimTK::State&)> Observer;
+
+	/** Parse the model file. The plugin's types must be registered. */
+	explicit ReflexBranchRunner(const std::string& modelFile);
+	~ReflexBranchRunner();
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	/** Vary a double property of a controller. */
+	void addParameter(const std::string& controller, const std::string& property);
+	/** Add a variant with one value per parameter, in the order added. */
+	void addVariant(const std::vector<double>& values);
+	int getNumVariants() const { return (int)_variants.size(); }
+
+	/** Time (seconds) at which the variants branch off. */
+	void setBranchTime(double time) { _branchTime = time; }
+	/** Time (seconds) at which every variant ends. */
+	void setFinalTime(double time) { _finalTime = time; }
+	/** Interval (seconds) at which the observer is called. */
+	void setReportingInterval(double interval) { _reportingInterval = interval; }
+	void setIntegratorAccuracy(double accuracy) { _accuracy = accuracy; }
+	/** Number of worker threads; 0 uses one per hardware thread. */
+	void setNumThreads(int numThreads) { _numThreads = numThreads; }
+	/** History (seconds) the prefix keeps, at least the longest delay of
+	 * any variant. 0 keeps what the model's own delays need. */
+	void setHistoryWindow(double window) { _historyWindow = window; }
+	void setObserver(const Observer& observer) { _observer = observer; }
+
+	//--------------------------------------------------------------------------
+	// EXECUTION
+	//--------------------------------------------------------------------------
+	/** Simulate the shared prefix up to the branch time. Done by run() if
+	 * not done before. */
+	void simulatePrefix();
+	/** Wall time (seconds) spent on the prefix. */
+	double getPrefixWallTime() const { return _prefixWallTime; }
+
+	/** Run every variant from the branch, in parallel. */
+	std::vector<Result> run();
+
+private:
+	class Branch;
+	class Worker;
+
+	std::unique_ptr<Model> _model;
+
+	std::vector<std::string> _controllers;
+	std::vector<std::string> _properties;
+	std::vector<std::vector<double> > _variants;
+
+	double _branchTime;
+	double _finalTime;
+	double _reportingInterval;
+	double _accuracy;
+	int _numThreads;
+	double _historyWindow;
+	Observer _observer;
+
+	// state and histories at the branch
+	std::unique_ptr<Branch> _branch;
+	double _prefixWallTime;
+
+};	// END of class ReflexBranchRunner
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexBranchRunner_H_
@@ -0,0 +1,298 @@
+/* -------------------------------------------------------------------------- *
+ *                   OpenSim:  ReflexControlEvaluator.cpp                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexControlEvaluator.h"
+#include "MuscleReflexController.h"
+
+#include <functional>
+#include <thread>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// run body(first, last) over [0, n) split into contiguous ranges, one
+	// per thread
+	template <class Body>
+	void parallelRanges(int n, int numThreads, const Body& body)
+	{
+		numThreads = std::max(1, std::min(numThreads, n));
+		if(numThreads == 1){
+			body(0, n);
+			return;
+		}
+		vector<std::thread> threads;
+		for(int t=0; t<numThreads; ++t){
+			int first = (int)((long long)n*t/numThreads);
+			int last = (int)((long long)n*(t+1)/numThreads);
+			threads.push_back(std::thread([&body, first, last]() { body(first, last); }));
+		}
+		for(size_t t=0; t<threads.size(); ++t)
+			threads[t].join();
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ReflexControlEvaluator::ReflexControlEvaluator(Model& model) :
+	_model(model),
+	_defaultState(new State(model.initSystem())),
+	_numThreads(0),
+	_blockSize(64)
+{
+}
+
+ReflexControlEvaluator::ReflexControlEvaluator(const string& modelFile) :
+	_ownedModel(new Model(modelFile)),
+	_model(*_ownedModel),
+	_defaultState(new State(_model.initSystem())),
+	_numThreads(0),
+	_blockSize(64)
+{
+}
+
+ReflexControlEvaluator::~ReflexControlEvaluator()
+{
+	delete _defaultState;
+}
+
+//=============================================================================
+// EVALUATION
+//=============================================================================
+void ReflexControlEvaluator::loadFrame(const Storage& states, int frame,
+	State& s) const
+{
+	const StateVector& row = *states.getStateVector(frame);
+	loadFrame(row.getTime(), &row.getData()[0], s);
+}
+
+void ReflexControlEvaluator::loadFrame(double time, const double* values,
+	State& s) const
+{
+	_model.setStateValues(s, values);
+	s.updTime() = time;
+	_model.getMultibodySystem().realize(s, Stage::Velocity);
+}
+
+const MuscleReflexController& ReflexControlEvaluator::getReflexController(
+	const string& name) const
+{
+	const MuscleReflexController* controller =
+		dynamic_cast<const MuscleReflexController*>(&_model.getControllerSet().get(name));
+	if(!controller)
+		throw Exception("ReflexControlEvaluator: " + name
+			+ " is not a reflex controller.");
+	return *controller;
+}
+
+int ReflexControlEvaluator::getNumStates() const
+{
+	return _model.getNumStateVariables();
+}
+
+int ReflexControlEvaluator::getNumMuscles(const string& controllerName) const
+{
+	return getReflexController(controllerName).getActuatorSet().getSize();
+}
+
+SignalDelayLine* ReflexControlEvaluator::getSensorHistory(
+	const string& controllerName) const
+{
+	return getReflexController(controllerName).getSensorHistory();
+}
+
+void ReflexControlEvaluator::evaluate(const Storage& states,
+	const string& controllerName, Storage& controls) const
+{
+	evaluate(states, getReflexController(controllerName), controls);
+}
+
+void ReflexControlEvaluator::evaluate(const string& controllerName,
+	const double* times, const double* states, int numFrames,
+	double* controls) const
+{
+	int ns = getNumStates();
+	evaluateFrames(getReflexController(controllerName), numFrames,
+		[times](int f) { return times[f]; },
+		[this, times, states, ns](int f, State& s) {
+			loadFrame(times[f], states + (size_t)f*ns, s);
+		},
+		controls);
+}
+
+void ReflexControlEvaluator::evaluateSensors(const string& controllerName,
+	const double* lengths, const double* speeds, int numFrames,
+	double* controls) const
+{
+	getReflexController(controllerName).computeMuscleControlsFromSensors(
+		lengths, speeds, numFrames, controls);
+}
+
+void ReflexControlEvaluator::evaluate(const Storage& states,
+	const MuscleReflexController& controller, Storage& controls) const
+{
+	// states in the order of the model's state variables
+	Storage modelStates;
+	_model.formStateStorage(states, modelStates);
+	if(modelStates.isInDegrees())
+		_model.getSimbodyEngine().convertDegreesToRadians(modelStates);
+
+	int nf = modelStates.getSize();
+	int nm = controller.getActuatorSet().getSize();
+
+	// frame-major control matrix
+	vector<double> results((size_t)nf*nm, 0.0);
+	evaluateFrames(controller, nf,
+		[&modelStates](int f) { return modelStates.getStateVector(f)->getTime(); },
+		[this, &modelStates](int f, State& s) { loadFrame(modelStates, f, s); },
+		nf*nm ? &results[0] : NULL);
+
+	// control storage, one column per muscle
+	Array<string> labels;
+	labels.append("time");
+	for(int i=0; i<nm; ++i)
+		labels.append(controller.getActuatorSet()[i].getName());
+	controls.purge();
+	controls.setName(controller.getName() + "_controls");
+	controls.setColumnLabels(labels);
+	for(int f=0; f<nf; ++f)
+		controls.append(modelStates.getStateVector(f)->getTime(), nm,
+			nm ? &results[(size_t)f*nm] : NULL);
+}
+
+void ReflexControlEvaluator::evaluateFrames(const MuscleReflexController& controller,
+	int nf, const function<double(int)>& frameTime,
+	const function<void(int, State&)>& load, double* results) const
+{
+	int nm = controller.getActuatorSet().getSize();
+	int numThreads = _numThreads > 0 ? _numThreads : (int)std::thread::hardware_concurrency();
+
+	// the contact gate, latched open at the first frame in contact as the
+	// event handler would during a simulation
+	bool gated = controller.getProperty_gate_forces().size() > 0;
+	bool latching = gated && controller.get_gate_latch();
+	if(latching || controller.dependsOnHistory()){
+		for(int f=1; f<nf; ++f)
+			if(frameTime(f) < frameTime(f-1))
+				throw Exception("ReflexControlEvaluator: " + controller.getName()
+					+ " needs states in increasing time order.");
+	}
+
+	if(nf > 0 && !controller.dependsOnHistory()){
+		vector<char> open(nf, 1);
+
+		// the first frame alone, so lazily built caches are in place before
+		// the controller is shared between threads
+		State s0 = *_defaultState;
+		Vector u0(nm, 0.0);
+		load(0, s0);
+		controller.computeMuscleControls(s0, u0);
+		for(int i=0; i<nm; ++i)
+			results[i] = u0[i];
+		if(gated)
+			open[0] = controller.isGateOpen(s0);
+
+		parallelRanges(nf-1, numThreads, [&](int first, int last) {
+			State s = *_defaultState;
+			Vector u(nm);
+			for(int f=first+1; f<last+1; ++f){
+				load(f, s);
+				u = 0;
+				controller.computeMuscleControls(s, u);
+				for(int i=0; i<nm; ++i)
+					results[(size_t)f*nm + i] = u[i];
+				if(gated)
+					open[f] = controller.isGateOpen(s);
+			}
+		});
+
+		// reflexes are off, and their controls zero, while the gate is closed
+		bool latched = false;
+		for(int f=0; f<nf && gated; ++f){
+			if(latched || open[f]){
+				latched = latching;
+				continue;
+			}
+			for(int i=0; i<nm; ++i)
+				results[(size_t)f*nm + i] = 0;
+		}
+	}
+	else if(nf > 0){
+		// samples of an earlier evaluation or simulation are not this
+		// trajectory's past
+		controller.resetSimulationState();
+
+		// realize a block of frames in parallel, then replay it in order
+		int blockSize = std::max(1, _blockSize)*std::max(1, numThreads);
+		vector<State> block(std::min(blockSize, nf), *_defaultState);
+		Vector u(nm);
+		bool latched = false;
+		for(int start=0; start<nf; start+=blockSize){
+			int n = std::min(blockSize, nf - start);
+			parallelRanges(n, numThreads, [&](int first, int last) {
+				for(int b=first; b<last; ++b)
+					load(start + b, block[b]);
+			});
+			for(int b=0; b<n; ++b){
+				u = 0;
+				if(latched || controller.isGateOpen(block[b])){
+					latched = latching;
+					controller.computeMuscleControls(block[b], u);
+				}
+				else if(controller.get_gate_warmup())
+					// keep the history current while the reflexes are off
+					controller.recordHistory(block[b]);
+				for(int i=0; i<nm; ++i)
+					results[(size_t)(start + b)*nm + i] = u[i];
+			}
+		}
+	}
+}
+
+void ReflexControlEvaluator::evaluateFiles(const string& modelFile,
+	const string& statesFile, const string& controllerName,
+	const string& outputFile, int numThreads)
+{
+	Model model(modelFile);
+	ReflexControlEvaluator evaluator(model);
+	evaluator.setNumThreads(numThreads);
+
+	Storage states(statesFile);
+	Storage controls;
+	evaluator.evaluate(states, controllerName, controls);
+	controls.print(outputFile);
+}
@@ -0,0 +1,166 @@
+#ifndef OPENSIM_ReflexControlEvaluator_H_
+#define OPENSIM_ReflexControlEvaluator_H_
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  ReflexControlEvaluator.h                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <functional>
+#include <memory>
+#include <string>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace SimTK {
+class State;
+}
+
+namespace OpenSim {
+
+class Model;
+class Storage;
+class MuscleReflexController;
+class SignalDelayLine;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexControlEvaluator computes what a reflex controller would have done
+ * along a recorded trajectory, without re-simulating it.
+ *
+ * Each frame of a states storage is loaded into a State of its own and
+ * realized to the Velocity stage, and the controller's reflex controls are
+ * evaluated there. The result is a control storage with one column per
+ * controlled muscle.
+ *
+ * Frames are spread over worker threads. Controllers without history (see
+ * MuscleReflexController::dependsOnHistory()) are evaluated on the workers
+ * too. For delayed controllers the frames are realized in parallel a block
+ * at a time, and then evaluated one after another in time order, so that
+ * their delay lines are rebuilt exactly as during a simulation, starting
+ * from an empty history.
+ *
+ * The contact gate is applied as in a simulation: controls are zero until
+ * the gate_forces reach gate_threshold, after which the gate stays open if
+ * it latches (frames must then be in increasing time order), and a
+ * delayed controller with gate_warmup keeps recording its history while the
+ * gate is closed. update_interval and trace_mode of the controller are not
+ * applied. Muscle and reflex states missing from the storage take their
+ * default values.
+ *
+ * For scripting, frames can also be passed as plain arrays, and the stretch
+ * reflexes can be evaluated directly from arrays of sensed signals (see
+ * MuscleReflexController::computeMuscleControlsFromSensors()); results are
+ * written to caller-owned arrays, so bindings can pass NumPy buffers
+ * through without copying.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexControlEvaluator {
+
+public:
+	/** Evaluate the controllers of the model, whose system is built here. */
+	explicit ReflexControlEvaluator(Model& model);
+	/** Load the model file and evaluate its controllers. */
+	explicit ReflexControlEvaluator(const std::string& modelFile);
+	~ReflexControlEvaluator();
+
+	/** Number of worker threads; 0 uses one per hardware thread. */
+	void setNumThreads(int numThreads) { _numThreads = numThreads; }
+	/** Frames realized per thread before a delayed controller catches up. */
+	void setBlockSize(int blockSize) { _blockSize = blockSize; }
+
+	/** Evaluate a controller of the model at every frame of states.
+	 *
+	 * @param states		states storage (e.g. from a forward simulation)
+	 * @param controller	reflex controller belonging to the model
+	 * @param controls		filled with time and one column per muscle
+	 */
+	void evaluate(const Storage& states, const MuscleReflexController& controller,
+		Storage& controls) const;
+	/** Evaluate the named controller of the model. */
+	void evaluate(const Storage& states, const std::string& controllerName,
+		Storage& controls) const;
+
+	/** Evaluate the named controller at frames given as arrays.
+	 *
+	 * @param controllerName	reflex controller belonging to the model
+	 * @param times				time of each frame
+	 * @param states			frame-major state values, getNumStates() per
+	 *							frame, in the model's state variable order
+	 * @param numFrames			number of frames
+	 * @param controls			filled with getNumMuscles() controls per frame
+	 */
+	void evaluate(const std::string& controllerName, const double* times,
+		const double* states, int numFrames, double* controls) const;
+
+	/** Evaluate the named controller from frame-major arrays of sensed
+	 * lengths and speeds, getNumMuscles() values per frame. */
+	void evaluateSensors(const std::string& controllerName,
+		const double* lengths, const double* speeds, int numFrames,
+		double* controls) const;
+
+	/** Number of state variables of the model. */
+	int getNumStates() const;
+	/** Number of muscles of the named controller. */
+	int getNumMuscles(const std::string& controllerName) const;
+	/** Sensor history of the named controller, or NULL if it has none. */
+	SignalDelayLine* getSensorHistory(const std::string& controllerName) const;
+
+	/** Load a model and a states file, evaluate the named controller and
+	 * write its controls to outputFile. */
+	static void evaluateFiles(const std::string& modelFile,
+		const std::string& statesFile, const std::string& controllerName,
+		const std::string& outputFile, int numThreads = 0);
+
+private:
+	// set a state to a frame of the model-ordered states storage
+	void loadFrame(const Storage& states, int frame, SimTK::State& s) const;
+	// set a state to the given time and state values
+	void loadFrame(double time, const double* values, SimTK::State& s) const;
+	// evaluate the controller at numFrames frames, set up by load(frame, s)
+	// and at frameTime(frame), into frame-major controls
+	void evaluateFrames(const MuscleReflexController& controller, int numFrames,
+		const std::function<double(int)>& frameTime,
+		const std::function<void(int, SimTK::State&)>& load,
+		double* controls) const;
+	const MuscleReflexController& getReflexController(const std::string& name) const;
+
+	// model loaded by the evaluator, if any
+	std::unique_ptr<Model> _ownedModel;
+	Model& _model;
+	SimTK::State* _defaultState;
+
+	int _numThreads;
+	int _blockSize;
+
+};	// END of class ReflexControlEvaluator
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexControlEvaluator_H_
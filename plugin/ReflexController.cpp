@@ -79,27 +79,14 @@ ReflexController::ReflexController(double gain)
 void ReflexController::constructProperties()
 {
 	constructProperty_gain(1.0);
+	constructProperty_use_path_surrogate(false);
 }
 
 void ReflexController::connectToModel(Model &model)
 {
 	Super::connectToModel(model);
 
-	// get the list of actuators assigned to the reflex controller
-	Set<Actuator>& actuators = updActuators();
-
-	int cnt=0;
- 
-	while(cnt < actuators.getSize()){
-		Muscle *musc = dynamic_cast<Muscle*>(&actuators[cnt]);
-		// control muscles only
-		if(!musc){
-			cout << "ReflexController:: WARNING- controller assigned a non-muscle actuator ";
-			cout << actuators[cnt].getName() << " which will be ignored." << endl;
-			actuators.remove(cnt);
-		}else
-			cnt++;
-	}
+	usePathSurrogate(model, get_use_path_surrogate());
 }
 
 //=============================================================================
@@ -109,10 +96,10 @@ void ReflexController::connectToModel(Model &model)
 /**
  * Compute the controls for muscles under influence of this reflex controller
  *
- * @param s			current state of the system
- * @param controls	system wide controls to which this controller can add
+ * @param s				current state of the system
+ * @param muscleControls	reflex control of each muscle
  */
-void ReflexController::computeControls(const State& s, Vector &controls) const
+void ReflexController::computeMuscleControls(const State& s, Vector &muscleControls) const
 {	
 	// get time
 	double time = s.getTime();
@@ -120,6 +107,9 @@ void ReflexController::computeControls(const State& s, Vector &controls) const
 	// get the list of actuators assigned to the reflex controller
 	const Set<Actuator>& actuators = getActuatorSet();
 
+	// scheduled gain
+	double gain = get_gain()*getGainScale(s);
+
 	// muscle lengthening speed
 	double speed = 0;
 	// max muscle lengthening (stretch) speed
@@ -129,14 +119,42 @@ void ReflexController::computeControls(const State& s, Vector &controls) const
 
 	for(int i=0; i<actuators.getSize(); ++i){
 		const Muscle *musc = dynamic_cast<const Muscle*>(&actuators[i]);
-		speed = musc->getLengtheningSpeed(s);
+		if(get_use_path_surrogate()){
+			double length;
+			calcPathLengthAndSpeed(s, i, length, speed);
+		}
+		else
+			speed = musc->getLengtheningSpeed(s);
 		// unnormalize muscle's maximum contraction velocity (fib_lengths/sec) 
 		max_speed = musc->getOptimalFiberLength()*musc->getMaxContractionVelocity();
-		control = 0.5*get_gain()*(fabs(speed)+speed)/max_speed;
+		control = 0.5*gain*(fabs(speed)+speed)/max_speed;
+
+		muscleControls[i] = control;
+	}
+}
+
+void ReflexController::computeMuscleControlsFromSensors(const double* lengths,
+	const double* speeds, int numFrames, double* muscleControls) const
+{
+	if(hasGainSchedule())
+		throw Exception("ReflexController: " + getName()
+			+ " follows a gain_schedule, which needs the state.");
+
+	const Set<Actuator>& actuators = getActuatorSet();
+	int nm = actuators.getSize();
+
+	// half the gain over the max lengthening speed, per muscle
+	vector<double> scale(nm);
+	for(int i=0; i<nm; ++i){
+		const Muscle& musc = static_cast<const Muscle&>(actuators[i]);
+		scale[i] = 0.5*get_gain()/(musc.getOptimalFiberLength()*musc.getMaxContractionVelocity());
+	}
 
-		SimTK::Vector actControls(1,control);
-		// add reflex controls to whatever controls are already in place.
-		musc->addInControls(actControls, controls);
+	for(int f=0; f<numFrames; ++f){
+		const double* speed = speeds + (size_t)f*nm;
+		double* control = muscleControls + (size_t)f*nm;
+		for(int i=0; i<nm; ++i)
+			control[i] = scale[i]*(fabs(speed[i]) + speed[i]);
 	}
 }
 
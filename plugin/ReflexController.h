@@ -27,7 +27,7 @@
 //============================================================================
 // INCLUDE
 //============================================================================
-#include <OpenSim/Simulation/Control/Controller.h>
+#include "MuscleReflexController.h"
 
 // to export class as part of a plugin:
 #include "osimReflexesDLL.h" 
@@ -47,8 +47,8 @@ namespace OpenSim {
  * @author  Ajay Seth
  * @version 1.0
  */
-class OSIMREFLEXES_API ReflexController : public Controller {
-OpenSim_DECLARE_CONCRETE_OBJECT(ReflexController, Controller);
+class OSIMREFLEXES_API ReflexController : public MuscleReflexController {
+OpenSim_DECLARE_CONCRETE_OBJECT(ReflexController, MuscleReflexController);
 
 public:
 //=============================================================================
@@ -59,6 +59,9 @@ public:
     /**@{**/  	
 	OpenSim_DECLARE_PROPERTY(gain, double, 
 		"Factor by which the stretch response is scaled." );
+	OpenSim_DECLARE_PROPERTY(use_path_surrogate, bool,
+		"Sense lengthening speed with a fitted polynomial of the spanned "
+		"coordinates (see MusclePathSurrogate) instead of the geometry path.");
 
 //=============================================================================
 // METHODS
@@ -76,20 +79,28 @@ public:
 	*/
 	ReflexController(double gain);
 
-	/** Compute the controls for actuators (muscles)
+	/** Compute the controls for muscles
 	 *  This method defines the behavior for ReflexController controller 
 	 *
-	 * @param s			system state 
-	 * @param controls	writable model controls
+	 * @param s					system state 
+	 * @param muscleControls	reflex control of each muscle
 	 */
-	void computeControls(const SimTK::State& s, SimTK::Vector &controls) const OVERRIDE_11;
+	void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector &muscleControls) const OVERRIDE_11;
 
+	/** Batch controls from path lengthening speeds; lengths are unused and
+	 * may be NULL. */
+	void computeMuscleControlsFromSensors(const double* lengths,
+		const double* speeds, int numFrames, double* muscleControls) const OVERRIDE_11;
+
+
+protected:
+	// ModelComponent interface to connect this component to its model
+	void connectToModel(Model& aModel) OVERRIDE_11;
 
 private:
 	// Connect properties to local pointers.  */
 	void constructProperties();
-	// ModelComponent interface to connect this component to its model
-	void connectToModel(Model& aModel);
 
 	//=============================================================================
 };	// END of class ReflexController
@@ -0,0 +1,302 @@
+/* -------------------------------------------------------------------------- *
+ *                   OpenSim:  ReflexEquilibriumSolver.cpp                    *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexEquilibriumSolver.h"
+#include "MuscleReflexController.h"
+#include "SignalDelayLine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// step halvings tried before a Newton step is taken as it is
+	const int MaxStepHalvings = 6;
+
+	double getLargestMagnitude(const vector<double>& values)
+	{
+		double largest = 0;
+		for(size_t i=0; i<values.size(); ++i)
+			largest = std::max(largest, fabs(values[i]));
+		return largest;
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S)
+//=============================================================================
+ReflexEquilibriumSolver::ReflexEquilibriumSolver(Model& model) :
+	_model(model),
+	_tolerance(1e-6),
+	_maxIterations(20),
+	_perturbation(1e-5),
+	_numColors(0),
+	_numEvaluations(0)
+{
+	const ControllerSet& controllers = _model.getControllerSet();
+	for(int i=0; i<controllers.getSize(); ++i)
+		if(const MuscleReflexController* reflex =
+				dynamic_cast<const MuscleReflexController*>(&controllers[i]))
+			if(!reflex->isDisabled())
+				_reflexes.push_back(reflex);
+
+	buildPattern();
+}
+
+void ReflexEquilibriumSolver::buildPattern()
+{
+	const Set<Muscle>& muscles = _model.getMuscles();
+	int m = muscles.getSize();
+
+	// every muscle's control depends on its own activation, through its
+	// fiber state, and on the activations of the muscles its reflexes sense
+	_columnRows.assign(m, vector<int>());
+	for(int j=0; j<m; ++j)
+		_columnRows[j].push_back(j);
+	vector<int> sensed;
+	for(size_t c=0; c<_reflexes.size(); ++c){
+		const Set<Actuator>& actuators = _reflexes[c]->getActuatorSet();
+		for(int i=0; i<actuators.getSize(); ++i){
+			int row = muscles.getIndex(actuators[i].getName());
+			sensed.clear();
+			_reflexes[c]->getSensedMuscles(i, sensed);
+			for(size_t k=0; k<sensed.size(); ++k){
+				int column = muscles.getIndex(actuators[sensed[k]].getName());
+				vector<int>& rows = _columnRows[column];
+				if(find(rows.begin(), rows.end(), row) == rows.end())
+					rows.push_back(row);
+			}
+		}
+	}
+
+	// greedy coloring: a column takes the first color that no column
+	// sharing one of its rows has taken
+	vector<vector<int> > rowColumns(m);
+	for(int j=0; j<m; ++j)
+		for(size_t k=0; k<_columnRows[j].size(); ++k)
+			rowColumns[_columnRows[j][k]].push_back(j);
+
+	_colors.assign(m, -1);
+	_numColors = 0;
+	vector<int> takenBy;
+	for(int j=0; j<m; ++j){
+		takenBy.assign(_numColors + 1, 0);
+		for(size_t k=0; k<_columnRows[j].size(); ++k){
+			const vector<int>& neighbors = rowColumns[_columnRows[j][k]];
+			for(size_t n=0; n<neighbors.size(); ++n)
+				if(_colors[neighbors[n]] >= 0)
+					takenBy[_colors[neighbors[n]]] = 1;
+		}
+		int color = 0;
+		while(takenBy[color])
+			++color;
+		_colors[j] = color;
+		_numColors = std::max(_numColors, color + 1);
+	}
+}
+
+//=============================================================================
+// SOLUTION
+//=============================================================================
+void ReflexEquilibriumSolver::resetReflexes(const State& s) const
+{
+	for(size_t c=0; c<_reflexes.size(); ++c){
+		if(SignalDelayLine* history = _reflexes[c]->getSensorHistory())
+			history->clear();
+		_reflexes[c]->invalidateHeldControls(s);
+	}
+}
+
+void ReflexEquilibriumSolver::evaluate(State& s,
+	const vector<double>& activations, vector<double>& residual)
+{
+	const Set<Muscle>& muscles = _model.getMuscles();
+	int m = muscles.getSize();
+
+	for(int k=0; k<m; ++k)
+		muscles[k].setActivation(s, activations[k]);
+	_model.equilibrateMuscles(s);
+
+	// Activations and fiber lengths are not kinematics: changing them does
+	// not invalidate the controls, which are cached at the velocity stage.
+	s.invalidateAllCacheAtOrAbove(Stage::Velocity);
+	for(size_t c=0; c<_reflexes.size(); ++c)
+		_reflexes[c]->invalidateHeldControls(s);
+	_model.getMultibodySystem().realize(s, Stage::Velocity);
+
+	residual.resize(m);
+	for(int k=0; k<m; ++k){
+		double control = SimTK::clamp(muscles[k].getMinControl(),
+			muscles[k].getControl(s), muscles[k].getMaxControl());
+		residual[k] = activations[k] - control;
+	}
+	++_numEvaluations;
+}
+
+ReflexEquilibriumSolver::Result ReflexEquilibriumSolver::solve(State& s)
+{
+	const Set<Muscle>& muscles = _model.getMuscles();
+	int m = muscles.getSize();
+	if((int)_colors.size() != m)
+		buildPattern();
+
+	Result result;
+	result.converged = false;
+	result.iterations = 0;
+	_numEvaluations = 0;
+
+	_model.getMultibodySystem().realize(s, Stage::Velocity);
+	vector<double> lower(m), upper(m), activations(m);
+	for(int k=0; k<m; ++k){
+		lower[k] = muscles[k].getMinControl();
+		upper[k] = muscles[k].getMaxControl();
+		activations[k] = SimTK::clamp(lower[k], muscles[k].getActivation(s), upper[k]);
+	}
+
+	vector<double> residual, trialResidual, trial(m);
+	evaluate(s, activations, residual);
+	double norm = getLargestMagnitude(residual);
+
+	Matrix jacobian(m, m);
+	Vector step(m), rhs(m);
+	vector<double> perturbations(m);
+	while(norm > _tolerance && result.iterations < _maxIterations){
+		++result.iterations;
+
+		// one evaluation per color of the sparse Jacobian
+		jacobian = 0;
+		for(int color=0; color<_numColors; ++color){
+			trial = activations;
+			for(int j=0; j<m; ++j){
+				if(_colors[j] != color)
+					continue;
+				// step away from the upper bound
+				perturbations[j] = activations[j] + _perturbation > upper[j]
+					? -_perturbation : _perturbation;
+				trial[j] += perturbations[j];
+			}
+			evaluate(s, trial, trialResidual);
+			for(int j=0; j<m; ++j){
+				if(_colors[j] != color)
+					continue;
+				for(size_t k=0; k<_columnRows[j].size(); ++k){
+					int i = _columnRows[j][k];
+					jacobian(i, j) = (trialResidual[i] - residual[i])/perturbations[j];
+				}
+			}
+		}
+
+		for(int k=0; k<m; ++k)
+			rhs[k] = -residual[k];
+		FactorLU(jacobian).solve(rhs, step);
+
+		// damped step, kept within the control bounds
+		double scale = 1.0;
+		for(int halving=0; halving<=MaxStepHalvings; ++halving, scale *= 0.5){
+			for(int k=0; k<m; ++k)
+				trial[k] = SimTK::clamp(lower[k], activations[k] + scale*step[k], upper[k]);
+			evaluate(s, trial, trialResidual);
+			if(getLargestMagnitude(trialResidual) < norm)
+				break;
+		}
+		activations = trial;
+		residual = trialResidual;
+		norm = getLargestMagnitude(residual);
+	}
+
+	// the state holds the last evaluated activations, the solution
+	resetReflexes(s);
+	s.invalidateAllCacheAtOrAbove(Stage::Velocity);
+	_model.getMultibodySystem().realize(s, Stage::Velocity);
+
+	result.converged = norm <= _tolerance;
+	result.evaluations = _numEvaluations;
+	result.residual = norm;
+	if(!result.converged)
+		cout << "WARNING - ReflexEquilibriumSolver did not converge: activation "
+			"mismatch " << norm << " after " << result.iterations
+			<< " iterations." << endl;
+	return result;
+}
+
+//=============================================================================
+// STARTUP MEASUREMENT
+//=============================================================================
+ReflexEquilibriumSolver::Startup ReflexEquilibriumSolver::measureStartup(
+	const State& initial, double duration, bool equilibrate, double accuracy)
+{
+	typedef chrono::steady_clock Clock;
+
+	State s(initial);
+	resetReflexes(s);
+	_model.equilibrateMuscles(s);
+
+	Startup startup;
+	startup.equilibrated = equilibrate;
+	Clock::time_point start = Clock::now();
+	if(equilibrate)
+		solve(s);
+	startup.solveTime = chrono::duration<double>(Clock::now() - start).count();
+
+	const MultibodySystem& system = _model.getMultibodySystem();
+	RungeKuttaMersonIntegrator integrator(system);
+	integrator.setAccuracy(accuracy);
+	TimeStepper stepper(system, integrator);
+
+	start = Clock::now();
+	stepper.initialize(s);
+	stepper.stepTo(s.getTime() + duration);
+	startup.wallTime = chrono::duration<double>(Clock::now() - start).count();
+	startup.numSteps = integrator.getNumStepsTaken();
+
+	resetReflexes(s);
+	return startup;
+}
+
+void ReflexEquilibriumSolver::printStartupComparison(const State& s,
+	ostream& out, double duration)
+{
+	out << "reflex_equilibrium\tsteps\tsolve_time\twall_time" << endl;
+	for(int equilibrate=0; equilibrate<2; ++equilibrate){
+		Startup startup = measureStartup(s, duration, equilibrate != 0);
+		out << setprecision(6) << equilibrate << '\t'
+			<< startup.numSteps << '\t'
+			<< startup.solveTime << '\t'
+			<< startup.wallTime << endl;
+	}
+}
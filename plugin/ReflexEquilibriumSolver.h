@@ -0,0 +1,155 @@
+#ifndef OPENSIM_ReflexEquilibriumSolver_H_
+#define OPENSIM_ReflexEquilibriumSolver_H_
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  ReflexEquilibriumSolver.h                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <iosfwd>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace SimTK {
+class State;
+}
+
+namespace OpenSim {
+
+class Model;
+class MuscleReflexController;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexEquilibriumSolver initializes the muscles of a model in equilibrium
+ * with its reflexes.
+ *
+ * Model::equilibrateMuscles() puts the fibers in equilibrium with the
+ * activations held in the state, but the reflex controllers then excite the
+ * muscles differently at the first step, and the activation and fiber
+ * transients make the start of a landing stiff. solve() instead finds the
+ * activations a that the controls of all the model's controllers reproduce
+ * once the fibers are equilibrated at a, i.e. the root of
+ *
+ *     F(a) = a - clamp(u(a))
+ *
+ * over all muscles at once, by damped Newton iterations. The Jacobian is
+ * sparse: a muscle's control depends on its own activation, through its own
+ * fiber state, and on the activations of the muscles its reflexes sense
+ * (MuscleReflexController::getSensedMuscles(), e.g. the undelayed couplings
+ * of a spinal network). Columns that share no row are colored alike and
+ * differenced together, so a Jacobian costs one controls evaluation per
+ * color rather than per muscle.
+ *
+ * Delayed reflexes read no history at the start, so they only contribute
+ * their undelayed terms. The sensor histories sensed while solving are
+ * cleared afterwards.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexEquilibriumSolver {
+
+public:
+	/** Outcome of a solve. */
+	struct Result {
+		bool converged;
+		int iterations;		// Newton iterations
+		int evaluations;	// controls evaluations, Jacobians included
+		double residual;	// largest activation mismatch
+	};
+
+	/** Cost of integrating the start of a simulation. */
+	struct Startup {
+		bool equilibrated;	// solved for reflex equilibrium first
+		int numSteps;		// integration steps taken
+		double solveTime;	// wall time (seconds) of the solve
+		double wallTime;	// wall time (seconds) of the integration
+	};
+
+	/** Solve for the muscles of the model, whose system must exist. */
+	explicit ReflexEquilibriumSolver(Model& model);
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	/** Largest activation mismatch accepted. */
+	void setTolerance(double tolerance) { _tolerance = tolerance; }
+	void setMaxIterations(int maxIterations) { _maxIterations = maxIterations; }
+	/** Activation step of the finite difference Jacobian. */
+	void setPerturbation(double perturbation) { _perturbation = perturbation; }
+
+	/** Number of colors of the Jacobian, i.e. controls evaluations per
+	 * Jacobian. */
+	int getNumColors() const { return _numColors; }
+
+	//--------------------------------------------------------------------------
+	// EXECUTION
+	//--------------------------------------------------------------------------
+	/** Set the activations and fiber lengths of the state's muscles in
+	 * equilibrium with the controls. */
+	Result solve(SimTK::State& s);
+
+	/** Integrate duration seconds from the state, after equilibrating the
+	 * muscles with Model::equilibrateMuscles() and, if equilibrate is true,
+	 * with the reflexes. */
+	Startup measureStartup(const SimTK::State& s, double duration,
+		bool equilibrate, double accuracy = 1e-5);
+	/** Measure the start with and without reflex equilibrium and write both
+	 * as a tab-delimited table. */
+	void printStartupComparison(const SimTK::State& s, std::ostream& out,
+		double duration = 0.05);
+
+private:
+	// sparsity pattern of the Jacobian and its column coloring
+	void buildPattern();
+	// residual F(a), leaving the state at activations a
+	void evaluate(SimTK::State& s, const std::vector<double>& activations,
+		std::vector<double>& residual);
+	// forget controls and sensor histories computed at trial activations
+	void resetReflexes(const SimTK::State& s) const;
+
+	Model& _model;
+	std::vector<const MuscleReflexController*> _reflexes;
+
+	double _tolerance;
+	int _maxIterations;
+	double _perturbation;
+
+	// model muscle indices of the activations each column (activation)
+	// influences, and the color of each column
+	std::vector<std::vector<int> > _columnRows;
+	std::vector<int> _colors;
+	int _numColors;
+	int _numEvaluations;
+
+};	// END of class ReflexEquilibriumSolver
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexEquilibriumSolver_H_
@@ -0,0 +1,306 @@
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  ReflexKernelExporter.cpp                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexKernelExporter.h"
+#include "MuscleFiberStretchController.h"
+#include "DelayedPathReflexController.h"
+
+#include <cctype>
+#include <fstream>
+#include <iomanip>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// delays within this many ticks of a whole tick count are taken as one
+	const double TickRoundoff = 1e-9;
+
+	// C++ string literal of text
+	string quote(const string& text)
+	{
+		string literal = "\"";
+		for(size_t k=0; k<text.size(); ++k){
+			if(text[k] == '"' || text[k] == '\\')
+				literal += '\\';
+			literal += text[k];
+		}
+		return literal + "\"";
+	}
+
+	// constexpr array of one value per muscle
+	template <typename T>
+	void writeArray(ostream& out, const string& type, const string& name,
+		const vector<T>& values, const string& comment)
+	{
+		out << "// " << comment << "\n"
+			<< "constexpr " << type << " " << name << "[NumMuscles] = {";
+		for(size_t k=0; k<values.size(); ++k)
+			out << (k ? ", " : " ") << values[k];
+		out << " };\n\n";
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ReflexKernelExporter::ReflexKernelExporter(Model& model) :
+	_model(model),
+	_tickPeriod(0.001)
+{
+	_model.initSystem();
+}
+
+ReflexKernelExporter::ReflexKernelExporter(const string& modelFile) :
+	_ownedModel(new Model(modelFile)),
+	_model(*_ownedModel),
+	_tickPeriod(0.001)
+{
+	_model.initSystem();
+}
+
+ReflexKernelExporter::~ReflexKernelExporter()
+{
+}
+
+string ReflexKernelExporter::makeIdentifier(const string& name)
+{
+	string identifier;
+	for(size_t k=0; k<name.size(); ++k)
+		identifier += isalnum((unsigned char)name[k]) ? name[k] : '_';
+	if(identifier.empty() || isdigit((unsigned char)identifier[0]))
+		identifier = "kernel_" + identifier;
+	return identifier;
+}
+
+//=============================================================================
+// EXPORT
+//=============================================================================
+void ReflexKernelExporter::write(const string& controllerName, ostream& out) const
+{
+	const ControllerSet& controllers = _model.getControllerSet();
+	if(!controllers.contains(controllerName))
+		throw Exception("ReflexKernelExporter: controller '" + controllerName
+			+ "' not found in the model.");
+	const MuscleReflexController* controller =
+		dynamic_cast<const MuscleReflexController*>(&controllers.get(controllerName));
+	if(!controller)
+		throw Exception("ReflexKernelExporter: " + controllerName
+			+ " is not a reflex controller.");
+	if(controller->getActuatorSet().getSize() == 0)
+		throw Exception("ReflexKernelExporter: " + controllerName
+			+ " controls no muscles.");
+	if(controller->hasGainSchedule())
+		throw Exception("ReflexKernelExporter: " + controllerName
+			+ " follows a gain_schedule, which needs the state.");
+
+	const MuscleFiberStretchController* fiber =
+		dynamic_cast<const MuscleFiberStretchController*>(controller);
+	if(fiber && !fiber->get_spindle_sensor().empty())
+		throw Exception("ReflexKernelExporter: " + controllerName
+			+ " senses through spindle states, not sensor arrays.");
+	bool stretch = dynamic_cast<const MusclePathStretchController*>(controller) != NULL;
+	bool delayed = dynamic_cast<const DelayedPathReflexController*>(controller) != NULL;
+	if(!stretch && !delayed)
+		throw Exception("ReflexKernelExporter: " + controller->getConcreteClassName()
+			+ " " + controllerName + " has no kernel.");
+
+	string space = makeIdentifier(_namespace.empty() ? controllerName : _namespace);
+	string guard = "REFLEX_KERNEL_" + space + "_H_";
+	for(size_t k=0; k<guard.size(); ++k)
+		guard[k] = (char)toupper((unsigned char)guard[k]);
+
+	const Set<Actuator>& muscles = controller->getActuatorSet();
+	out << "// Reflex kernel of " << controller->getConcreteClassName() << " "
+		<< controllerName << " of model " << _model.getName() << ",\n"
+		<< "// generated by ReflexKernelExporter. Do not edit.\n";
+	if(controller->getProperty_gate_forces().size() > 0)
+		out << "//\n// In the model the reflexes are gated on contact (gate_forces);\n"
+			<< "// apply the controls only while the gate would be open.\n";
+	out << "#ifndef " << guard << "\n#define " << guard << "\n\n"
+		<< "#include <cmath>\n\n"
+		<< "namespace " << space << " {\n\n"
+		<< "constexpr int NumMuscles = " << muscles.getSize() << ";\n\n"
+		<< "// sensor and control order\n"
+		<< "constexpr const char* MuscleNames[NumMuscles] = {";
+	for(int i=0; i<muscles.getSize(); ++i)
+		out << (i ? ", " : " ") << quote(muscles[i].getName());
+	out << " };\n\n";
+
+	out << setprecision(17);
+	if(delayed)
+		writeDelayedKernel(*controller, out);
+	else
+		writeStretchKernel(*controller, fiber != NULL, out);
+
+	out << "} // namespace " << space << "\n\n"
+		<< "#endif // " << guard << "\n";
+}
+
+void ReflexKernelExporter::print(const string& controller, const string& fileName) const
+{
+	ofstream out(fileName.c_str());
+	if(!out.good())
+		throw Exception("ReflexKernelExporter: could not write " + fileName + ".");
+	write(controller, out);
+}
+
+void ReflexKernelExporter::writeStretchKernel(const MuscleReflexController& controller,
+	bool fiber, ostream& out) const
+{
+	const MusclePathStretchController& reflex =
+		static_cast<const MusclePathStretchController&>(controller);
+	const Set<Actuator>& muscles = reflex.getActuatorSet();
+	double k_l = reflex.get_gain_length();
+	double k_v = reflex.get_gain_velocity();
+
+	// rest length and the length and speed normalizations, per muscle, as in
+	// computeMuscleControlsFromSensors()
+	vector<double> rest, lengthScale, speedScale;
+	for(int i=0; i<muscles.getSize(); ++i){
+		const Muscle& musc = static_cast<const Muscle&>(muscles[i]);
+		double f_o = musc.getOptimalFiberLength();
+		rest.push_back(reflex.get_normalized_rest_length()
+			*(fiber ? f_o : f_o + musc.getTendonSlackLength()));
+		lengthScale.push_back(0.5*k_l/f_o);
+		speedScale.push_back(0.5*k_v/(f_o*musc.getMaxContractionVelocity()));
+	}
+
+	string sensed = fiber ? "fiber" : "path";
+	writeArray(out, "double", "RestLength", rest,
+		"rest " + sensed + " length (m)");
+	writeArray(out, "double", "LengthScale", lengthScale,
+		"half the length gain over the optimal fiber length (1/m)");
+	writeArray(out, "double", "SpeedScale", speedScale,
+		"half the velocity gain over the maximum lengthening speed (s/m)");
+
+	out << "// Reflex controls from the " << sensed << " lengths (m) and lengthening\n"
+		<< "// speeds (m/s) of the muscles, in MuscleNames order.\n"
+		<< "inline void step(const double* lengths, const double* speeds,\n"
+		<< "\tdouble* controls) noexcept\n"
+		<< "{\n"
+		<< "\tfor(int i=0; i<NumMuscles; ++i){\n"
+		<< "\t\tdouble stretch = lengths[i] - RestLength[i];\n"
+		<< "\t\tcontrols[i] = LengthScale[i]*(std::fabs(stretch) + stretch)\n"
+		<< "\t\t\t+ SpeedScale[i]*(std::fabs(speeds[i]) + speeds[i]);\n"
+		<< "\t}\n"
+		<< "}\n\n";
+}
+
+void ReflexKernelExporter::writeDelayedKernel(const MuscleReflexController& controller,
+	ostream& out) const
+{
+	if(_tickPeriod <= 0)
+		throw Exception("ReflexKernelExporter: the tick period must be positive.");
+
+	const DelayedPathReflexController& reflex =
+		static_cast<const DelayedPathReflexController&>(controller);
+	const Set<Actuator>& muscles = reflex.getActuatorSet();
+
+	// each delay as whole ticks plus a fraction of a tick, and the ticks of
+	// history its interpolation reaches back
+	vector<double> speedScale, fraction;
+	vector<int> delayTicks, historyTicks;
+	int historyLength = 1;
+	for(int i=0; i<muscles.getSize(); ++i){
+		const Muscle& musc = static_cast<const Muscle&>(muscles[i]);
+		speedScale.push_back(0.5/(musc.getOptimalFiberLength()*musc.getMaxContractionVelocity()));
+		double ticks = reflex.getMuscleDelay(i)/_tickPeriod;
+		int whole = (int)floor(ticks + TickRoundoff);
+		double part = ticks - whole;
+		if(part < TickRoundoff)
+			part = 0;
+		delayTicks.push_back(whole);
+		fraction.push_back(part);
+		historyTicks.push_back(whole + (part > 0 ? 1 : 0));
+		historyLength = std::max(historyLength, historyTicks.back() + 1);
+	}
+
+	out << "// period (s) at which step is called\n"
+		<< "constexpr double TickPeriod = " << _tickPeriod << ";\n\n"
+		<< "constexpr double Gain = " << reflex.get_gain() << ";\n\n";
+	writeArray(out, "double", "SpeedScale", speedScale,
+		"half the inverse of the maximum lengthening speed (s/m)");
+	writeArray(out, "int", "DelayTicks", delayTicks,
+		"delay, whole ticks");
+	writeArray(out, "double", "DelayFraction", fraction,
+		"and the fraction of a tick beyond them");
+	writeArray(out, "int", "HistoryTicks", historyTicks,
+		"ticks of history the delayed signal reaches back");
+
+	out << "// ticks of sensed signals held\n"
+		<< "constexpr int HistoryLength = " << historyLength << ";\n\n"
+		<< "// Sensed signals of the last HistoryLength ticks, in a ring.\n"
+		<< "struct State {\n"
+		<< "\tdouble history[HistoryLength][NumMuscles];\n"
+		<< "\tint head;\t\t\t// row of the latest tick\n"
+		<< "\tlong long ticks;\t// ticks stepped since reset\n"
+		<< "};\n\n"
+		<< "inline void reset(State& state) noexcept\n"
+		<< "{\n"
+		<< "\tfor(int k=0; k<HistoryLength; ++k)\n"
+		<< "\t\tfor(int i=0; i<NumMuscles; ++i)\n"
+		<< "\t\t\tstate.history[k][i] = 0;\n"
+		<< "\tstate.head = HistoryLength - 1;\n"
+		<< "\tstate.ticks = 0;\n"
+		<< "}\n\n"
+		<< "// Record one tick of path lengthening speeds (m/s), in MuscleNames\n"
+		<< "// order, and compute the delayed reflex controls. Signals from before\n"
+		<< "// the first tick since reset are zero.\n"
+		<< "inline void step(State& state, const double* speeds, double* controls) noexcept\n"
+		<< "{\n"
+		<< "\tint head = state.head + 1 == HistoryLength ? 0 : state.head + 1;\n"
+		<< "\tdouble* sensed = state.history[head];\n"
+		<< "\tfor(int i=0; i<NumMuscles; ++i)\n"
+		<< "\t\tsensed[i] = SpeedScale[i]*(std::fabs(speeds[i]) + speeds[i]);\n"
+		<< "\tstate.head = head;\n"
+		<< "\t++state.ticks;\n\n"
+		<< "\tfor(int i=0; i<NumMuscles; ++i){\n"
+		<< "\t\tif(state.ticks <= HistoryTicks[i]){\n"
+		<< "\t\t\tcontrols[i] = 0;\n"
+		<< "\t\t\tcontinue;\n"
+		<< "\t\t}\n"
+		<< "\t\tint r0 = head - DelayTicks[i];\n"
+		<< "\t\tif(r0 < 0)\n"
+		<< "\t\t\tr0 += HistoryLength;\n"
+		<< "\t\tdouble signal = state.history[r0][i];\n"
+		<< "\t\tif(DelayFraction[i] > 0){\n"
+		<< "\t\t\tint r1 = r0 == 0 ? HistoryLength - 1 : r0 - 1;\n"
+		<< "\t\t\tsignal += DelayFraction[i]*(state.history[r1][i] - signal);\n"
+		<< "\t\t}\n"
+		<< "\t\tcontrols[i] = Gain*signal;\n"
+		<< "\t}\n"
+		<< "}\n\n";
+}
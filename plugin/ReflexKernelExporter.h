@@ -0,0 +1,122 @@
+#ifndef OPENSIM_ReflexKernelExporter_H_
+#define OPENSIM_ReflexKernelExporter_H_
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  ReflexKernelExporter.h                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <iosfwd>
+#include <memory>
+#include <string>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+class Model;
+class MuscleReflexController;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexKernelExporter writes the reflex law of a configured controller as
+ * a self-contained C++ header, for controllers that cannot link OpenSim
+ * (e.g. an exoskeleton's embedded loop).
+ *
+ * Supported are MusclePathStretchController, MuscleFiberStretchController
+ * (without a spindle_sensor) and DelayedPathReflexController. The muscles'
+ * optimal fiber lengths, tendon slack lengths and maximum contraction
+ * velocities are folded with the rest length and gains into constexpr
+ * per-muscle arrays, so the kernel needs no model. The generated header
+ * declares, in a namespace of its own:
+ *  - NumMuscles and MuscleNames, the sensor and control order;
+ *  - for the stretch controllers, step(lengths, speeds, controls), from the
+ *    path (or fiber) lengths and lengthening speeds in meters and m/s;
+ *  - for the delayed controller, a State holding a fixed-size ring buffer of
+ *    sensed signals, reset(state) and step(state, speeds, controls), called
+ *    once per tick of the fixed tick period with the path lengthening
+ *    speeds. Delays are taken in ticks, interpolating between two ticks
+ *    for delays that are not a multiple of the period.
+ * Neither step allocates, throws or reads global state.
+ *
+ * The kernel reproduces computeMuscleControls() (and the sensor batch
+ * evaluation) at the same sensor values; a delayed kernel matches the
+ * plugin when the plugin's sensors are sampled on the same ticks. Contact
+ * gating (gate_forces) and gain schedules stay with the caller: a
+ * controller with a gain_schedule is refused, and step should only be
+ * called, or its controls applied, while the reflexes are meant to act.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexKernelExporter {
+
+public:
+	/** Export controllers of the model, which is initialized here. */
+	explicit ReflexKernelExporter(Model& model);
+	/** Parse the model file. The plugin's types must be registered. */
+	explicit ReflexKernelExporter(const std::string& modelFile);
+	~ReflexKernelExporter();
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	/** Period (seconds) of the tick at which a delayed kernel is stepped. */
+	void setTickPeriod(double period) { _tickPeriod = period; }
+	double getTickPeriod() const { return _tickPeriod; }
+	/** Namespace of the generated kernel. Empty (the default) uses the
+	 * controller's name. */
+	void setKernelNamespace(const std::string& name) { _namespace = name; }
+
+	//--------------------------------------------------------------------------
+	// EXPORT
+	//--------------------------------------------------------------------------
+	/** Write the kernel of the named reflex controller to out. */
+	void write(const std::string& controller, std::ostream& out) const;
+	/** Write the kernel of the named reflex controller to a header file. */
+	void print(const std::string& controller, const std::string& fileName) const;
+
+private:
+	// C++ identifier for a kernel namespace or include guard
+	static std::string makeIdentifier(const std::string& name);
+
+	void writeStretchKernel(const MuscleReflexController& controller,
+		bool fiber, std::ostream& out) const;
+	void writeDelayedKernel(const MuscleReflexController& controller,
+		std::ostream& out) const;
+
+	std::unique_ptr<Model> _ownedModel;
+	Model& _model;
+
+	double _tickPeriod;
+	std::string _namespace;
+
+};	// END of class ReflexKernelExporter
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexKernelExporter_H_
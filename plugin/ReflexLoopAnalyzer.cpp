@@ -0,0 +1,454 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  ReflexLoopAnalyzer.cpp                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexLoopAnalyzer.h"
+#include "ReflexController.h"
+#include "DelayedPathReflexController.h"
+
+#include <iomanip>
+#include <thread>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// run body(first, last) over [0, n) split into contiguous ranges, one
+	// per thread
+	template <class Body>
+	void parallelRanges(int n, int numThreads, const Body& body)
+	{
+		numThreads = std::max(1, std::min(numThreads, n));
+		if(numThreads == 1){
+			body(0, n);
+			return;
+		}
+		vector<std::thread> threads;
+		for(int t=0; t<numThreads; ++t){
+			int first = (int)((long long)n*t/numThreads);
+			int last = (int)((long long)n*(t+1)/numThreads);
+			threads.push_back(std::thread([&body, first, last]() { body(first, last); }));
+		}
+		for(size_t t=0; t<threads.size(); ++t)
+			threads[t].join();
+	}
+
+	// Solve M X = R in place by Gaussian elimination with partial pivoting:
+	// M is n by n and R n by k, both row-major; R is left holding X.
+	// @return false if M is singular
+	bool solveComplex(vector<Complex>& M, vector<Complex>& R, int n, int k)
+	{
+		for(int c=0; c<n; ++c){
+			int pivot = c;
+			for(int r=c+1; r<n; ++r)
+				if(abs(M[r*n + c]) > abs(M[pivot*n + c]))
+					pivot = r;
+			if(M[pivot*n + c] == 0.0)
+				return false;
+			if(pivot != c){
+				swap_ranges(M.begin() + c*n, M.begin() + (c+1)*n, M.begin() + pivot*n);
+				swap_ranges(R.begin() + c*k, R.begin() + (c+1)*k, R.begin() + pivot*k);
+			}
+			Complex inverse = 1.0/M[c*n + c];
+			for(int r=c+1; r<n; ++r){
+				Complex factor = M[r*n + c]*inverse;
+				if(factor == 0.0)
+					continue;
+				for(int j=c; j<n; ++j)
+					M[r*n + j] -= factor*M[c*n + j];
+				for(int j=0; j<k; ++j)
+					R[r*k + j] -= factor*R[c*k + j];
+			}
+		}
+		for(int c=n-1; c>=0; --c){
+			Complex inverse = 1.0/M[c*n + c];
+			for(int j=0; j<k; ++j){
+				Complex x = R[c*k + j];
+				for(int i=c+1; i<n; ++i)
+					x -= M[c*n + i]*R[i*k + j];
+				R[c*k + j] = x*inverse;
+			}
+		}
+		return true;
+	}
+
+	// normalization of the stretch velocity a reflex senses
+	double getMaxStretchVelocity(const Muscle& muscle)
+	{
+		return muscle.getOptimalFiberLength()*muscle.getMaxContractionVelocity();
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ReflexLoopAnalyzer::ReflexLoopAnalyzer(Model& model) :
+	_model(model),
+	_defaultState(new State(model.initSystem())),
+	_perturbation(1e-6),
+	_numThreads(0),
+	_numStates(0),
+	_numMuscles(0)
+{
+	setLogFrequencies(0.1, 50.0, 200);
+}
+
+ReflexLoopAnalyzer::ReflexLoopAnalyzer(const string& modelFile) :
+	_ownedModel(new Model(modelFile)),
+	_model(*_ownedModel),
+	_defaultState(new State(_model.initSystem())),
+	_perturbation(1e-6),
+	_numThreads(0),
+	_numStates(0),
+	_numMuscles(0)
+{
+	setLogFrequencies(0.1, 50.0, 200);
+}
+
+ReflexLoopAnalyzer::~ReflexLoopAnalyzer()
+{
+}
+
+void ReflexLoopAnalyzer::setLogFrequencies(double minFrequency,
+	double maxFrequency, int numFrequencies)
+{
+	if(minFrequency <= 0 || maxFrequency <= minFrequency || numFrequencies < 2)
+		throw Exception("ReflexLoopAnalyzer: the frequency grid needs 0 < min < max "
+			"and at least 2 frequencies.");
+	_frequencies.resize(numFrequencies);
+	double ratio = log(maxFrequency/minFrequency)/(numFrequencies - 1);
+	for(int f=0; f<numFrequencies; ++f)
+		_frequencies[f] = minFrequency*exp(f*ratio);
+}
+
+//=============================================================================
+// LINEARIZATION
+//=============================================================================
+void ReflexLoopAnalyzer::linearize()
+{
+	linearize(*_defaultState);
+}
+
+void ReflexLoopAnalyzer::linearize(const State& state)
+{
+	const MultibodySystem& system = _model.getMultibodySystem();
+	const Set<Muscle>& muscles = _model.getMuscles();
+
+	State s(state);
+	system.realize(s, Stage::Velocity);
+	// the controls about which to linearize, held fixed while the states
+	// are perturbed
+	const Vector controls = _model.getControls(s);
+
+	int n = s.getNY();
+	int m = muscles.getSize();
+	vector<double> maxSpeed(m);
+	for(int k=0; k<m; ++k)
+		maxSpeed[k] = getMaxStretchVelocity(muscles[k]);
+
+	// state derivatives under the given controls, and the sensed stretch
+	// velocities
+	auto evaluate = [&](const Vector& u, Vector& derivatives, vector<double>& sensed) {
+		system.realize(s, Stage::Velocity);
+		for(int k=0; k<m; ++k)
+			sensed[k] = muscles[k].getLengtheningSpeed(s)/maxSpeed[k];
+		_model.setControls(s, u);
+		system.realize(s, Stage::Acceleration);
+		derivatives = s.getYDot();
+	};
+
+	_A.assign((size_t)n*n, 0.0);
+	_B.assign((size_t)n*m, 0.0);
+	_C.assign((size_t)m*n, 0.0);
+
+	const Vector y0 = s.getY();
+	Vector plus(n), minus(n);
+	vector<double> sensedPlus(m), sensedMinus(m);
+
+	// central differences with respect to each state
+	for(int j=0; j<n; ++j){
+		double h = _perturbation*std::max(1.0, fabs(y0[j]));
+		s.updY() = y0;
+		s.updY()[j] += h;
+		evaluate(controls, plus, sensedPlus);
+		s.updY() = y0;
+		s.updY()[j] -= h;
+		evaluate(controls, minus, sensedMinus);
+		for(int i=0; i<n; ++i)
+			_A[(size_t)i*n + j] = (plus[i] - minus[i])/(2*h);
+		for(int k=0; k<m; ++k)
+			_C[(size_t)k*n + j] = (sensedPlus[k] - sensedMinus[k])/(2*h);
+	}
+
+	// and with respect to each muscle's excitation
+	s.updY() = y0;
+	for(int k=0; k<m; ++k){
+		double h = _perturbation;
+		Vector u = controls;
+		muscles[k].addInControls(Vector(1, h), u);
+		evaluate(u, plus, sensedPlus);
+		u = controls;
+		muscles[k].addInControls(Vector(1, -h), u);
+		evaluate(u, minus, sensedMinus);
+		for(int i=0; i<n; ++i)
+			_B[(size_t)i*m + k] = (plus[i] - minus[i])/(2*h);
+	}
+
+	_numStates = n;
+	_numMuscles = m;
+	s.updY() = y0;
+	system.realize(s, Stage::Velocity);
+	_state.reset(new State(s));
+}
+
+int ReflexLoopAnalyzer::getNumUnstablePoles() const
+{
+	if(!isLinearized())
+		throw Exception("ReflexLoopAnalyzer: linearize the model first.");
+
+	int n = _numStates;
+	Matrix A(n, n);
+	for(int i=0; i<n; ++i)
+		for(int j=0; j<n; ++j)
+			A(i, j) = _A[(size_t)i*n + j];
+
+	Vector_<Complex> poles;
+	Eigen(A).getAllEigenValues(poles);
+	int numUnstable = 0;
+	for(int i=0; i<poles.size(); ++i)
+		if(poles[i].real() > 1e-8*std::max(1.0, abs(poles[i])))
+			++numUnstable;
+	return numUnstable;
+}
+
+//=============================================================================
+// FREQUENCY RESPONSE
+//=============================================================================
+void ReflexLoopAnalyzer::solvePlant(const vector<int>& muscles,
+	vector<Complex>& plant) const
+{
+	int n = _numStates;
+	int m = _numMuscles;
+	int k = (int)muscles.size();
+	int nf = (int)_frequencies.size();
+	plant.assign((size_t)nf*k*k, Complex(NaN, NaN));
+
+	int numThreads = _numThreads > 0 ? _numThreads : (int)std::thread::hardware_concurrency();
+	parallelRanges(nf, numThreads, [&](int first, int last) {
+		vector<Complex> M((size_t)n*n), X((size_t)n*k);
+		for(int f=first; f<last; ++f){
+			// (jwI - A) X = B, for the columns of the loop's muscles
+			Complex jw(0.0, 2*Pi*_frequencies[f]);
+			for(size_t e=0; e<M.size(); ++e)
+				M[e] = -_A[e];
+			for(int i=0; i<n; ++i){
+				M[(size_t)i*n + i] += jw;
+				for(int c=0; c<k; ++c)
+					X[(size_t)i*k + c] = _B[(size_t)i*m + muscles[c]];
+			}
+			if(!solveComplex(M, X, n, k))
+				continue;
+			// P = C X, for the rows of the loop's muscles
+			Complex* P = &plant[(size_t)f*k*k];
+			for(int r=0; r<k; ++r){
+				const double* C = &_C[(size_t)muscles[r]*n];
+				for(int c=0; c<k; ++c){
+					Complex sum = 0;
+					for(int i=0; i<n; ++i)
+						sum += C[i]*X[(size_t)i*k + c];
+					P[r*k + c] = sum;
+				}
+			}
+		}
+	});
+}
+
+vector<ReflexLoopAnalyzer::Loop> ReflexLoopAnalyzer::analyze(
+	const string& controllerName) const
+{
+	if(!isLinearized())
+		throw Exception("ReflexLoopAnalyzer: linearize the model first.");
+	for(size_t f=0; f<_frequencies.size(); ++f)
+		if(_frequencies[f] <= 0 || (f > 0 && _frequencies[f] <= _frequencies[f-1]))
+			throw Exception("ReflexLoopAnalyzer: frequencies must be positive and increasing.");
+
+	const ControllerSet& controllers = _model.getControllerSet();
+	if(!controllers.contains(controllerName))
+		throw Exception("ReflexLoopAnalyzer: controller " + controllerName
+			+ " not found in the model.");
+	const Controller& controller = controllers.get(controllerName);
+
+	// the reflex gain on the sensed stretch velocity, and each muscle's delay
+	const Set<Actuator>& actuators = controller.getActuatorSet();
+	int k = actuators.getSize();
+	double gain = 0;
+	vector<double> delays(k, 0.0);
+	if(const DelayedPathReflexController* delayed =
+		dynamic_cast<const DelayedPathReflexController*>(&controller)){
+		gain = delayed->get_gain()*delayed->getGainScale(*_state);
+		for(int i=0; i<k; ++i)
+			delays[i] = delayed->getMuscleDelay(i);
+	}
+	else if(const ReflexController* reflex =
+		dynamic_cast<const ReflexController*>(&controller))
+		gain = reflex->get_gain()*reflex->getGainScale(*_state);
+	else
+		throw Exception("ReflexLoopAnalyzer: " + controllerName
+			+ " is not a stretch velocity reflex controller.");
+
+	vector<int> muscles(k);
+	for(int i=0; i<k; ++i)
+		muscles[i] = _model.getMuscles().getIndex(actuators[i].getName());
+
+	vector<Complex> plant;
+	solvePlant(muscles, plant);
+
+	int nf = (int)_frequencies.size();
+	vector<Loop> loops(k + 1);
+	for(int i=0; i<k; ++i){
+		Loop& loop = loops[i];
+		loop.name = actuators[i].getName();
+		loop.muscles.push_back(loop.name);
+		loop.plant.resize(nf);
+		for(int f=0; f<nf; ++f)
+			loop.plant[f] = plant[(size_t)f*k*k + i*k + i];
+		assess(loop, gain, delays[i]);
+	}
+
+	// the group: every muscle excited alike, the stretch sensed on average
+	Loop& group = loops[k];
+	group.name = controllerName;
+	double meanDelay = 0;
+	for(int i=0; i<k; ++i){
+		group.muscles.push_back(actuators[i].getName());
+		meanDelay += delays[i]/k;
+	}
+	group.plant.assign(nf, 0.0);
+	for(int f=0; f<nf; ++f){
+		for(int e=0; e<k*k; ++e)
+			group.plant[f] += plant[(size_t)f*k*k + e];
+		if(k > 0)
+			group.plant[f] /= (double)k;
+	}
+	assess(group, gain, meanDelay);
+
+	return loops;
+}
+
+void ReflexLoopAnalyzer::assess(Loop& loop, double gain, double delay) const
+{
+	int nf = (int)loop.plant.size();
+	if(nf != (int)_frequencies.size())
+		throw Exception("ReflexLoopAnalyzer: loop " + loop.name
+			+ " was analyzed at other frequencies.");
+
+	loop.gain = gain;
+	loop.delay = delay;
+	loop.response.resize(nf);
+	loop.peakLoopGain = 0;
+	loop.crossoverFrequency = NaN;
+	loop.phaseMargin = Infinity;
+	loop.criticalDelay = Infinity;
+
+	// the delay only turns the phase of the undelayed loop
+	vector<Complex> undelayed(nf);
+	for(int f=0; f<nf; ++f){
+		double w = 2*Pi*_frequencies[f];
+		undelayed[f] = -gain*loop.plant[f];
+		loop.response[f] = undelayed[f]*polar(1.0, -w*delay);
+		loop.peakLoopGain = std::max(loop.peakLoopGain, abs(undelayed[f]));
+	}
+
+	for(int f=0; f+1<nf; ++f){
+		double g0 = abs(undelayed[f]), g1 = abs(undelayed[f+1]);
+		if(isNaN(g0) || isNaN(g1) || g0 == 0 || g1 == 0)
+			continue;
+		if((g0 - 1)*(g1 - 1) > 0 || g0 == g1)
+			continue;
+
+		// gain crossover, interpolated in log gain over log frequency
+		double t = log(g0)/(log(g0) - log(g1));
+		double frequency = exp((1 - t)*log(_frequencies[f]) + t*log(_frequencies[f+1]));
+		double phase = arg(undelayed[f]) + t*arg(undelayed[f+1]/undelayed[f]);
+		// phase in [-pi, pi): the delay that turns it to -pi is critical
+		phase -= 2*Pi*floor((phase + Pi)/(2*Pi));
+		double w = 2*Pi*frequency;
+		double critical = (phase + Pi)/w;
+		double margin = (critical - delay)*w*180/Pi;
+
+		loop.criticalDelay = std::min(loop.criticalDelay, critical);
+		if(margin < loop.phaseMargin){
+			loop.phaseMargin = margin;
+			loop.crossoverFrequency = frequency;
+		}
+	}
+}
+
+//=============================================================================
+// OUTPUT
+//=============================================================================
+void ReflexLoopAnalyzer::printMargins(const vector<Loop>& loops, ostream& out)
+{
+	out << "loop\tgain\tdelay\tpeak_loop_gain\tcrossover_frequency\t"
+		"phase_margin\tcritical_delay\tstable" << endl;
+	for(size_t l=0; l<loops.size(); ++l){
+		const Loop& loop = loops[l];
+		out << setprecision(8) << loop.name << '\t'
+			<< loop.gain << '\t'
+			<< loop.delay << '\t'
+			<< loop.peakLoopGain << '\t'
+			<< loop.crossoverFrequency << '\t'
+			<< loop.phaseMargin << '\t'
+			<< loop.criticalDelay << '\t'
+			<< (loop.isStable() ? 1 : 0) << endl;
+	}
+}
+
+void ReflexLoopAnalyzer::printResponses(const vector<Loop>& loops,
+	ostream& out) const
+{
+	out << "frequency";
+	for(size_t l=0; l<loops.size(); ++l)
+		out << '\t' << loops[l].name << "_gain\t" << loops[l].name << "_phase";
+	out << endl;
+
+	for(size_t f=0; f<_frequencies.size(); ++f){
+		out << setprecision(8) << _frequencies[f];
+		for(size_t l=0; l<loops.size(); ++l){
+			const Complex& response = loops[l].response[f];
+			out << '\t' << abs(response) << '\t' << arg(response)*180/Pi;
+		}
+		out << endl;
+	}
+}
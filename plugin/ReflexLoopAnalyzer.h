@@ -0,0 +1,175 @@
+#ifndef OPENSIM_ReflexLoopAnalyzer_H_
+#define OPENSIM_ReflexLoopAnalyzer_H_
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  ReflexLoopAnalyzer.h                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <complex>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace SimTK {
+class State;
+}
+
+namespace OpenSim {
+
+class Model;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexLoopAnalyzer assesses the stability of delayed stretch reflex loops
+ * in the frequency domain, from one linearization of the model, instead of
+ * from many simulated landings.
+ *
+ * linearize() takes the model about a State by central finite differences:
+ * the state derivatives with respect to the continuous states and to the
+ * muscle excitations (A, B), and the normalized lengthening speed each
+ * reflex senses with respect to the states (C). The plant of a reflex loop,
+ * from excitation to sensed stretch velocity, is then
+ * P(jw) = C (jwI - A)^-1 B, solved at every frequency of a grid, the
+ * frequencies spread over threads.
+ *
+ * analyze() forms the loops of a DelayedPathReflexController (or an
+ * undelayed ReflexController): one per muscle, from the diagonal of P, and
+ * one for the controller's muscles as a group, excited together and sensed
+ * on average. With the rectifier of the reflex taken as conducting (the
+ * muscle stretching, the worst case), the loop transfer is
+ * L(jw) = -gain P(jw) exp(-jw delay), and for each loop the analyzer reports
+ * the peak loop gain, the gain crossover frequency, the phase margin at the
+ * reflex delay and the critical delay, the shortest delay at which the loop
+ * reaches instability. A loop whose gain stays below one has no crossover and
+ * tolerates any delay.
+ *
+ * A Loop keeps its plant response, so assess() re-evaluates it for other
+ * gains and delays without linearizing again, to prune unstable parameter
+ * regions before simulating them. The margins presume a stable open loop
+ * (see getNumUnstablePoles()) and neglect coupling between muscles.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexLoopAnalyzer {
+
+public:
+	/** A reflex loop and its margins. */
+	struct Loop {
+		std::string name;			// muscle, or controller for the group
+		std::vector<std::string> muscles;
+		double gain;				// control per unit normalized stretch velocity
+		double delay;				// seconds
+		// plant response (excitation to sensed stretch velocity) and loop
+		// response L at each analyzed frequency
+		std::vector<std::complex<double> > plant;
+		std::vector<std::complex<double> > response;
+		double peakLoopGain;
+		double crossoverFrequency;	// Hz, NaN if the loop gain stays below one
+		double phaseMargin;			// degrees, Infinity without crossover
+		double criticalDelay;		// seconds, Infinity without crossover
+		bool isStable() const { return delay < criticalDelay; }
+	};
+
+	/** Analyze the reflexes of the model, whose system is built here. */
+	explicit ReflexLoopAnalyzer(Model& model);
+	/** Load the model file and analyze its reflexes. */
+	explicit ReflexLoopAnalyzer(const std::string& modelFile);
+	~ReflexLoopAnalyzer();
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	/** Frequencies (Hz) at which loops are analyzed. */
+	void setFrequencies(const std::vector<double>& frequencies)
+	{	_frequencies = frequencies; }
+	/** Analyze at numFrequencies logarithmically spaced frequencies (Hz). */
+	void setLogFrequencies(double minFrequency, double maxFrequency,
+		int numFrequencies);
+	const std::vector<double>& getFrequencies() const { return _frequencies; }
+	/** Relative finite difference step of the linearization. */
+	void setPerturbation(double perturbation) { _perturbation = perturbation; }
+	/** Number of worker threads; 0 uses one per hardware thread. */
+	void setNumThreads(int numThreads) { _numThreads = numThreads; }
+
+	//--------------------------------------------------------------------------
+	// ANALYSIS
+	//--------------------------------------------------------------------------
+	/** Linearize the model about the state. */
+	void linearize(const SimTK::State& s);
+	/** Linearize the model about its default state. */
+	void linearize();
+	bool isLinearized() const { return _state.get() != NULL; }
+	/** Number of eigenvalues of A with a positive real part. */
+	int getNumUnstablePoles() const;
+
+	/** Loops of the named controller about the linearized state: one per
+	 * muscle in actuator order, then the group. */
+	std::vector<Loop> analyze(const std::string& controllerName) const;
+
+	/** Re-evaluate a loop's response and margins for a gain and delay. */
+	void assess(Loop& loop, double gain, double delay) const;
+
+	/** Write the margins of the loops as a tab-delimited table. */
+	static void printMargins(const std::vector<Loop>& loops, std::ostream& out);
+	/** Write the loop responses (gain and phase per frequency). */
+	void printResponses(const std::vector<Loop>& loops, std::ostream& out) const;
+
+private:
+	// plant responses of the muscles (model muscle indices) at every
+	// frequency: numFrequencies blocks of muscles.size() squared, row-major
+	void solvePlant(const std::vector<int>& muscles,
+		std::vector<std::complex<double> >& plant) const;
+
+	// model loaded by the analyzer, if any
+	std::unique_ptr<Model> _ownedModel;
+	Model& _model;
+	std::unique_ptr<SimTK::State> _defaultState;
+	// state the model was linearized about
+	std::unique_ptr<SimTK::State> _state;
+
+	std::vector<double> _frequencies;
+	double _perturbation;
+	int _numThreads;
+
+	// linearization: numStates square A (row-major), B with one column per
+	// model muscle and C with one row per model muscle, each row-major
+	int _numStates;
+	int _numMuscles;
+	std::vector<double> _A;
+	std::vector<double> _B;
+	std::vector<double> _C;
+
+};	// END of class ReflexLoopAnalyzer
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexLoopAnalyzer_H_
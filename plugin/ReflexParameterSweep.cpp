@@ -0,0 +1,621 @@
+/* -------------------------------------------------------------------------- *
+ *                   OpenSim:  ReflexParameterSweep.cpp                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexParameterSweep.h"
+#include "MuscleReflexController.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <limits>
+#include <thread>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <csignal>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	const char SweepMagic[8] = { 'R','F','X','S','W','E','E','P' };
+	const unsigned int SweepVersion = 1;
+
+	template <typename T>
+	void writeValue(ostream& out, const T& value)
+	{
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void writeNames(ostream& out, const vector<string>& names)
+	{
+		writeValue(out, (unsigned int)names.size());
+		for(size_t i=0; i<names.size(); ++i){
+			writeValue(out, (unsigned int)names[i].size());
+			out.write(names[i].data(), names[i].size());
+		}
+	}
+
+	// result record of a point that was not simulated
+	void markFailed(double* record, int width)
+	{
+		record[0] = 0;
+		for(int k=1; k<width; ++k)
+			record[k] = NaN;
+	}
+
+#ifndef _WIN32
+	// blocking transfers that survive signals and short reads/writes
+	bool writeAll(int fd, const void* data, size_t size)
+	{
+		const char* p = static_cast<const char*>(data);
+		while(size > 0){
+			ssize_t n = ::write(fd, p, size);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				return false;
+			p += n;
+			size -= (size_t)n;
+		}
+		return true;
+	}
+
+	bool readAll(int fd, void* data, size_t size)
+	{
+		char* p = static_cast<char*>(data);
+		while(size > 0){
+			ssize_t n = ::read(fd, p, size);
+			if(n < 0 && errno == EINTR)
+				continue;
+			if(n <= 0)
+				return false;
+			p += n;
+			size -= (size_t)n;
+		}
+		return true;
+	}
+
+	bool sendRequest(int fd, int shard, long long first, long long count)
+	{
+		return writeAll(fd, &shard, sizeof(shard))
+			&& writeAll(fd, &first, sizeof(first))
+			&& writeAll(fd, &count, sizeof(count));
+	}
+#endif
+}
+
+
+//=============================================================================
+// WORKER
+//=============================================================================
+// A worker's model, loaded once, and the handles it needs to set up and
+// measure a run.
+class ReflexParameterSweep::Evaluator {
+public:
+	Evaluator(const ReflexParameterSweep& sweep, const string& workerTag) :
+		_sweep(sweep),
+		_model(sweep._modelFile)
+	{
+		ControllerSet& controllers = _model.updControllerSet();
+		// workers recording control traces each write their own files
+		for(int i=0; i<controllers.getSize(); ++i)
+			if(MuscleReflexController* reflex =
+					dynamic_cast<MuscleReflexController*>(&controllers[i]))
+				reflex->tagTraceFile(workerTag);
+
+		for(size_t p=0; p<sweep._controllers.size(); ++p){
+			Controller& controller = controllers.get(sweep._controllers[p]);
+			_parameters.push_back(&Property<double>::updAs(
+				controller.updPropertyByName(sweep._properties[p])));
+		}
+		for(size_t o=0; o<sweep._outputs.size(); ++o)
+			_outputs.push_back(&_model.getCoordinateSet().get(sweep._outputs[o]));
+	}
+
+	// simulate a grid point, filling its result record
+	void evaluate(long long point, double* record)
+	{
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+		int width = _sweep.getResultWidth();
+		markFailed(record, width);
+		for(size_t o=0; o<_outputs.size(); ++o){
+			record[3 + 3*o] = Infinity;
+			record[4 + 3*o] = -Infinity;
+		}
+
+		try{
+			vector<double> values = _sweep.getPointValues(point);
+			for(size_t p=0; p<_parameters.size(); ++p)
+				_parameters[p]->setValue(values[p]);
+
+			// controllers pick up the parameters when connected to the model
+			State s = _model.initSystem();
+			_model.equilibrateMuscles(s);
+
+			const MultibodySystem& system = _model.getMultibodySystem();
+			RungeKuttaMersonIntegrator integrator(system);
+			integrator.setAccuracy(_sweep._accuracy);
+			TimeStepper stepper(system, integrator);
+			stepper.initialize(s);
+
+			double dt = _sweep._reportingInterval;
+			int numSteps = (int)ceil(_sweep._duration/dt - 1e-9);
+			measure(integrator.getState(), record);
+			for(int k=1; k<=numSteps; ++k){
+				stepper.stepTo(std::min(k*dt, _sweep._duration));
+				measure(integrator.getState(), record);
+			}
+			record[0] = 1;
+		}
+		catch(const std::exception& x){
+			cout << "ReflexParameterSweep: point " << point
+				<< " failed: " << x.what() << endl;
+		}
+
+		record[2] = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+	}
+
+private:
+	void measure(const State& s, double* record) const
+	{
+		_model.getMultibodySystem().realize(s, Stage::Position);
+		record[1] = s.getTime();
+		for(size_t o=0; o<_outputs.size(); ++o){
+			double value = _outputs[o]->getValue(s);
+			record[3 + 3*o] = std::min(record[3 + 3*o], value);
+			record[4 + 3*o] = std::max(record[4 + 3*o], value);
+			record[5 + 3*o] = value;
+		}
+	}
+
+	const ReflexParameterSweep& _sweep;
+	Model _model;
+	std::vector<Property<double>*> _parameters;
+	std::vector<const Coordinate*> _outputs;
+};
+
+// the coordinator's end of a worker
+struct ReflexParameterSweep::Connection {
+	long pid;		// local process, or -1 for a remote worker
+	int readFd;
+	int writeFd;
+	int shard;		// shard being run, or -1 if idle
+	std::chrono::steady_clock::time_point deadline;	// when the shard times out
+};
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ReflexParameterSweep::ReflexParameterSweep(const string& modelFile) :
+	_modelFile(modelFile),
+	_model(new Model(modelFile)),
+	_duration(0.5),
+	_reportingInterval(0.001),
+	_accuracy(1e-4),
+	_numProcesses(0),
+	_shardSize(4),
+	_maxRetries(2),
+	_shardTimeout(0)
+{
+}
+
+ReflexParameterSweep::~ReflexParameterSweep()
+{
+#ifndef _WIN32
+	// remote workers never handed to run()
+	for(size_t r=0; r<_remoteWorkers.size(); ++r){
+		close(_remoteWorkers[r].first);
+		if(_remoteWorkers[r].second != _remoteWorkers[r].first)
+			close(_remoteWorkers[r].second);
+	}
+#endif
+}
+
+//=============================================================================
+// CONFIGURATION
+//=============================================================================
+void ReflexParameterSweep::addParameter(const string& controller,
+	const string& property, const vector<double>& values)
+{
+	const ControllerSet& controllers = _model->getControllerSet();
+	if(!controllers.contains(controller))
+		throw Exception("ReflexParameterSweep: controller '" + controller
+			+ "' not found in the model.");
+	const Controller& c = controllers.get(controller);
+	if(!c.hasProperty(property)
+		|| !Property<double>::isA(c.getPropertyByName(property)))
+		throw Exception("ReflexParameterSweep: " + controller
+			+ " has no double property '" + property + "'.");
+	if(values.empty())
+		throw Exception("ReflexParameterSweep: no values for " + controller
+			+ "." + property + ".");
+
+	_controllers.push_back(controller);
+	_properties.push_back(property);
+	_values.push_back(values);
+}
+
+void ReflexParameterSweep::addOutputCoordinate(const string& name)
+{
+	if(!_model->getCoordinateSet().contains(name))
+		throw Exception("ReflexParameterSweep: coordinate '" + name
+			+ "' not found in the model.");
+	_outputs.push_back(name);
+}
+
+void ReflexParameterSweep::addRemoteWorker(int readFd, int writeFd)
+{
+	_remoteWorkers.push_back(make_pair(readFd, writeFd));
+}
+
+//=============================================================================
+// GRID
+//=============================================================================
+long long ReflexParameterSweep::getNumPoints() const
+{
+	if(_values.empty())
+		return 0;
+	long long n = 1;
+	for(size_t p=0; p<_values.size(); ++p)
+		n *= (long long)_values[p].size();
+	return n;
+}
+
+vector<double> ReflexParameterSweep::getPointValues(long long point) const
+{
+	// mixed radix digits, the last parameter varying fastest
+	vector<double> values(_values.size());
+	for(int p=(int)_values.size()-1; p>=0; --p){
+		long long n = (long long)_values[p].size();
+		values[p] = _values[p][point % n];
+		point /= n;
+	}
+	return values;
+}
+
+//=============================================================================
+// EXECUTION
+//=============================================================================
+#ifdef _WIN32
+
+void ReflexParameterSweep::serve(int inFd, int outFd) const
+{
+	throw Exception("ReflexParameterSweep: worker processes require a POSIX system.");
+}
+
+void ReflexParameterSweep::spawnWorker(vector<Connection>& connections) const
+{
+	throw Exception("ReflexParameterSweep: worker processes require a POSIX system.");
+}
+
+void ReflexParameterSweep::run(const string& resultFile)
+{
+	throw Exception("ReflexParameterSweep: worker processes require a POSIX system.");
+}
+
+#else
+
+void ReflexParameterSweep::serve(int inFd, int outFd) const
+{
+	Evaluator evaluator(*this, "worker" + to_string((long long)getpid()));
+	int width = getResultWidth();
+	vector<double> records;
+
+	while(true){
+		int shard;
+		long long first, count;
+		if(!readAll(inFd, &shard, sizeof(shard)) || shard < 0
+			|| !readAll(inFd, &first, sizeof(first))
+			|| !readAll(inFd, &count, sizeof(count)))
+			return;
+
+		records.assign((size_t)(count*width), 0.0);
+		for(long long i=0; i<count; ++i)
+			evaluator.evaluate(first + i, &records[(size_t)(i*width)]);
+
+		if(!writeAll(outFd, &shard, sizeof(shard))
+			|| !writeAll(outFd, &count, sizeof(count))
+			|| !writeAll(outFd, records.data(), records.size()*sizeof(double)))
+			return;
+	}
+}
+
+void ReflexParameterSweep::spawnWorker(vector<Connection>& connections) const
+{
+	int toWorker[2], fromWorker[2];
+	if(pipe(toWorker) != 0)
+		throw Exception("ReflexParameterSweep: could not create a worker pipe.");
+	if(pipe(fromWorker) != 0){
+		close(toWorker[0]); close(toWorker[1]);
+		throw Exception("ReflexParameterSweep: could not create a worker pipe.");
+	}
+
+	// nothing buffered may be written twice
+	cout.flush();
+	pid_t pid = fork();
+	if(pid < 0){
+		close(toWorker[0]); close(toWorker[1]);
+		close(fromWorker[0]); close(fromWorker[1]);
+		throw Exception("ReflexParameterSweep: could not start a worker process.");
+	}
+
+	if(pid == 0){
+		// worker: keep only its own ends of its own pipes
+		close(toWorker[1]);
+		close(fromWorker[0]);
+		for(size_t c=0; c<connections.size(); ++c){
+			close(connections[c].readFd);
+			close(connections[c].writeFd);
+		}
+		int status = 0;
+		try{
+			serve(toWorker[0], fromWorker[1]);
+		}
+		catch(const std::exception& x){
+			cout << "ReflexParameterSweep: worker failed: " << x.what() << endl;
+			status = 1;
+		}
+		cout.flush();
+		_exit(status);
+	}
+
+	close(toWorker[0]);
+	close(fromWorker[1]);
+	Connection connection = { (long)pid, fromWorker[0], toWorker[1], -1,
+		std::chrono::steady_clock::time_point() };
+	connections.push_back(connection);
+}
+
+void ReflexParameterSweep::run(const string& resultFile)
+{
+	if(_duration <= 0 || _reportingInterval <= 0)
+		throw Exception("ReflexParameterSweep: duration and reporting interval must be positive.");
+	if(_shardSize < 1)
+		throw Exception("ReflexParameterSweep: shard size must be positive.");
+	long long numPoints = getNumPoints();
+	if(numPoints == 0)
+		throw Exception("ReflexParameterSweep: no parameters to sweep.");
+
+	int width = getResultWidth();
+	vector<double> results((size_t)(numPoints*width));
+	for(long long i=0; i<numPoints; ++i)
+		markFailed(&results[(size_t)(i*width)], width);
+
+	int numShards = (int)((numPoints + _shardSize - 1)/_shardSize);
+	deque<int> pending;
+	for(int k=0; k<numShards; ++k)
+		pending.push_back(k);
+	vector<int> attempts(numShards, 0);
+	int numFinished = 0;
+
+	// a dead worker must not kill the coordinator
+	struct sigaction ignore, previous;
+	memset(&ignore, 0, sizeof(ignore));
+	ignore.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ignore, &previous);
+
+	vector<Connection> connections;
+	for(size_t r=0; r<_remoteWorkers.size(); ++r){
+		Connection connection = { -1, _remoteWorkers[r].first, _remoteWorkers[r].second, -1,
+			std::chrono::steady_clock::time_point() };
+		connections.push_back(connection);
+	}
+	_remoteWorkers.clear();
+
+	// close a connection, reaping its process
+	auto drop = [](Connection& c) {
+		close(c.readFd);
+		if(c.writeFd != c.readFd)
+			close(c.writeFd);
+		if(c.pid > 0)
+			waitpid((pid_t)c.pid, NULL, 0);
+	};
+
+	try{
+		int numLocal = _numProcesses > 0 ? _numProcesses : (int)std::thread::hardware_concurrency();
+		numLocal = std::max(connections.empty() ? 1 : 0, std::min(numLocal, numShards));
+		for(int w=0; w<numLocal; ++w)
+			spawnWorker(connections);
+
+		vector<double> records;
+		while(numFinished < numShards){
+			// hand out shards to idle workers
+			for(size_t c=0; c<connections.size() && !pending.empty(); ++c){
+				Connection& connection = connections[c];
+				if(connection.shard >= 0)
+					continue;
+				int k = pending.front();
+				pending.pop_front();
+				long long first = (long long)k*_shardSize;
+				long long count = std::min((long long)_shardSize, numPoints - first);
+				if(sendRequest(connection.writeFd, k, first, count)){
+					connection.shard = k;
+					connection.deadline = std::chrono::steady_clock::now()
+						+ std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+							std::chrono::duration<double>(_shardTimeout));
+				}
+				else{
+					// the shard never reached the worker
+					pending.push_front(k);
+					bool local = connection.pid > 0;
+					drop(connection);
+					connections.erase(connections.begin() + c);
+					--c;
+					if(local)
+						spawnWorker(connections);
+				}
+			}
+
+			vector<pollfd> polls;
+			vector<size_t> polled;
+			std::chrono::steady_clock::time_point earliest = std::chrono::steady_clock::time_point::max();
+			for(size_t c=0; c<connections.size(); ++c){
+				if(connections[c].shard < 0)
+					continue;
+				pollfd p = { connections[c].readFd, POLLIN, 0 };
+				polls.push_back(p);
+				polled.push_back(c);
+				earliest = std::min(earliest, connections[c].deadline);
+			}
+			if(polls.empty())
+				throw Exception("ReflexParameterSweep: no workers left to run the sweep.");
+
+			// wake up no later than the first shard deadline
+			int timeout = -1;
+			if(_shardTimeout > 0){
+				auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+					earliest - std::chrono::steady_clock::now()).count() + 1;
+				timeout = (int)std::max(0LL, std::min((long long)left,
+					(long long)numeric_limits<int>::max()));
+			}
+
+			if(poll(polls.data(), polls.size(), timeout) < 0){
+				if(errno == EINTR)
+					continue;
+				throw Exception("ReflexParameterSweep: polling the workers failed.");
+			}
+			std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+			// collect replies, dropping workers that died or timed out; walk
+			// backwards so erasing keeps the remaining indices valid
+			for(int i=(int)polls.size()-1; i>=0; --i){
+				Connection& connection = connections[polled[i]];
+				bool timedOut = !polls[i].revents && _shardTimeout > 0 && now >= connection.deadline;
+				if(!polls[i].revents && !timedOut)
+					continue;
+				int k = connection.shard;
+				long long first = (long long)k*_shardSize;
+				long long count = std::min((long long)_shardSize, numPoints - first);
+
+				bool ok = false;
+				if(!timedOut){
+					int shard = -1;
+					long long replyCount = 0;
+					records.resize((size_t)(count*width));
+					ok = readAll(connection.readFd, &shard, sizeof(shard))
+						&& readAll(connection.readFd, &replyCount, sizeof(replyCount))
+						&& shard == k && replyCount == count
+						&& readAll(connection.readFd, records.data(), records.size()*sizeof(double));
+				}
+
+				if(ok){
+					copy(records.begin(), records.end(), results.begin() + (size_t)(first*width));
+					connection.shard = -1;
+					++numFinished;
+					continue;
+				}
+
+				// the worker died, broke the protocol or went silent: retry the shard
+				if(timedOut)
+					cout << "WARNING - ReflexParameterSweep: shard " << k << " timed out after "
+						<< _shardTimeout << " s." << endl;
+				if(++attempts[k] > _maxRetries){
+					cout << "WARNING - ReflexParameterSweep: shard " << k << " failed "
+						<< attempts[k] << " times and is recorded as not completed." << endl;
+					++numFinished;
+				}
+				else
+					pending.push_back(k);
+
+				// a silent local worker would never be reaped
+				bool local = connection.pid > 0;
+				if(timedOut && local)
+					kill((pid_t)connection.pid, SIGKILL);
+				drop(connection);
+				connections.erase(connections.begin() + polled[i]);
+				if(local && numFinished < numShards)
+					spawnWorker(connections);
+			}
+		}
+	}
+	catch(...){
+		for(size_t c=0; c<connections.size(); ++c){
+			if(connections[c].pid > 0)
+				kill((pid_t)connections[c].pid, SIGTERM);
+			drop(connections[c]);
+		}
+		sigaction(SIGPIPE, &previous, NULL);
+		throw;
+	}
+
+	// stop every worker
+	for(size_t c=0; c<connections.size(); ++c){
+		sendRequest(connections[c].writeFd, -1, 0, 0);
+		drop(connections[c]);
+	}
+	sigaction(SIGPIPE, &previous, NULL);
+
+	writeResults(resultFile, results);
+}
+
+#endif
+
+void ReflexParameterSweep::writeResults(const string& resultFile,
+	const vector<double>& results) const
+{
+	ofstream out(resultFile.c_str(), ios::binary);
+	if(!out.good())
+		throw Exception("ReflexParameterSweep: cannot write " + resultFile + ".");
+
+	vector<string> parameterNames;
+	for(size_t p=0; p<_controllers.size(); ++p)
+		parameterNames.push_back(_controllers[p] + "." + _properties[p]);
+
+	out.write(SweepMagic, sizeof(SweepMagic));
+	writeValue(out, SweepVersion);
+	writeNames(out, parameterNames);
+	writeNames(out, _outputs);
+	long long numPoints = getNumPoints();
+	writeValue(out, (unsigned long long)numPoints);
+
+	int width = getResultWidth();
+	for(long long i=0; i<numPoints; ++i){
+		vector<double> values = getPointValues(i);
+		out.write(reinterpret_cast<const char*>(values.data()), values.size()*sizeof(double));
+		out.write(reinterpret_cast<const char*>(&results[(size_t)(i*width)]), width*sizeof(double));
+	}
+	if(!out.good())
+		throw Exception("ReflexParameterSweep: writing " + resultFile + " failed.");
+}
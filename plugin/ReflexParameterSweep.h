@@ -0,0 +1,169 @@
+#ifndef OPENSIM_ReflexParameterSweep_H_
+#define OPENSIM_ReflexParameterSweep_H_
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  ReflexParameterSweep.h                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <memory>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+class Model;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexParameterSweep simulates a model over a grid of controller
+ * parameters (e.g. the gain and delay of a DelayedPathReflexController and
+ * the gains of a MuscleFiberStretchController), spread over worker
+ * processes.
+ *
+ * The grid is the product of the values given for each parameter (the last
+ * parameter varying fastest) and is split into shards of consecutive grid
+ * points. A coordinator hands shards to workers and merges their results
+ * into one binary result file. Each worker loads the model once and, for
+ * each grid point, sets the parameters, initializes the system, simulates
+ * for the set duration and measures the minimum, maximum and final value of
+ * each output coordinate. Reflexes recording a control trace write one file
+ * per worker process (name.worker<pid>.ctrace).
+ *
+ * Workers speak a small binary protocol over a pair of file descriptors, so
+ * they can be local processes on pipes or remote processes on a socket:
+ *  - request: int32 shard (negative to stop), int64 first point, int64 count
+ *  - reply:   int32 shard, int64 count, count result records (doubles)
+ * run() forks the local workers; remote workers run serve() with the same
+ * model file and configuration and are handed to the coordinator with
+ * addRemoteWorker(). A shard whose worker dies, breaks the protocol or
+ * does not answer within the shard timeout is retried on another worker
+ * (a local worker that timed out is killed and restarted), up to the
+ * retry limit, after which its points are recorded as not completed.
+ * Without a shard timeout the coordinator waits for a silent worker
+ * indefinitely.
+ *
+ * The result file starts with the magic "RFXSWEEP", a uint32 version, the
+ * parameter names ("controller.property") and output coordinate names, each
+ * list a uint32 count of uint32 length-prefixed strings, and a uint64 number
+ * of points. One record of doubles per grid point follows, in grid order:
+ * the parameter values, completed (1 or 0), final time, wall time, and the
+ * min, max and final value of each output coordinate.
+ *
+ * Worker processes require a POSIX system.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexParameterSweep {
+
+public:
+	/** Parse the model file. The plugin's types must be registered. */
+	explicit ReflexParameterSweep(const std::string& modelFile);
+	~ReflexParameterSweep();
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	/** Sweep a double property of a controller over the given values. */
+	void addParameter(const std::string& controller, const std::string& property,
+		const std::vector<double>& values);
+	/** Measure a coordinate of every run. */
+	void addOutputCoordinate(const std::string& name);
+
+	/** Simulated duration of each run (seconds). */
+	void setDuration(double duration) { _duration = duration; }
+	/** Interval (seconds) at which the outputs are sampled. */
+	void setReportingInterval(double interval) { _reportingInterval = interval; }
+	void setIntegratorAccuracy(double accuracy) { _accuracy = accuracy; }
+
+	/** Number of local worker processes; 0 uses one per hardware thread. */
+	void setNumProcesses(int numProcesses) { _numProcesses = numProcesses; }
+	/** Grid points per shard. */
+	void setShardSize(int shardSize) { _shardSize = shardSize; }
+	/** Times a shard is retried after its worker failed. */
+	void setMaxRetries(int maxRetries) { _maxRetries = maxRetries; }
+	/** Wall-clock seconds a worker may take to answer one shard before the
+	 * shard is reassigned; zero (the default) waits indefinitely. */
+	void setShardTimeout(double seconds) { _shardTimeout = seconds; }
+
+	/** Add a connected remote worker running serve(). The coordinator takes
+	 * ownership of the descriptors. */
+	void addRemoteWorker(int readFd, int writeFd);
+
+	//--------------------------------------------------------------------------
+	// EXECUTION
+	//--------------------------------------------------------------------------
+	long long getNumPoints() const;
+	/** Parameter values of a grid point. */
+	std::vector<double> getPointValues(long long point) const;
+	/** Doubles per result record, excluding the parameter values. */
+	int getResultWidth() const { return 3 + 3*(int)_outputs.size(); }
+
+	/** Run the whole grid and write the merged results to resultFile. */
+	void run(const std::string& resultFile);
+
+	/** Worker side of the protocol: answer shard requests read from inFd on
+	 * outFd until told to stop or the coordinator goes away. */
+	void serve(int inFd, int outFd) const;
+
+private:
+	class Evaluator;
+	struct Connection;
+
+	// start a local worker process
+	void spawnWorker(std::vector<Connection>& connections) const;
+	void writeResults(const std::string& resultFile,
+		const std::vector<double>& results) const;
+
+	std::string _modelFile;
+	std::unique_ptr<Model> _model;
+
+	std::vector<std::string> _controllers;
+	std::vector<std::string> _properties;
+	std::vector<std::vector<double> > _values;
+	std::vector<std::string> _outputs;
+
+	double _duration;
+	double _reportingInterval;
+	double _accuracy;
+
+	int _numProcesses;
+	int _shardSize;
+	int _maxRetries;
+	double _shardTimeout;
+
+	// connected remote workers, as (read, write) descriptors
+	std::vector<std::pair<int, int> > _remoteWorkers;
+
+};	// END of class ReflexParameterSweep
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexParameterSweep_H_
@@ -0,0 +1,302 @@
+/* -------------------------------------------------------------------------- *
+ *                 OpenSim:  ReflexRegressionHarness.cpp                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "ReflexRegressionHarness.h"
+#include "MuscleReflexController.h"
+
+#include <chrono>
+#include <iomanip>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// suffix of the control columns of a trajectory
+	const string ControlSuffix = "_control";
+
+	bool isControlColumn(const string& label)
+	{
+		return label.size() > ControlSuffix.size()
+			&& label.compare(label.size() - ControlSuffix.size(),
+				ControlSuffix.size(), ControlSuffix) == 0;
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+ReflexRegressionHarness::ReflexRegressionHarness(const string& modelFile) :
+	_model(new Model(modelFile)),
+	_duration(0.1),
+	_reportingInterval(0.001),
+	_accuracy(1e-5),
+	_controlTolerance(1e-3),
+	_coordinateTolerance(1e-4),
+	_timingRepeats(20),
+	_allocationCounter(NULL)
+{
+}
+
+ReflexRegressionHarness::~ReflexRegressionHarness()
+{
+}
+
+vector<string> ReflexRegressionHarness::getControllerNames() const
+{
+	vector<string> names;
+	const ControllerSet& controllers = _model->getControllerSet();
+	for(int i=0; i<controllers.getSize(); ++i)
+		if(dynamic_cast<const MuscleReflexController*>(&controllers[i]))
+			names.push_back(controllers[i].getName());
+	return names;
+}
+
+string ReflexRegressionHarness::getGoldenFileName(const string& directory,
+	const string& controller)
+{
+	return directory + "/" + controller + ".golden.sto";
+}
+
+//=============================================================================
+// EXECUTION
+//=============================================================================
+ReflexRegressionHarness::Measurement ReflexRegressionHarness::run(
+	const string& controllerName, Storage& trajectory)
+{
+	if(_duration <= 0 || _reportingInterval <= 0)
+		throw Exception("ReflexRegressionHarness: duration and reporting interval must be positive.");
+
+	// only the reflex controller under test acts; the others get their
+	// flags back however the run ends
+	ControllerSet& controllers = _model->updControllerSet();
+	if(!controllers.contains(controllerName)
+		|| !dynamic_cast<MuscleReflexController*>(&controllers.get(controllerName)))
+		throw Exception("ReflexRegressionHarness: " + controllerName
+			+ " is not a reflex controller of the model.");
+	vector<bool> wasDisabled(controllers.getSize());
+	for(int i=0; i<controllers.getSize(); ++i){
+		wasDisabled[i] = controllers[i].isDisabled();
+		if(dynamic_cast<MuscleReflexController*>(&controllers[i]))
+			controllers[i].setDisabled(controllers[i].getName() != controllerName);
+	}
+	auto restore = [&]() {
+		for(int i=0; i<controllers.getSize(); ++i)
+			controllers[i].setDisabled(wasDisabled[i]);
+	};
+
+	Measurement measurement;
+	try{
+		measurement = measure(controllerName, trajectory);
+	}
+	catch(...){
+		restore();
+		throw;
+	}
+	restore();
+	return measurement;
+}
+
+ReflexRegressionHarness::Measurement ReflexRegressionHarness::measure(
+	const string& controllerName, Storage& trajectory)
+{
+	State s = _model->initSystem();
+	_model->equilibrateMuscles(s);
+	const MuscleReflexController& controller =
+		static_cast<const MuscleReflexController&>(_model->getControllerSet().get(controllerName));
+
+	// columns: coordinates, then the controls of the controller's muscles
+	const CoordinateSet& coordinates = _model->getCoordinateSet();
+	const Set<Actuator>& muscles = controller.getActuatorSet();
+	vector<int> controlIndex;
+	Array<string> labels;
+	labels.append("time");
+	for(int c=0; c<coordinates.getSize(); ++c)
+		labels.append(coordinates[c].getName());
+	for(int m=0; m<muscles.getSize(); ++m){
+		labels.append(muscles[m].getName() + ControlSuffix);
+		controlIndex.push_back(_model->getActuators().getIndex(muscles[m].getName()));
+	}
+	trajectory.purge();
+	trajectory.setName(controllerName + "_regression");
+	trajectory.setColumnLabels(labels);
+
+	vector<State> recorded;
+	vector<double> row(labels.getSize() - 1);
+	auto record = [&](const State& state) {
+		_model->getMultibodySystem().realize(state, Stage::Dynamics);
+		const Vector& controls = _model->getControls(state);
+		int k = 0;
+		for(int c=0; c<coordinates.getSize(); ++c)
+			row[k++] = coordinates[c].getValue(state);
+		for(size_t m=0; m<controlIndex.size(); ++m)
+			row[k++] = controls[controlIndex[m]];
+		trajectory.append(state.getTime(), (int)row.size(), row.empty() ? NULL : &row[0]);
+		recorded.push_back(state);
+	};
+
+	const MultibodySystem& system = _model->getMultibodySystem();
+	RungeKuttaMersonIntegrator integrator(system);
+	integrator.setAccuracy(_accuracy);
+	TimeStepper stepper(system, integrator);
+	stepper.initialize(s);
+
+	int numSteps = (int)ceil(_duration/_reportingInterval - 1e-9);
+	record(integrator.getState());
+	for(int k=1; k<=numSteps; ++k){
+		stepper.stepTo(std::min(k*_reportingInterval, _duration));
+		record(integrator.getState());
+	}
+
+	Measurement measurement;
+	measurement.controller = controllerName;
+	measurement.numSteps = integrator.getNumStepsTaken();
+	measurement.maxControlError = 0;
+	measurement.maxCoordinateError = 0;
+
+	// time the reflexes alone at the recorded states, in time order so that
+	// delayed controllers see a monotonic history within each pass
+	Vector u(muscles.getSize());
+	long long allocations = _allocationCounter ? _allocationCounter() : 0;
+	chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	for(int r=0; r<_timingRepeats; ++r){
+		for(size_t f=0; f<recorded.size(); ++f){
+			u = 0;
+			controller.computeMuscleControls(recorded[f], u);
+		}
+	}
+	double elapsed = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+	double numEvaluations = std::max(1.0, (double)_timingRepeats*recorded.size());
+	measurement.nsPerEvaluation = elapsed/numEvaluations;
+	measurement.allocationsPerEvaluation = _allocationCounter
+		? (_allocationCounter() - allocations)/numEvaluations : -1;
+
+	return measurement;
+}
+
+vector<ReflexRegressionHarness::Measurement> ReflexRegressionHarness::writeGolden(
+	const string& directory)
+{
+	vector<Measurement> measurements;
+	vector<string> names = getControllerNames();
+	for(size_t i=0; i<names.size(); ++i){
+		Storage trajectory;
+		measurements.push_back(run(names[i], trajectory));
+		trajectory.print(getGoldenFileName(directory, names[i]));
+	}
+	return measurements;
+}
+
+void ReflexRegressionHarness::compare(const Storage& trajectory,
+	const Storage& golden, Measurement& measurement) const
+{
+	const Array<string>& labels = trajectory.getColumnLabels();
+	const Array<string>& goldenLabels = golden.getColumnLabels();
+
+	if(trajectory.getSize() != golden.getSize()){
+		measurement.maxControlError = Infinity;
+		measurement.maxCoordinateError = Infinity;
+		return;
+	}
+
+	for(int c=1; c<labels.getSize(); ++c){
+		int g = goldenLabels.findIndex(labels[c]);
+		double& error = isControlColumn(labels[c])
+			? measurement.maxControlError : measurement.maxCoordinateError;
+		if(g < 1){
+			error = Infinity;
+			continue;
+		}
+		for(int f=0; f<trajectory.getSize(); ++f){
+			const StateVector& row = *trajectory.getStateVector(f);
+			const StateVector& goldenRow = *golden.getStateVector(f);
+			if(fabs(row.getTime() - goldenRow.getTime()) > 1e-9){
+				measurement.maxControlError = Infinity;
+				measurement.maxCoordinateError = Infinity;
+				return;
+			}
+			error = std::max(error, fabs(row.getData()[c-1] - goldenRow.getData()[g-1]));
+		}
+	}
+}
+
+bool ReflexRegressionHarness::check(const string& directory, ostream& report)
+{
+	bool passed = true;
+	report << "controller\tsteps\tns_per_evaluation\tallocations_per_evaluation\t"
+		"max_control_error\tmax_coordinate_error\tresult" << endl;
+
+	vector<string> names = getControllerNames();
+	for(size_t i=0; i<names.size(); ++i){
+		Storage trajectory;
+		Measurement measurement = run(names[i], trajectory);
+		Storage golden(getGoldenFileName(directory, names[i]));
+		compare(trajectory, golden, measurement);
+
+		vector<string> failures;
+		if(measurement.maxControlError > _controlTolerance)
+			failures.push_back("controls");
+		if(measurement.maxCoordinateError > _coordinateTolerance)
+			failures.push_back("kinematics");
+
+		map<string, Budget>::const_iterator budget = _budgets.find(names[i]);
+		if(budget != _budgets.end()){
+			const Budget& b = budget->second;
+			if(b.maxSteps >= 0 && measurement.numSteps > b.maxSteps)
+				failures.push_back("steps");
+			if(b.maxNsPerEvaluation >= 0 && measurement.nsPerEvaluation > b.maxNsPerEvaluation)
+				failures.push_back("time");
+			if(b.maxAllocationsPerEvaluation >= 0 && measurement.allocationsPerEvaluation >= 0
+				&& measurement.allocationsPerEvaluation > b.maxAllocationsPerEvaluation)
+				failures.push_back("allocations");
+		}
+
+		string result = "pass";
+		if(!failures.empty()){
+			passed = false;
+			result = "FAIL:";
+			for(size_t k=0; k<failures.size(); ++k)
+				result += (k ? "," : "") + failures[k];
+		}
+
+		report << setprecision(6) << measurement.controller << '\t'
+			<< measurement.numSteps << '\t'
+			<< measurement.nsPerEvaluation << '\t'
+			<< measurement.allocationsPerEvaluation << '\t'
+			<< measurement.maxControlError << '\t'
+			<< measurement.maxCoordinateError << '\t'
+			<< result << endl;
+	}
+	return passed;
+}
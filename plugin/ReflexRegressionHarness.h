@@ -0,0 +1,162 @@
+#ifndef OPENSIM_ReflexRegressionHarness_H_
+#define OPENSIM_ReflexRegressionHarness_H_
+/* -------------------------------------------------------------------------- *
+ *                  OpenSim:  ReflexRegressionHarness.h                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <iosfwd>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+class Model;
+class Storage;
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexRegressionHarness guards optimizations of the reflex controllers
+ * against changes in behavior and cost.
+ *
+ * For each reflex controller of a model such as
+ * examples/LandingModel/LandingReflexesModel.osim it runs a short landing
+ * with only that reflex controller enabled, recording the coordinates and
+ * the controller's controls at every reporting interval; the other reflex
+ * controllers get their disabled flags back afterwards. The recording is
+ * either written as a golden trajectory (<controller>.golden.sto) or
+ * compared with one within tolerances.
+ *
+ * Each run is also measured in-process: integration steps taken and, by
+ * re-evaluating the controller's reflexes at the recorded states in a tight
+ * loop, the cost of an evaluation in nanoseconds and, when the caller
+ * supplies an allocation counter, the heap allocations it makes. The
+ * library does not replace operator new itself; a test executable that
+ * does (plugin/test) passes its counter to setAllocationCounter().
+ * Optional budgets turn these measurements into pass/fail criteria.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexRegressionHarness {
+
+public:
+	/** Measurements of one run. */
+	struct Measurement {
+		std::string controller;
+		int numSteps;				// integration steps taken
+		double nsPerEvaluation;		// reflex evaluation cost
+		double allocationsPerEvaluation;	// -1 if not counted
+		double maxControlError;		// against the golden trajectory
+		double maxCoordinateError;
+	};
+
+	/** Limits on a controller's measurements; negative means no limit. */
+	struct Budget {
+		Budget() : maxSteps(-1), maxNsPerEvaluation(-1),
+			maxAllocationsPerEvaluation(-1) {}
+		int maxSteps;
+		double maxNsPerEvaluation;
+		double maxAllocationsPerEvaluation;
+	};
+
+	/** Parse the model file. The plugin's types must be registered. */
+	explicit ReflexRegressionHarness(const std::string& modelFile);
+	~ReflexRegressionHarness();
+
+	//--------------------------------------------------------------------------
+	// CONFIGURATION
+	//--------------------------------------------------------------------------
+	/** Simulated duration of each landing (seconds). */
+	void setDuration(double duration) { _duration = duration; }
+	/** Interval (seconds) at which the trajectory is recorded. */
+	void setReportingInterval(double interval) { _reportingInterval = interval; }
+	void setIntegratorAccuracy(double accuracy) { _accuracy = accuracy; }
+	/** Largest deviation from the golden controls and coordinates. */
+	void setTolerances(double controls, double coordinates)
+	{	_controlTolerance = controls; _coordinateTolerance = coordinates; }
+	/** Evaluations timed per recorded state. */
+	void setTimingRepeats(int repeats) { _timingRepeats = repeats; }
+	void setBudget(const std::string& controller, const Budget& budget)
+	{	_budgets[controller] = budget; }
+	/** Function returning the number of heap allocations made so far by the
+	 * process, or NULL (the default) to leave allocations unmeasured. */
+	void setAllocationCounter(long long (*counter)())
+	{	_allocationCounter = counter; }
+
+	/** Names of the reflex controllers exercised, in model order. */
+	std::vector<std::string> getControllerNames() const;
+
+	//--------------------------------------------------------------------------
+	// EXECUTION
+	//--------------------------------------------------------------------------
+	/** Land with only the named reflex controller enabled, recording the
+	 * trajectory into trajectory. */
+	Measurement run(const std::string& controller, Storage& trajectory);
+
+	/** Record golden trajectories of every reflex controller in directory.
+	 * @return the measurements of the recorded runs */
+	std::vector<Measurement> writeGolden(const std::string& directory);
+
+	/** Run every reflex controller, compare with the golden trajectories in
+	 * directory and check the budgets, reporting each run to report.
+	 * @return true if every run is within tolerances and budgets */
+	bool check(const std::string& directory, std::ostream& report);
+
+	/** Path of a controller's golden trajectory in directory. */
+	static std::string getGoldenFileName(const std::string& directory,
+		const std::string& controller);
+
+private:
+	// land with the model's controllers enabled as they are
+	Measurement measure(const std::string& controller, Storage& trajectory);
+
+	// largest deviation of each kind of column from the golden trajectory
+	void compare(const Storage& trajectory, const Storage& golden,
+		Measurement& measurement) const;
+
+	std::unique_ptr<Model> _model;
+
+	double _duration;
+	double _reportingInterval;
+	double _accuracy;
+	double _controlTolerance;
+	double _coordinateTolerance;
+	int _timingRepeats;
+	std::map<std::string, Budget> _budgets;
+	long long (*_allocationCounter)();
+
+};	// END of class ReflexRegressionHarness
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexRegressionHarness_H_
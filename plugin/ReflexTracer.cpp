@@ -0,0 +1,318 @@
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  ReflexTracer.cpp                           *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexTracer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+using namespace OpenSim;
+using namespace std;
+
+namespace {
+	// default number of events kept per thread before further events are
+	// dropped (about 24 MB)
+	const size_t DefaultMaxEventsPerThread = 250000;
+	const size_t MaxNameLength = 63;
+
+	struct TraceEvent {
+		char phase;				// 'B', 'E', 'i' or 'C'
+		const char* category;	// static string
+		char name[MaxNameLength+1];
+		double timestamp;		// microseconds since the tracer started
+		double value;			// simulated time or counter value, < 0 if none
+	};
+
+	const size_t EventsPerChunk = 1024;
+
+	// a block of one thread's events. The thread fills the events in order
+	// and then publishes each by advancing published, so the writer reads
+	// the first `published` events without a lock.
+	struct EventChunk {
+		EventChunk() : published(0), next(NULL) {}
+		TraceEvent events[EventsPerChunk];
+		atomic<size_t> published;
+		atomic<EventChunk*> next;	// set once this chunk is full
+	};
+
+	// events of one thread, a list of chunks appended to only by that thread
+	struct ThreadBuffer {
+		explicit ThreadBuffer(int thread) :
+			thread(thread), tail(&head), count(0), dropped(0) {}
+		~ThreadBuffer()
+		{
+			EventChunk* chunk = head.next.load();
+			while(chunk){
+				EventChunk* next = chunk->next.load();
+				delete chunk;
+				chunk = next;
+			}
+		}
+
+		int thread;
+		EventChunk head;
+		EventChunk* tail;			// chunk being filled (owning thread only)
+		size_t count;				// events kept (owning thread only)
+		atomic<size_t> dropped;
+	};
+
+	typedef chrono::steady_clock Clock;
+
+	struct TracerState {
+		TracerState() : enabled(false), start(Clock::now()),
+			maxEventsPerThread(DefaultMaxEventsPerThread)
+		{
+			const char* file = getenv("REFLEX_TRACE");
+			if(file && *file){
+				fileName = file;
+				enabled = true;
+			}
+			const char* maxEvents = getenv("REFLEX_TRACE_MAX_EVENTS");
+			if(maxEvents && *maxEvents)
+				maxEventsPerThread = (size_t)strtoull(maxEvents, NULL, 10);
+		}
+		// the trace is written when the program exits
+		~TracerState()
+		{
+			if(!fileName.empty())
+				writeFile();
+		}
+
+		void writeFile();
+
+		atomic<bool> enabled;
+		Clock::time_point start;
+		string fileName;
+		atomic<size_t> maxEventsPerThread;
+
+		// buffers of every thread that recorded an event, and the file name;
+		// held only to register a thread or to look at the list
+		mutex buffersMutex;
+		vector<unique_ptr<ThreadBuffer> > buffers;
+		// one write of the file at a time
+		mutex writeMutex;
+	};
+
+	TracerState& tracer()
+	{
+		static TracerState state;
+		return state;
+	}
+
+	// the calling thread's buffer, registered on its first event
+	ThreadBuffer& threadBuffer()
+	{
+		static thread_local ThreadBuffer* buffer = NULL;
+		if(!buffer){
+			TracerState& state = tracer();
+			lock_guard<mutex> lock(state.buffersMutex);
+			state.buffers.push_back(unique_ptr<ThreadBuffer>(
+				new ThreadBuffer((int)state.buffers.size() + 1)));
+			buffer = state.buffers.back().get();
+		}
+		return *buffer;
+	}
+
+	void record(char phase, const char* category, const string& name, double value)
+	{
+		ThreadBuffer& buffer = threadBuffer();
+		if(buffer.count >= tracer().maxEventsPerThread.load(memory_order_relaxed)){
+			buffer.dropped.fetch_add(1, memory_order_relaxed);
+			return;
+		}
+
+		EventChunk* chunk = buffer.tail;
+		size_t index = chunk->published.load(memory_order_relaxed);
+		if(index == EventsPerChunk){
+			EventChunk* next = new EventChunk();
+			chunk->next.store(next, memory_order_release);
+			buffer.tail = chunk = next;
+			index = 0;
+		}
+
+		TraceEvent& event = chunk->events[index];
+		event.phase = phase;
+		event.category = category;
+		size_t n = min(name.size(), MaxNameLength);
+		memcpy(event.name, name.data(), n);
+		event.name[n] = '\0';
+		event.timestamp = chrono::duration<double, micro>(Clock::now() - tracer().start).count();
+		event.value = value;
+		++buffer.count;
+		// the writer may read the event once it sees the new count
+		chunk->published.store(index + 1, memory_order_release);
+	}
+
+	void writeJsonString(ostream& out, const char* text)
+	{
+		out << '"';
+		for(const char* c = text; *c; ++c){
+			if(*c == '"' || *c == '\\')
+				out << '\\' << *c;
+			else if((unsigned char)*c < 0x20)
+				out << ' ';
+			else
+				out << *c;
+		}
+		out << '"';
+	}
+
+	void writeEvent(ostream& out, const TraceEvent& event, int thread)
+	{
+		out << "{\"name\":";
+		writeJsonString(out, event.name);
+		out << ",\"cat\":";
+		writeJsonString(out, event.category);
+		out << ",\"ph\":\"" << event.phase << "\",\"ts\":" << event.timestamp
+			<< ",\"pid\":1,\"tid\":" << thread;
+		if(event.phase == 'C')
+			out << ",\"args\":{\"value\":" << event.value << "}";
+		else if(event.value >= 0)
+			out << ",\"args\":{\"sim_time\":" << event.value << "}";
+		if(event.phase == 'i')
+			out << ",\"s\":\"t\"";
+		out << "}";
+	}
+
+	void TracerState::writeFile()
+	{
+		lock_guard<mutex> writeLock(writeMutex);
+
+		// the buffers are never removed, so recording threads only wait on
+		// the list while it is copied, not while the file is written
+		string file;
+		vector<ThreadBuffer*> threads;
+		{
+			lock_guard<mutex> lock(buffersMutex);
+			file = fileName;
+			for(size_t b=0; b<buffers.size(); ++b)
+				threads.push_back(buffers[b].get());
+		}
+		if(file.empty())
+			return;
+		ofstream out(file.c_str());
+		if(!out.good()){
+			cout << "WARNING - ReflexTracer could not write " << file << endl;
+			return;
+		}
+
+		out << setprecision(15) << "{\"traceEvents\":[\n";
+		bool first = true;
+		for(size_t b=0; b<threads.size(); ++b){
+			const ThreadBuffer& buffer = *threads[b];
+			size_t dropped = buffer.dropped.load(memory_order_relaxed);
+
+			// every event the thread has published by now
+			for(const EventChunk* chunk = &buffer.head; chunk;
+				chunk = chunk->next.load(memory_order_acquire)){
+				size_t numEvents = chunk->published.load(memory_order_acquire);
+				for(size_t e=0; e<numEvents; ++e){
+					out << (first ? "" : ",\n");
+					first = false;
+					writeEvent(out, chunk->events[e], buffer.thread);
+				}
+			}
+			if(dropped)
+				cout << "WARNING - ReflexTracer dropped " << dropped
+					<< " events of thread " << buffer.thread << endl;
+		}
+		out << "\n]}\n";
+	}
+}
+
+
+//=============================================================================
+// CONTROL
+//=============================================================================
+void ReflexTracer::enable(const string& fileName)
+{
+	TracerState& state = tracer();
+	{
+		lock_guard<mutex> lock(state.buffersMutex);
+		state.fileName = fileName;
+	}
+	state.enabled.store(true, memory_order_release);
+}
+
+void ReflexTracer::disable()
+{
+	tracer().enabled.store(false, memory_order_release);
+}
+
+bool ReflexTracer::isEnabled()
+{
+	return tracer().enabled.load(memory_order_relaxed);
+}
+
+void ReflexTracer::setMaxEventsPerThread(size_t maxEvents)
+{
+	tracer().maxEventsPerThread.store(maxEvents, memory_order_relaxed);
+}
+
+size_t ReflexTracer::getMaxEventsPerThread()
+{
+	return tracer().maxEventsPerThread.load(memory_order_relaxed);
+}
+
+void ReflexTracer::write()
+{
+	tracer().writeFile();
+}
+
+//=============================================================================
+// EVENTS
+//=============================================================================
+void ReflexTracer::begin(const char* category, const string& name, double simTime)
+{
+	record('B', category, name, simTime);
+}
+
+void ReflexTracer::end(const char* category, const string& name)
+{
+	record('E', category, name, -1);
+}
+
+void ReflexTracer::instant(const char* category, const string& name, double simTime)
+{
+	if(isEnabled())
+		record('i', category, name, simTime);
+}
+
+void ReflexTracer::counter(const string& name, double value)
+{
+	if(isEnabled())
+		record('C', "time", name, value);
+}
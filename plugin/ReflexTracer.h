@@ -0,0 +1,130 @@
+#ifndef OPENSIM_ReflexTracer_H_
+#define OPENSIM_ReflexTracer_H_
+/* -------------------------------------------------------------------------- *
+ *                        OpenSim:  ReflexTracer.h                            *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <cstddef>
+#include <string>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+//=============================================================================
+//=============================================================================
+/**
+ * ReflexTracer records a timeline of the plugin's work and writes it as
+ * Chrome trace-event JSON (load it in chrome://tracing or Perfetto).
+ *
+ * Controllers record begin and end events around computeControls() and
+ * connectToModel(), a counter of simulated time at every control request,
+ * and delay lines record their history operations (growth and roll backs).
+ * Lining the simulated-time counter up with the wall-clock timeline shows
+ * where the time goes, e.g. around foot contact.
+ *
+ * Each thread appends to a buffer of its own without taking a lock: a list
+ * of fixed-size chunks whose events the thread publishes through an atomic
+ * count. The buffers are merged when the file is written, by write() or
+ * when the program exits; the writer reads the events published so far, so
+ * write() may be called while other threads are still recording, and the
+ * file is written without holding up threads that start recording. A
+ * thread keeps at most getMaxEventsPerThread() events (default 250000,
+ * about 24 MB) and drops the rest; set the limit with
+ * setMaxEventsPerThread() or the environment variable
+ * REFLEX_TRACE_MAX_EVENTS.
+ *
+ * Tracing is off unless enabled by enable() or by setting the environment
+ * variable REFLEX_TRACE to the output file name. When off, each trace point
+ * costs a single flag test.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API ReflexTracer {
+
+public:
+	/** Start recording, to be written to fileName. */
+	static void enable(const std::string& fileName);
+	/** Stop recording. Events recorded so far are kept. */
+	static void disable();
+	static bool isEnabled();
+
+	/** Events kept per thread before further events are dropped. */
+	static void setMaxEventsPerThread(size_t maxEvents);
+	static size_t getMaxEventsPerThread();
+
+	/** Begin and end a span on the calling thread. simTime, if given, is
+	 * attached to the begin event. */
+	static void begin(const char* category, const std::string& name,
+		double simTime = -1);
+	static void end(const char* category, const std::string& name);
+	/** A point event. */
+	static void instant(const char* category, const std::string& name,
+		double simTime = -1);
+	/** A sample of a counter track. */
+	static void counter(const std::string& name, double value);
+
+	/** Write every event recorded so far to the trace file. Safe to call
+	 * while other threads record. */
+	static void write();
+};
+
+//=============================================================================
+/**
+ * ReflexTraceScope records a span for the lifetime of the scope, if tracing
+ * was enabled when the scope began. The name is held by reference and must
+ * outlive the scope.
+ */
+class OSIMREFLEXES_API ReflexTraceScope {
+public:
+	ReflexTraceScope(const char* category, const std::string& name,
+		double simTime = -1) :
+		_category(category), _name(name), _active(ReflexTracer::isEnabled())
+	{
+		if(_active)
+			ReflexTracer::begin(_category, _name, simTime);
+	}
+	~ReflexTraceScope()
+	{
+		if(_active)
+			ReflexTracer::end(_category, _name);
+	}
+
+private:
+	ReflexTraceScope(const ReflexTraceScope&);
+	ReflexTraceScope& operator=(const ReflexTraceScope&);
+
+	const char* _category;
+	const std::string& _name;
+	bool _active;
+};
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexTracer_H_
@@ -29,6 +29,10 @@
 #include "MusclePathStretchController.h"
 #include "MuscleFiberStretchController.h"
 #include "DelayedPathReflexController.h"
+#include "TendonForceReflexController.h"
+#include "SpinalNetworkReflexController.h"
+#include "MuscleSpindleSensor.h"
+#include "FusedReflexController.h"
 
 using namespace OpenSim;
 using namespace std;
@@ -46,6 +50,10 @@ OSIMREFLEXES_API void RegisterTypes_osimReflexesPlugin()
 	Object::RegisterType(MusclePathStretchController());
 	Object::RegisterType(MuscleFiberStretchController());
     Object::RegisterType(DelayedPathReflexController());
+	Object::RegisterType(TendonForceReflexController());
+	Object::RegisterType(SpinalNetworkReflexController());
+	Object::RegisterType(MuscleSpindleSensor());
+	Object::RegisterType(FusedReflexController());
 }
 
 dllObjectInstantiator::dllObjectInstantiator() 
@@ -0,0 +1,470 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  SignalDelayLine.cpp                         *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <OpenSim/Common/Exception.h>
+#include "SignalDelayLine.h"
+#include "ReflexTracer.h"
+
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <mutex>
+
+using namespace OpenSim;
+using namespace std;
+
+namespace {
+	// zero run of a channel that has always been zero, or is not zero now
+	const double AlwaysZero = -numeric_limits<double>::infinity();
+	const double NotZero = numeric_limits<double>::infinity();
+
+	// fewest samples a memory limit leaves a line, and its initial capacity
+	const int MinSamples = 16;
+
+	// lines shared between the controllers of a model, by signal name
+	typedef map<pair<const Model*, string>, weak_ptr<SignalDelayLine> > LineRegistry;
+
+	// names of the traced history operations
+	const string RollbackEvent = "delay_line_rollback";
+	const string GrowEvent = "delay_line_grow";
+	const string DecimateEvent = "delay_line_decimate";
+
+	LineRegistry& sharedLines()
+	{
+		static LineRegistry registry;
+		return registry;
+	}
+
+	mutex& sharedLinesMutex()
+	{
+		static mutex registryMutex;
+		return registryMutex;
+	}
+}
+
+
+// samples of a line, oldest first, with the channel state that goes with them
+class SignalDelayLine::Snapshot {
+public:
+	vector<string> channelNames;
+	vector<double> times;
+	// row-major, one row of channel values per time
+	vector<double> values;
+	vector<double> zeroSince;
+};
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+SignalDelayLine::SignalDelayLine() :
+	_numChannels(0),
+	_maxDelay(0.0),
+	_capacity(0),
+	_head(0),
+	_count(0),
+	_prefixCount(0),
+	_maxSamples(0),
+	_peakBytes(0),
+	_numDecimations(0)
+{
+}
+
+shared_ptr<SignalDelayLine> SignalDelayLine::getShared(const Model& model,
+	const string& signal)
+{
+	lock_guard<mutex> lock(sharedLinesMutex());
+	LineRegistry& registry = sharedLines();
+
+	// forget lines whose controllers have all been destroyed
+	for(LineRegistry::iterator it = registry.begin(); it != registry.end();){
+		if(it->second.expired())
+			registry.erase(it++);
+		else
+			++it;
+	}
+
+	weak_ptr<SignalDelayLine>& entry = registry[make_pair(&model, signal)];
+	shared_ptr<SignalDelayLine> line = entry.lock();
+	if(!line){
+		line.reset(new SignalDelayLine());
+		entry = line;
+	}
+	return line;
+}
+
+//=============================================================================
+// CHANNELS
+//=============================================================================
+int SignalDelayLine::addChannel(const string& name)
+{
+	int index = getChannelIndex(name);
+	if(index >= 0)
+		return index;
+
+	_channelNames.push_back(name);
+	_numChannels = (int)_channelNames.size();
+
+	// the row width changed, so start over
+	_times.clear();
+	_values.clear();
+	_capacity = 0;
+	_head = 0;
+	_count = 0;
+	_prefix.reset();
+	_prefixCount = 0;
+	_zeroSince.assign(_numChannels, AlwaysZero);
+
+	return _numChannels-1;
+}
+
+int SignalDelayLine::getChannelIndex(const string& name) const
+{
+	vector<string>::const_iterator it =
+		find(_channelNames.begin(), _channelNames.end(), name);
+	return it == _channelNames.end() ? -1 : (int)(it - _channelNames.begin());
+}
+
+void SignalDelayLine::requireDelay(double delay)
+{
+	_maxDelay = max(_maxDelay, delay);
+}
+
+void SignalDelayLine::clear()
+{
+	_head = 0;
+	_count = 0;
+	_prefix.reset();
+	_prefixCount = 0;
+	_zeroSince.assign(_numChannels, AlwaysZero);
+}
+
+//=============================================================================
+// MEMORY
+//=============================================================================
+void SignalDelayLine::limitMemory(size_t bytes)
+{
+	// a held sample costs its time and one value per channel
+	size_t rowBytes = (_numChannels + 1)*sizeof(double);
+	int samples = (int)min(bytes/rowBytes, (size_t)numeric_limits<int>::max());
+	if(samples < MinSamples){
+		cout << "WARNING - a memory budget of " << bytes << " bytes is too small "
+			"for a delay line of " << _numChannels << " channels; keeping "
+			<< MinSamples << " samples." << endl;
+		samples = MinSamples;
+	}
+	_maxSamples = _maxSamples > 0 ? min(_maxSamples, samples) : samples;
+}
+
+size_t SignalDelayLine::getMemoryBytes() const
+{
+	size_t bytes = (_times.capacity() + _values.capacity()
+		+ _zeroSince.capacity())*sizeof(double);
+	for(size_t c=0; c<_channelNames.size(); ++c)
+		bytes += sizeof(string) + _channelNames[c].capacity();
+	// a shared prefix counts toward every line sharing it
+	if(_prefix)
+		bytes += (_prefix->times.capacity() + _prefix->values.capacity())*sizeof(double);
+	return bytes;
+}
+
+size_t SignalDelayLine::getChannelMemoryBytes() const
+{
+	if(_numChannels == 0)
+		return 0;
+	// a channel's column of values and its share of the time column
+	return (_values.capacity() + _times.capacity()/_numChannels)*sizeof(double)/_numChannels;
+}
+
+//=============================================================================
+// SAMPLES
+//=============================================================================
+double SignalDelayLine::sampleTime(int i) const
+{
+	return i < _prefixCount ? _prefix->times[i] : _times[row(i - _prefixCount)];
+}
+
+const double* SignalDelayLine::sampleValues(int i) const
+{
+	return i < _prefixCount ? &_prefix->values[(size_t)i*_numChannels]
+		: &_values[(size_t)row(i - _prefixCount)*_numChannels];
+}
+
+double SignalDelayLine::getLatest(int channel) const
+{
+	int n = _prefixCount + _count;
+	if(n == 0)
+		return 0.0;
+	return sampleValues(n-1)[channel];
+}
+
+void SignalDelayLine::write(double time, int channel, double value)
+{
+	int r = beginRow(time);
+	_values[r*_numChannels + channel] = value;
+	if(value != 0)
+		_zeroSince[channel] = NotZero;
+	else if(_zeroSince[channel] == NotZero)
+		_zeroSince[channel] = time;
+}
+
+double SignalDelayLine::read(int channel, double time) const
+{
+	// nothing recorded yet, or the delayed signal precedes our recorded
+	// history: assume the signal is zero
+	int n = _prefixCount + _count;
+	if(n == 0 || time < sampleTime(0))
+		return 0.0;
+
+	if(time >= sampleTime(n-1))
+		return sampleValues(n-1)[channel];
+
+	// bisect for the samples bracketing the requested time, through the
+	// shared prefix and the ring alike
+	int lo = 0, hi = n-1;
+	while(hi - lo > 1){
+		int mid = (lo + hi)/2;
+		if(sampleTime(mid) <= time)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	double t0 = sampleTime(lo), t1 = sampleTime(hi);
+	double v0 = sampleValues(lo)[channel];
+	double v1 = sampleValues(hi)[channel];
+	return v0 + (v1 - v0)*(time - t0)/(t1 - t0);
+}
+
+int SignalDelayLine::beginRow(double time)
+{
+	if(_prefixCount + _count > 0){
+		// the integrator stepped back: forget the abandoned future
+		if(time < sampleTime(_prefixCount + _count - 1)){
+			ReflexTracer::instant("history", RollbackEvent, time);
+			// the shared prefix cannot change, so it becomes our own
+			if(_prefixCount > 0 && time < _prefix->times.back())
+				materialize();
+			while(_count > 0 && _times[row(_count-1)] > time)
+				--_count;
+			// a zero run that began in the abandoned future is unknown
+			for(int c=0; c<_numChannels; ++c)
+				if(_zeroSince[c] > time) _zeroSince[c] = NotZero;
+		}
+		// at the time of the last shared sample, a row of our own follows
+		// and shadows it
+		if(_count > 0 && _times[row(_count-1)] == time)
+			return row(_count-1);
+	}
+
+	trim();
+	if(_count == _capacity){
+		if(_maxSamples > 0 && _capacity >= _maxSamples)
+			decimate();
+		else
+			grow();
+	}
+
+	int r = row(_count);
+	_times[r] = time;
+	if(_count > 0){
+		// channels not written at this time hold their previous value
+		int prev = row(_count-1);
+		copy(_values.begin() + prev*_numChannels,
+			_values.begin() + (prev+1)*_numChannels,
+			_values.begin() + r*_numChannels);
+	}
+	else if(_prefixCount > 0)
+		copy(_prefix->values.end() - _numChannels, _prefix->values.end(),
+			_values.begin() + r*_numChannels);
+	else
+		fill(_values.begin() + r*_numChannels,
+			_values.begin() + (r+1)*_numChannels, 0.0);
+	++_count;
+	return r;
+}
+
+void SignalDelayLine::trim()
+{
+	int n = _prefixCount + _count;
+	if(n < 2)
+		return;
+
+	// Keep one sample at or before the oldest time a consumer can ask for.
+	// An extra window of max delay is kept so that stepping back in time
+	// does not uncover history that was already dropped.
+	double horizon = sampleTime(n-1) - 2*_maxDelay;
+	if(_prefixCount > 0){
+		// the shared prefix goes whole, once the ring reaches back far enough
+		if(_count == 0 || _times[row(0)] > horizon)
+			return;
+		_prefix.reset();
+		_prefixCount = 0;
+	}
+	while(_count > 1 && _times[row(1)] <= horizon){
+		_head = (_head + 1) % _capacity;
+		--_count;
+	}
+}
+
+void SignalDelayLine::linearize()
+{
+	materialize();
+	if(_head == 0)
+		return;
+	rotate(_times.begin(), _times.begin() + _head, _times.end());
+	rotate(_values.begin(), _values.begin() + (size_t)_head*_numChannels, _values.end());
+	_head = 0;
+}
+
+void SignalDelayLine::grow()
+{
+	ReflexTraceScope traceScope("history", GrowEvent);
+	int capacity = max(MinSamples, 2*_capacity);
+	if(_maxSamples > 0)
+		capacity = max(_capacity, min(capacity, _maxSamples));
+	vector<double> times(capacity);
+	vector<double> values(capacity*_numChannels);
+
+	for(int i=0; i<_count; ++i){
+		int r = row(i);
+		times[i] = _times[r];
+		copy(_values.begin() + r*_numChannels,
+			_values.begin() + (r+1)*_numChannels,
+			values.begin() + i*_numChannels);
+	}
+
+	_times.swap(times);
+	_values.swap(values);
+	_capacity = capacity;
+	_head = 0;
+	_peakBytes = max(_peakBytes, getMemoryBytes());
+}
+
+void SignalDelayLine::materialize()
+{
+	if(_prefixCount == 0)
+		return;
+
+	int n = _prefixCount + _count;
+	int capacity = max(MinSamples, max(_capacity, n));
+	vector<double> times(capacity);
+	vector<double> values((size_t)capacity*_numChannels);
+	for(int i=0; i<n; ++i){
+		times[i] = sampleTime(i);
+		const double* row = sampleValues(i);
+		copy(row, row + _numChannels, values.begin() + (size_t)i*_numChannels);
+	}
+
+	_times.swap(times);
+	_values.swap(values);
+	_capacity = capacity;
+	_head = 0;
+	_count = n;
+	_prefix.reset();
+	_prefixCount = 0;
+	_peakBytes = max(_peakBytes, getMemoryBytes());
+}
+
+//=============================================================================
+// SNAPSHOTS
+//=============================================================================
+shared_ptr<const SignalDelayLine::Snapshot> SignalDelayLine::takeSnapshot() const
+{
+	// nothing was added since the line was restored
+	if(_prefix && _count == 0 && _prefix->zeroSince == _zeroSince)
+		return _prefix;
+
+	shared_ptr<Snapshot> snapshot(new Snapshot());
+	int n = _prefixCount + _count;
+	snapshot->channelNames = _channelNames;
+	snapshot->times.resize(n);
+	snapshot->values.resize((size_t)n*_numChannels);
+	for(int i=0; i<n; ++i){
+		snapshot->times[i] = sampleTime(i);
+		const double* row = sampleValues(i);
+		copy(row, row + _numChannels, snapshot->values.begin() + (size_t)i*_numChannels);
+	}
+	snapshot->zeroSince = _zeroSince;
+	return snapshot;
+}
+
+void SignalDelayLine::restore(const shared_ptr<const Snapshot>& snapshot)
+{
+	if(snapshot->channelNames != _channelNames)
+		throw OpenSim::Exception("SignalDelayLine: the snapshot was taken of a "
+			"line with other channels.");
+
+	_head = 0;
+	_count = 0;
+	_prefix = snapshot;
+	_prefixCount = (int)snapshot->times.size();
+	_zeroSince = snapshot->zeroSince;
+	if(_prefixCount == 0)
+		_prefix.reset();
+}
+
+void SignalDelayLine::decimate()
+{
+	ReflexTraceScope traceScope("history", DecimateEvent);
+	if(_numDecimations++ == 0)
+		cout << "WARNING - a delay line of " << _numChannels << " channels reached "
+			"its memory limit of " << _maxSamples << " samples; older history "
+			"is being decimated." << endl;
+
+	linearize();
+
+	// the newest half stays at full rate; every other older sample goes,
+	// keeping the oldest so the history reaches as far back as before
+	int old = _count - _count/2;
+	int kept = 0;
+	for(int i=0; i<_count; ++i){
+		if(i < old && i % 2 == 1)
+			continue;
+		if(kept != i){
+			_times[kept] = _times[i];
+			copy(_values.begin() + i*_numChannels,
+				_values.begin() + (i+1)*_numChannels,
+				_values.begin() + kept*_numChannels);
+		}
+		++kept;
+	}
+	_count = kept;
+
+	// a zero run whose first sample was dropped now reads zero only from
+	// the next held sample on
+	for(int c=0; c<_numChannels; ++c){
+		double& since = _zeroSince[c];
+		if(since == AlwaysZero || since == NotZero)
+			continue;
+		int i = (int)(lower_bound(_times.begin(), _times.begin() + _count, since)
+			- _times.begin());
+		since = i < _count ? _times[i] : NotZero;
+	}
+}
@@ -0,0 +1,206 @@
+#ifndef OPENSIM_SignalDelayLine_H_
+#define OPENSIM_SignalDelayLine_H_
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  SignalDelayLine.h                          *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <memory>
+#include <string>
+#include <vector>
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+
+namespace OpenSim {
+
+class Model;
+
+//=============================================================================
+//=============================================================================
+/**
+ * SignalDelayLine is a multi-channel, multi-tap delay store for sensor
+ * signals. Each channel (typically one muscle) is written at each sample
+ * time and can be read back at any number of delays by any number of
+ * consumers. Writing a channel again at the time of its latest sample
+ * replaces the value: integrators evaluate several states at the same time
+ * (e.g. Runge-Kutta stages), and the latest state sensed is the one kept.
+ *
+ * All channels share one time column, and samples are kept in a single
+ * contiguous ring buffer (one row of channel values per sample time). Only
+ * the window needed by the longest registered delay is retained, so memory
+ * does not grow with simulation length.
+ *
+ * A line can be limited to a memory budget. Once the ring reaches the
+ * budget, instead of growing, the older half of the held samples is
+ * decimated by two, so long delays are served from a coarser history
+ * rather than memory growing without bound.
+ *
+ * Sample times normally increase. When the integrator steps back in time
+ * (e.g. a rejected trial step), writing at an earlier time discards every
+ * sample recorded after it, so the line always reflects a single, monotonic
+ * history. Reading between samples interpolates linearly; reading before the
+ * first sample returns zero.
+ *
+ * A line's history can be captured in an immutable Snapshot and restored
+ * into lines of other copies of the model, e.g. to branch several
+ * simulations from one state. A restored line shares the snapshot's samples
+ * as a read-only prefix instead of copying them; new samples go to the
+ * line's own ring, and the prefix is copied only if the integrator steps
+ * back into it. The prefix is released once no delay reaches it.
+ *
+ * Controllers of the same model share a line for a given signal through
+ * getShared(), so several delayed controllers on the same muscles store each
+ * signal only once.
+ *
+ * @author  Matt DeMers
+ */
+class OSIMREFLEXES_API SignalDelayLine {
+
+public:
+	SignalDelayLine();
+
+	/** Add a channel, or find it if a channel of that name already exists.
+	 * Adding a new channel discards any recorded samples.
+	 * @return the index of the channel
+	 */
+	int addChannel(const std::string& name);
+	/** Index of the named channel, or -1 if there is none. */
+	int getChannelIndex(const std::string& name) const;
+	int getNumChannels() const { return _numChannels; }
+
+	/** Register a consumer that reads the line at the given delay. The line
+	 * retains enough history for the longest registered delay. */
+	void requireDelay(double delay);
+	double getMaxDelay() const { return _maxDelay; }
+
+	/** Discard all recorded samples. Channels and delays are kept. */
+	void clear();
+
+	/** Limit the memory held by the samples to about the given number of
+	 * bytes (the tightest limit of all consumers applies). */
+	void limitMemory(size_t bytes);
+	/** Most samples the line may hold, 0 if unlimited. */
+	int getMaxSamples() const { return _maxSamples; }
+	/** Bytes currently held by the line. */
+	size_t getMemoryBytes() const;
+	/** Largest getMemoryBytes() since the line was created. */
+	size_t getPeakMemoryBytes() const { return _peakBytes; }
+	/** Bytes held per channel by the sample buffers. */
+	size_t getChannelMemoryBytes() const;
+	/** Number of times old history was decimated to respect the limit. */
+	int getNumDecimations() const { return _numDecimations; }
+
+	/** Most recent value written to the channel (zero if none). */
+	double getLatest(int channel) const;
+
+	/** Record the value of a channel at the given time, replacing any value
+	 * already written at that time. */
+	void write(double time, int channel, double value);
+	/** Value of a channel at the given (delayed) time. */
+	double read(int channel, double time) const;
+	/** True if the channel has held zero from before the given time on,
+	 * so that reading it there (or later) is known to give zero without
+	 * searching the history. */
+	bool isZeroFrom(int channel, double time) const
+	{	return time >= _zeroSince[channel]; }
+
+	/** Number of sample times currently held. */
+	int getNumSamples() const { return _prefixCount + _count; }
+	const std::string& getChannelName(int channel) const
+	{	return _channelNames[channel]; }
+
+	/** Immutable copy of the samples of a line. */
+	class Snapshot;
+	/** Capture the line's channels and samples. */
+	std::shared_ptr<const Snapshot> takeSnapshot() const;
+	/** Replace the samples with those of a snapshot of a line with the same
+	 * channels, sharing them until they must change. */
+	void restore(const std::shared_ptr<const Snapshot>& snapshot);
+
+	/** Move the held samples to the front of the buffer, oldest first.
+	 * getTimesData() and getValuesData() then view the history in time
+	 * order (getNumSamples() rows of getNumChannels() values) without
+	 * copying, until the line is next written. */
+	void linearize();
+	const double* getTimesData() const
+	{	return _times.empty() ? NULL : &_times[0]; }
+	const double* getValuesData() const
+	{	return _values.empty() ? NULL : &_values[0]; }
+
+	/** Get the line for the named signal that is shared by all controllers
+	 * of the model. The line lives as long as any controller holds it. */
+	static std::shared_ptr<SignalDelayLine> getShared(const Model& model,
+		const std::string& signal);
+
+private:
+	// physical row of the i-th oldest sample
+	int row(int i) const { return (_head + i) % _capacity; }
+	// row holding the given time, appended (or rolled back to) as needed
+	int beginRow(double time);
+	// double the capacity (up to the limit), unrolling the ring
+	void grow();
+	// halve the sampling of the older half of the history
+	void decimate();
+	// drop samples no longer reachable by the longest delay
+	void trim();
+	// copy the shared prefix into the ring, ahead of the own samples
+	void materialize();
+	// time and row of channel values of the i-th oldest sample, prefix
+	// included
+	double sampleTime(int i) const;
+	const double* sampleValues(int i) const;
+
+	std::vector<std::string> _channelNames;
+	int _numChannels;
+	double _maxDelay;
+
+	// ring buffer of sample times and row-major channel values
+	std::vector<double> _times;
+	std::vector<double> _values;
+	int _capacity;
+	int _head;
+	int _count;
+
+	// samples shared with a snapshot, older than those of the ring
+	std::shared_ptr<const Snapshot> _prefix;
+	int _prefixCount;
+
+	// time from which each channel has been zero: -infinity if it never
+	// held anything else, +infinity if it is not (known to be) zero now
+	std::vector<double> _zeroSince;
+
+	// memory limit (0 if none), peak usage and decimations
+	int _maxSamples;
+	size_t _peakBytes;
+	int _numDecimations;
+
+};	// END of class SignalDelayLine
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_SignalDelayLine_H_
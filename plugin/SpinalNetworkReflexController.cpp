@@ -0,0 +1,340 @@
+/* -------------------------------------------------------------------------- *
+ *                  OpenSim:  SpinalNetworkReflexController.cpp               *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "SpinalNetworkReflexController.h"
+
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// one connection of the network, as read from a coupling file
+	struct Connection {
+		int target;
+		int source;
+		double weight;
+		double delay;
+	};
+
+	bool targetOrder(const Connection& a, const Connection& b)
+	{
+		return a.target < b.target;
+	}
+}
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+//_____________________________________________________________________________
+/* Default constructor. */
+SpinalNetworkReflexController::SpinalNetworkReflexController() :
+	_sensorType(PathVelocity),
+	_weightScale(1.0)
+{
+	constructProperties();
+}
+
+
+/*
+ * Construct Properties
+ */
+void SpinalNetworkReflexController::constructProperties()
+{
+	constructProperty_sensor("path_velocity");
+	constructProperty_coupling_file("");
+	constructProperty_row_offsets();
+	constructProperty_column_indices();
+	constructProperty_weights();
+	constructProperty_connection_delays();
+}
+
+void SpinalNetworkReflexController::connectToModel(Model &model)
+{
+	Super::connectToModel(model);
+
+	// get the list of muscles assigned to the reflex controller
+	const Set<Actuator>& actuators = getActuatorSet();
+
+	string signal;
+	if(get_sensor() == "path_velocity"){
+		_sensorType = PathVelocity;
+		signal = "path_stretch_velocity";
+	}
+	else if(get_sensor() == "fiber_velocity"){
+		_sensorType = FiberVelocity;
+		signal = "fiber_stretch_velocity";
+	}
+	else if(get_sensor() == "fiber_length"){
+		_sensorType = FiberLength;
+		signal = "fiber_stretch_length";
+	}
+	else
+		throw Exception("SpinalNetworkReflexController: unknown sensor '"
+			+ get_sensor() + "'.");
+
+	if(get_coupling_file().empty())
+		loadCouplingsFromProperties();
+	else
+		loadCouplingsFromFile(get_coupling_file());
+
+	int nm = actuators.getSize();
+	_sensors.assign(nm, 0.0);
+	_sensorLine = SignalDelayLine::getShared(model, signal);
+	_channels.clear();
+	for(int i=0; i<nm; ++i)
+		_channels.push_back(_sensorLine->addChannel(actuators[i].getName()));
+	for(size_t k=0; k<_delays.size(); ++k)
+		_sensorLine->requireDelay(_delays[k]);
+}
+
+void SpinalNetworkReflexController::loadCouplingsFromProperties()
+{
+	int nm = getActuatorSet().getSize();
+	int nnz = getProperty_weights().size();
+
+	_rowOffsets.clear();
+	_columnIndices.clear();
+	_weights.clear();
+	_delays.clear();
+
+	if(getProperty_row_offsets().size() == 0 && nnz == 0){
+		// no couplings
+		_rowOffsets.assign(nm+1, 0);
+		return;
+	}
+
+	if(getProperty_row_offsets().size() != nm+1)
+		throw Exception("SpinalNetworkReflexController: row_offsets must have "
+			"one more entry than the number of controlled muscles.");
+	if(getProperty_column_indices().size() != nnz)
+		throw Exception("SpinalNetworkReflexController: column_indices and "
+			"weights must be the same size.");
+	if(getProperty_connection_delays().size() != 0
+		&& getProperty_connection_delays().size() != nnz)
+		throw Exception("SpinalNetworkReflexController: connection_delays must "
+			"be empty or the same size as weights.");
+
+	for(int i=0; i<=nm; ++i){
+		int offset = get_row_offsets(i);
+		if(offset < 0 || offset > nnz || (i > 0 && offset < _rowOffsets.back()))
+			throw Exception("SpinalNetworkReflexController: row_offsets must be "
+				"non-decreasing and within the number of connections.");
+		_rowOffsets.push_back(offset);
+	}
+	if(_rowOffsets.front() != 0 || _rowOffsets.back() != nnz)
+		throw Exception("SpinalNetworkReflexController: row_offsets must start "
+			"at 0 and end at the number of connections.");
+
+	for(int k=0; k<nnz; ++k){
+		int col = get_column_indices(k);
+		if(col < 0 || col >= nm)
+			throw Exception("SpinalNetworkReflexController: column index out of "
+				"range of the controlled muscles.");
+		_columnIndices.push_back(col);
+		_weights.push_back(get_weights(k));
+		_delays.push_back(getProperty_connection_delays().size() ?
+			get_connection_delays(k) : 0.0);
+	}
+}
+
+void SpinalNetworkReflexController::loadCouplingsFromFile(const string& fileName)
+{
+	const Set<Actuator>& actuators = getActuatorSet();
+	int nm = actuators.getSize();
+
+	ifstream in(fileName.c_str());
+	if(!in.good())
+		throw Exception("SpinalNetworkReflexController: could not open coupling "
+			"file " + fileName + ".");
+
+	vector<Connection> connections;
+	string line;
+	int lineNumber = 0;
+	while(getline(in, line)){
+		++lineNumber;
+		size_t first = line.find_first_not_of(" \t\r");
+		if(first == string::npos || line[first] == '#')
+			continue;
+
+		istringstream fields(line);
+		string target, source;
+		Connection c;
+		c.delay = 0.0;
+		if(!(fields >> target >> source >> c.weight)){
+			ostringstream msg;
+			msg << "SpinalNetworkReflexController: malformed connection in "
+				<< fileName << " line " << lineNumber << ".";
+			throw Exception(msg.str());
+		}
+		fields >> c.delay;
+
+		c.target = actuators.getIndex(target);
+		c.source = actuators.getIndex(source);
+		if(c.target < 0 || c.source < 0){
+			ostringstream msg;
+			msg << "SpinalNetworkReflexController: " << fileName << " line "
+				<< lineNumber << " names a muscle that is not controlled by "
+				<< getName() << ".";
+			throw Exception(msg.str());
+		}
+		connections.push_back(c);
+	}
+
+	// group connections by target muscle, keeping file order within a row
+	stable_sort(connections.begin(), connections.end(), targetOrder);
+
+	_rowOffsets.assign(nm+1, 0);
+	_columnIndices.resize(connections.size());
+	_weights.resize(connections.size());
+	_delays.resize(connections.size());
+	for(size_t k=0; k<connections.size(); ++k){
+		_rowOffsets[connections[k].target+1]++;
+		_columnIndices[k] = connections[k].source;
+		_weights[k] = connections[k].weight;
+		_delays[k] = connections[k].delay;
+	}
+	for(int i=0; i<nm; ++i)
+		_rowOffsets[i+1] += _rowOffsets[i];
+}
+
+//=============================================================================
+// COMPUTATIONS
+//=============================================================================
+double SpinalNetworkReflexController::computeSensorSignal(const State& s,
+	const Muscle& musc) const
+{
+	double f_o = musc.getOptimalFiberLength();
+	double value = 0;
+
+	switch(_sensorType){
+	case PathVelocity:
+		value = musc.getLengtheningSpeed(s)/(f_o*musc.getMaxContractionVelocity());
+		break;
+	case FiberVelocity:
+		value = musc.getFiberVelocity(s)/(f_o*musc.getMaxContractionVelocity());
+		break;
+	case FiberLength:
+		value = (musc.getFiberLength(s) - f_o)/f_o;
+		break;
+	}
+	// only positive stretch produces a signal
+	return 0.5*(fabs(value) + value);
+}
+
+void SpinalNetworkReflexController::getSensedMuscles(int index,
+	vector<int>& muscles) const
+{
+	// delayed connections read the history, not the present sensors
+	for(int k=_rowOffsets[index]; k<_rowOffsets[index+1]; ++k)
+		if(_delays[k] <= 0)
+			muscles.push_back(_columnIndices[k]);
+}
+
+size_t SpinalNetworkReflexController::getInternalStateBytes() const
+{
+	return Super::getInternalStateBytes()
+		+ (_rowOffsets.capacity() + _columnIndices.capacity()
+			+ _channels.capacity())*sizeof(int)
+		+ (_weights.capacity() + _delays.capacity() + _sensors.capacity())*sizeof(double);
+}
+
+//_____________________________________________________________________________
+/**
+ * Compute the controls for muscles under influence of this reflex controller
+ *
+ * @param s				current state of the system
+ * @param muscleControls	reflex control of each muscle
+ */
+void SpinalNetworkReflexController::computeMuscleControls(const State& s, Vector &muscleControls) const
+{
+	// get time
+	double time = s.getTime();
+
+	int nm = getActuatorSet().getSize();
+
+	const SignalDelayLine& line = *_sensorLine;
+
+	// gather: the sensor signal of every muscle is read exactly once
+	senseMuscles(s);
+
+	// scheduled gain
+	double scale = _weightScale*getGainScale(s);
+
+	//reflex control
+	double control = 0;
+
+	// sparse matrix-vector product
+	for(int i=0; i<nm; ++i){
+		control = 0;
+		for(int k=_rowOffsets[i]; k<_rowOffsets[i+1]; ++k){
+			int j = _columnIndices[k];
+			if(_delays[k] > 0){
+				// quiet afferents contribute nothing without a lookup
+				if(!line.isZeroFrom(_channels[j], time - _delays[k]))
+					control += _weights[k]*line.read(_channels[j], time - _delays[k]);
+			}
+			else
+				control += _weights[k]*_sensors[j];
+		}
+		// net drive onto the muscle cannot be negative
+		control = 0.5*(fabs(control) + control);
+
+		muscleControls[i] = scale*control;
+	}
+}
+
+void SpinalNetworkReflexController::recordHistory(const State& s) const
+{
+	senseMuscles(s);
+}
+
+void SpinalNetworkReflexController::senseMuscles(const State& s) const
+{
+	double time = s.getTime();
+	const Set<Actuator>& actuators = getActuatorSet();
+	SignalDelayLine& line = *_sensorLine;
+
+	// sense every muscle, even if another controller or an earlier stage
+	// wrote this time: the state may differ
+	for(int j=0; j<actuators.getSize(); ++j){
+		const Muscle *musc = static_cast<const Muscle*>(&actuators[j]);
+		_sensors[j] = computeSensorSignal(s, *musc);
+		line.write(time, _channels[j], _sensors[j]);
+	}
+}
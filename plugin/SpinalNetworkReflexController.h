@@ -0,0 +1,192 @@
+#ifndef OPENSIM_SpinalNetworkReflexController_H_
+#define OPENSIM_SpinalNetworkReflexController_H_
+/* -------------------------------------------------------------------------- *
+ *                   OpenSim:  SpinalNetworkReflexController.h                *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+#include "MuscleReflexController.h"
+#include "SignalDelayLine.h"
+
+namespace OpenSim {
+
+class Muscle;
+
+//=============================================================================
+//=============================================================================
+/**
+ * SpinalNetworkReflexController excites muscles in response to the stretch
+ * of other muscles, as in heteronymous excitation or reciprocal inhibition.
+ *
+ * The controlled muscles (actuator_list) are both the sources and the
+ * targets of the network. The couplings are a sparse matrix W in compressed
+ * sparse row (CSR) form, where row i holds the connections onto target muscle
+ * i and each column index names a source muscle. Each call, the sensor signal
+ * of every muscle is gathered into a vector x and the controls are
+ *
+ *     u_i = max(0, sum_k W_ik * x_k(t - d_ik))
+ *
+ * where d_ik is the per-connection delay. Negative weights are inhibitory;
+ * the net drive onto a muscle is rectified. Sensor signals are kept in a
+ * SignalDelayLine shared with the other controllers of the model, so each
+ * source is stored once and read at every delay its connections need.
+ *
+ * The couplings are given either directly as the CSR properties
+ * (row_offsets, column_indices, weights and optionally connection_delays),
+ * whose row and column indices refer to the controlled muscles in the order
+ * they appear in the actuator list, or in a side file named by coupling_file.
+ * The side file holds one connection per line as
+ * "target_muscle source_muscle weight [delay]"; blank lines and lines
+ * starting with '#' are ignored. When coupling_file is set it takes
+ * precedence over the CSR properties.
+ *
+ * The sensor signal is selected by the sensor property:
+ *  - "path_velocity":  positive muscle-tendon lengthening speed, normalized
+ *                      by the maximum contraction velocity.
+ *  - "fiber_velocity": positive fiber lengthening speed, normalized by the
+ *                      maximum contraction velocity.
+ *  - "fiber_length":   positive fiber stretch beyond the optimal fiber
+ *                      length, normalized by optimal fiber length.
+ *
+ * @author  Matt DeMers
+ * @version 1.0
+ */
+class OSIMREFLEXES_API SpinalNetworkReflexController : public MuscleReflexController {
+OpenSim_DECLARE_CONCRETE_OBJECT(SpinalNetworkReflexController, MuscleReflexController);
+
+public:
+//=============================================================================
+// PROPERTIES
+//=============================================================================
+    /** @name Property declarations
+    These are the serializable properties associated with a SpinalNetworkReflexController.*/
+    /**@{**/
+	OpenSim_DECLARE_PROPERTY(sensor, std::string,
+		"Sensor signal driving the network: path_velocity, fiber_velocity "
+		"or fiber_length.");
+	OpenSim_DECLARE_PROPERTY(coupling_file, std::string,
+		"Optional file of connections, one 'target source weight [delay]' per "
+		"line. Overrides the CSR properties when set.");
+	OpenSim_DECLARE_LIST_PROPERTY(row_offsets, int,
+		"CSR row offsets, one more than the number of controlled muscles.");
+	OpenSim_DECLARE_LIST_PROPERTY(column_indices, int,
+		"CSR column (source muscle) index of each connection.");
+	OpenSim_DECLARE_LIST_PROPERTY(weights, double,
+		"CSR weight of each connection.");
+	OpenSim_DECLARE_LIST_PROPERTY(connection_delays, double,
+		"Delay (seconds) of each connection. Empty for no delays.");
+
+//=============================================================================
+// METHODS
+//=============================================================================
+	//--------------------------------------------------------------------------
+	// CONSTRUCTION AND DESTRUCTION
+	//--------------------------------------------------------------------------
+	/** Default constructor. */
+	SpinalNetworkReflexController();
+	// Uses default (compiler-generated) destructor, copy constructor and copy
+    // assignment operator.
+
+	/** Compute the controls for muscles
+	 *  This method defines the behavior for SpinalNetworkReflexController controller
+	 *
+	 * @param s					system state
+	 * @param muscleControls	reflex control of each muscle
+	 */
+	void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector &muscleControls) const OVERRIDE_11;
+
+	/** Sensor signals pass through the shared delay line. */
+	bool dependsOnHistory() const OVERRIDE_11 { return true; }
+
+	/** Fiber sensors read the fiber states. */
+	bool dependsOnAuxiliaryStates() const OVERRIDE_11
+	{	return get_sensor() != "path_velocity"; }
+
+	/** Record the sensor signals in the shared delay line only. */
+	void recordHistory(const SimTK::State& s) const OVERRIDE_11;
+
+	/** The sources of the muscle's undelayed connections. */
+	void getSensedMuscles(int index, std::vector<int>& muscles) const OVERRIDE_11;
+
+	/** The shared sensor line. */
+	SignalDelayLine* getSensorHistory() const OVERRIDE_11 { return _sensorLine.get(); }
+
+	/** Number of connections in the network, once connected to the model. */
+	int getNumConnections() const { return (int)_weights.size(); }
+
+	/** Scale applied to every weight, e.g. by a campaign scaling the reflex
+	 *  gains. Unlike the weights property it takes effect immediately. */
+	void setWeightScale(double scale) { _weightScale = scale; }
+	double getWeightScale() const { return _weightScale; }
+
+private:
+	// Connect properties to local pointers.  */
+	void constructProperties();
+	// ModelComponent interface to connect this component to its model
+	void connectToModel(Model& aModel);
+	// network matrix and per-muscle buffers
+	size_t getInternalStateBytes() const OVERRIDE_11;
+	// sense every muscle into _sensors, recording new samples in the line
+	void senseMuscles(const SimTK::State& s) const;
+
+	// build the CSR arrays from the properties or the coupling file
+	void loadCouplingsFromProperties();
+	void loadCouplingsFromFile(const std::string& fileName);
+	// sensor signal for one muscle
+	double computeSensorSignal(const SimTK::State& s, const Muscle& musc) const;
+
+	//=============================================================================
+	// Private Members
+	//=============================================================================
+	enum SensorType { PathVelocity, FiberVelocity, FiberLength };
+	SensorType _sensorType;
+
+	// CSR couplings
+	std::vector<int> _rowOffsets;
+	std::vector<int> _columnIndices;
+	std::vector<double> _weights;
+	std::vector<double> _delays;
+	double _weightScale;
+
+	// gathered sensor vector, reused between calls
+	mutable std::vector<double> _sensors;
+	// sensor history shared with other controllers, and each muscle's channel
+	std::shared_ptr<SignalDelayLine> _sensorLine;
+	std::vector<int> _channels;
+
+	//=============================================================================
+};	// END of class SpinalNetworkReflexController
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_SpinalNetworkReflexController_H_
+
+
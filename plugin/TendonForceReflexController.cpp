@@ -0,0 +1,202 @@
+/* -------------------------------------------------------------------------- *
+ *                   OpenSim:  TendonForceReflexController.cpp                *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+
+// This line includes a large number of OpenSim functions and classes so that
+// those things will be available to this program.
+#include <OpenSim/OpenSim.h>
+#include "TendonForceReflexController.h"
+
+// This allows us to use OpenSim functions, classes, etc., without having to
+// prefix the names of those things with "OpenSim::".
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+
+//=============================================================================
+// CONSTRUCTOR(S) AND DESTRUCTOR
+//=============================================================================
+//_____________________________________________________________________________
+/* Default constructor. */
+TendonForceReflexController::TendonForceReflexController()
+{
+	constructProperties();
+}
+
+/* Convenience constructor. */
+TendonForceReflexController::TendonForceReflexController(double gain,
+	double delay, double threshold)
+{
+	constructProperties();
+	set_gain(gain);
+	set_delay(delay);
+	set_normalized_force_threshold(threshold);
+}
+
+
+/*
+ * Construct Properties
+ */
+void TendonForceReflexController::constructProperties()
+{
+	constructProperty_gain(1.0);
+	constructProperty_delay(0.0);
+	constructProperty_normalized_force_threshold(0.0);
+	constructProperty_sensor_time_constant(0.005);
+}
+
+void TendonForceReflexController::connectToModel(Model &model)
+{
+	Super::connectToModel(model);
+
+	// get the list of actuators assigned to the reflex controller
+	Set<Actuator>& actuators = updActuators();
+	_sensorStateNames.setSize(0);
+	_channels.clear();
+	// the sensor states belong to this controller, so its history is its own
+	_sensedForceLine = SignalDelayLine::getShared(model,
+		getName() + "/sensed_tendon_force");
+	_sensedForceLine->requireDelay(get_delay());
+
+	// only muscles remain in the actuator set
+	for(int i=0; i<actuators.getSize(); ++i){
+		_sensorStateNames.append(actuators[i].getName() + "_tendon_force");
+		_channels.push_back(_sensedForceLine->addChannel(actuators[i].getName()));
+	}
+
+	if(get_sensor_time_constant() <= 0)
+		throw Exception("TendonForceReflexController: sensor_time_constant must be positive.");
+}
+
+void TendonForceReflexController::addToSystem(SimTK::MultibodySystem& system) const
+{
+	Super::addToSystem(system);
+
+	// The sensor states only affect the controls, which are computed from the
+	// Velocity stage, so changing them invalidates Velocity.
+	for(int i=0; i<_sensorStateNames.getSize(); ++i)
+		addStateVariable(_sensorStateNames[i], Stage::Velocity);
+}
+
+void TendonForceReflexController::initStateFromProperties(SimTK::State& s) const
+{
+	Super::initStateFromProperties(s);
+
+	// the sensors start unloaded
+	for(int i=0; i<_sensorStateNames.getSize(); ++i)
+		setStateVariable(s, _sensorStateNames[i], 0.0);
+}
+
+//=============================================================================
+// COMPUTATIONS
+//=============================================================================
+//_____________________________________________________________________________
+/**
+ * Tendon organ sensor dynamics. Derivatives are requested after the system
+ * has been realized to Dynamics, so the tendon force is available without
+ * any additional realization.
+ *
+ * @param s			current state of the system
+ */
+Vector TendonForceReflexController::
+	computeStateVariableDerivatives(const State& s) const
+{
+	const Set<Actuator>& actuators = getActuatorSet();
+	double tau = get_sensor_time_constant();
+
+	Vector derivs(_sensorStateNames.getSize(), 0.0);
+	for(int i=0; i<actuators.getSize(); ++i){
+		const Muscle *musc = dynamic_cast<const Muscle*>(&actuators[i]);
+		double force = musc->getTendonForce(s)/musc->getMaxIsometricForce();
+		derivs[i] = (force - getStateVariable(s, _sensorStateNames[i]))/tau;
+	}
+	return derivs;
+}
+
+double TendonForceReflexController::getSensedTendonForce(const State& s,
+	int index) const
+{
+	return getStateVariable(s, _sensorStateNames[index]);
+}
+
+//_____________________________________________________________________________
+/**
+ * Compute the controls for muscles under influence of this reflex controller
+ *
+ * @param s				current state of the system
+ * @param muscleControls	reflex control of each muscle
+ */
+void TendonForceReflexController::computeMuscleControls(const State& s, Vector &muscleControls) const
+{
+	// get time
+	double time = s.getTime();
+
+	// number of muscles controlled
+	int nm = getActuatorSet().getSize();
+
+	// save resused controller parameters
+	double k = get_gain()*getGainScale(s);
+	double delay = get_delay();
+	double threshold = get_normalized_force_threshold();
+
+	// normalized tendon force, as sensed by the tendon organ
+	double force = 0;
+	// force in excess of the threshold
+	double excess = 0;
+	//reflex control
+	double control = 0;
+
+	for(int i=0; i<nm; ++i){
+		force = getSensedTendonForce(s, i);
+
+		if(delay > 0){
+			// a delayed signal that precedes our recorded history reads as
+			// no force
+			_sensedForceLine->write(time, _channels[i], force);
+			force = _sensedForceLine->read(_channels[i], time - delay);
+		}
+
+		// only force in excess of the threshold produces a reflex
+		excess = force - threshold;
+		control = k*0.5*(fabs(excess) + excess);
+
+		muscleControls[i] = control;
+	}
+}
+
+void TendonForceReflexController::recordHistory(const State& s) const
+{
+	if(get_delay() <= 0)
+		return;
+
+	double time = s.getTime();
+	int nm = getActuatorSet().getSize();
+	for(int i=0; i<nm; ++i)
+		_sensedForceLine->write(time, _channels[i], getSensedTendonForce(s, i));
+}
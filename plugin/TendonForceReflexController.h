@@ -0,0 +1,160 @@
+#ifndef OPENSIM_TendonForceReflexController_H_
+#define OPENSIM_TendonForceReflexController_H_
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  TendonForceReflexController.h                 *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+
+// to export class as part of a plugin:
+#include "osimReflexesDLL.h"
+#include "MuscleReflexController.h"
+#include "SignalDelayLine.h"
+
+
+namespace OpenSim {
+
+//=============================================================================
+//=============================================================================
+/**
+ * TendonForceReflexController is a concrete controller that excites muscles
+ * in response to tendon force, in the manner of a Golgi tendon organ (Ib)
+ * force-feedback reflex.
+ *
+ * Tendon force is only available once the system has been realized to the
+ * Dynamics stage, but controls are computed while the system is being
+ * realized to Dynamics. Rather than realizing Dynamics a second time on every
+ * call, the controller owns one sensor state per muscle: the tendon force,
+ * normalized by the muscle's maximum isometric force and low-pass filtered
+ * with the sensor_time_constant. The sensor derivative is evaluated when the
+ * integrator asks for state derivatives (Dynamics is already realized), and
+ * computeControls() only reads the sensor state. The filtered signal can be
+ * delayed by a constant time offset before the gain is applied.
+ *
+ * Only force in excess of the normalized_force_threshold produces a reflex.
+ * A negative gain models autogenic (Ib) inhibition.
+ *
+ * @author  Matt DeMers
+ * @version 1.0
+ */
+class OSIMREFLEXES_API TendonForceReflexController : public MuscleReflexController {
+OpenSim_DECLARE_CONCRETE_OBJECT(TendonForceReflexController, MuscleReflexController);
+
+public:
+//=============================================================================
+// PROPERTIES
+//=============================================================================
+    /** @name Property declarations
+    These are the serializable properties associated with a TendonForceReflexController.*/
+    /**@{**/
+	OpenSim_DECLARE_PROPERTY(gain, double,
+		"Control gain applied to the normalized tendon force signal." );
+	OpenSim_DECLARE_PROPERTY(delay, double,
+		"Time delay (seconds) between the tendon force and the reflex signal.");
+	OpenSim_DECLARE_PROPERTY(normalized_force_threshold, double,
+		"Tendon force, as a fraction of maximum isometric force, below which "
+		"the controller does not respond.");
+	OpenSim_DECLARE_PROPERTY(sensor_time_constant, double,
+		"Time constant (seconds) of the first order tendon organ sensor.");
+
+//=============================================================================
+// METHODS
+//=============================================================================
+	//--------------------------------------------------------------------------
+	// CONSTRUCTION AND DESTRUCTION
+	//--------------------------------------------------------------------------
+	/** Default constructor. */
+	TendonForceReflexController();
+	// Uses default (compiler-generated) destructor, copy constructor and copy
+    // assignment operator.
+
+	/** Convenience constructor
+	* @param gain		gain on the tendon force response
+	* @param delay		delay on the tendon force response
+	* @param threshold	normalized tendon force below which there is no response
+	*/
+	TendonForceReflexController(double gain, double delay, double threshold);
+
+	/** Compute the controls for muscles
+	 *  This method defines the behavior for TendonForceReflexController controller
+	 *
+	 * @param s					system state
+	 * @param muscleControls	reflex control of each muscle
+	 */
+	void computeMuscleControls(const SimTK::State& s,
+		SimTK::Vector &muscleControls) const OVERRIDE_11;
+
+	/** Delayed controls are read from the sensed force history. */
+	bool dependsOnHistory() const OVERRIDE_11 { return get_delay() > 0; }
+
+	/** The sensed tendon forces are filter states. */
+	bool dependsOnAuxiliaryStates() const OVERRIDE_11 { return true; }
+
+	/** Record the sensed tendon forces in the history only. */
+	void recordHistory(const SimTK::State& s) const OVERRIDE_11;
+
+	/** The sensed force line, if delayed. */
+	SignalDelayLine* getSensorHistory() const OVERRIDE_11 { return _sensedForceLine.get(); }
+
+	/** Get the filtered, normalized tendon force sensed for a muscle.
+	 *
+	 * @param s			system state
+	 * @param index		index of the muscle in this controller's actuator set
+	 */
+	double getSensedTendonForce(const SimTK::State& s, int index) const;
+
+protected:
+	// ModelComponent interface for the tendon organ sensor states
+	SimTK::Vector computeStateVariableDerivatives(const SimTK::State& s) const OVERRIDE_11;
+	void initStateFromProperties(SimTK::State& s) const OVERRIDE_11;
+
+private:
+	// Connect properties to local pointers.  */
+	void constructProperties();
+	// ModelComponent interface to add computational elements to the SimTK system
+	void addToSystem(SimTK::MultibodySystem& system) const;
+	// ModelComponent interface to connect this component to its model
+	void connectToModel(Model& aModel);
+
+	//=============================================================================
+	// Private Members
+	//=============================================================================
+	// names of the sensor states, one per muscle, in actuator order
+	Array<std::string> _sensorStateNames;
+	// history of the sensed (filtered) tendon force, used when delay > 0
+	std::shared_ptr<SignalDelayLine> _sensedForceLine;
+	// delay line channel of each muscle, in actuator order
+	std::vector<int> _channels;
+
+	//=============================================================================
+};	// END of class TendonForceReflexController
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_TendonForceReflexController_H_
+
+
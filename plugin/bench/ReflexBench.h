@@ -0,0 +1,167 @@
+#ifndef OPENSIM_ReflexBench_H_
+#define OPENSIM_ReflexBench_H_
+/* -------------------------------------------------------------------------- *
+ *                          OpenSim:  ReflexBench.h                           *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <OpenSim/OpenSim.h>
+#include "MuscleReflexController.h"
+#include "RegisterTypes_osimPlugin.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace OpenSim {
+
+//=============================================================================
+//=============================================================================
+/**
+ * Helpers shared by the benchmarks: a scalable model, the states of a short
+ * simulation, and the cost of a reflex evaluation at those states.
+ */
+namespace ReflexBench {
+
+	/** Model of numMuscles Thelen muscles pulling a block on a slider, half
+	 * from either side, so any number of muscles can be benchmarked. */
+	inline Model* buildMuscleModel(int numMuscles)
+	{
+		Model* model = new Model();
+		model->setName("bench_" + std::to_string(numMuscles) + "_muscles");
+		model->setGravity(SimTK::Vec3(0));
+
+		OpenSim::Body& ground = model->getGroundBody();
+		OpenSim::Body* block = new OpenSim::Body("block", 20.0,
+			SimTK::Vec3(0), SimTK::Inertia(0.1));
+		SliderJoint* slider = new SliderJoint("slider", ground, SimTK::Vec3(0),
+			SimTK::Vec3(0), *block, SimTK::Vec3(0), SimTK::Vec3(0));
+		slider->upd_CoordinateSet()[0].setName("block_tx");
+		slider->upd_CoordinateSet()[0].setDefaultSpeedValue(0.5);
+		model->addBody(block);
+
+		for(int i=0; i<numMuscles; ++i){
+			double side = i % 2 ? 1.0 : -1.0;
+			double offset = 0.002*(i/2);
+			Thelen2003Muscle* muscle = new Thelen2003Muscle("muscle_" + std::to_string(i),
+				500.0, 0.1 + 0.0005*(i % 7), 0.2, 0.0);
+			muscle->addNewPathPoint("origin", ground, SimTK::Vec3(0.35*side, offset, 0));
+			muscle->addNewPathPoint("insertion", *block, SimTK::Vec3(0.05*side, offset, 0));
+			model->addForce(muscle);
+		}
+		return model;
+	}
+
+	/** Switch off the model's own reflex controllers, so that the
+	 * controllers under test all see the same motion. */
+	inline void disableReflexes(Model& model)
+	{
+		ControllerSet& controllers = model.updControllerSet();
+		for(int i=0; i<controllers.getSize(); ++i)
+			if(dynamic_cast<MuscleReflexController*>(&controllers[i]))
+				controllers[i].setDisabled(true);
+	}
+
+	/** Switch on the model's own reflex controllers (disabled in the landing
+	 * example), so that a simulation lands with the whole reflex stack.
+	 * @return the reflex controllers, in model order */
+	inline std::vector<MuscleReflexController*> enableReflexes(Model& model)
+	{
+		std::vector<MuscleReflexController*> reflexes;
+		ControllerSet& controllers = model.updControllerSet();
+		for(int i=0; i<controllers.getSize(); ++i)
+			if(MuscleReflexController* reflex = dynamic_cast<MuscleReflexController*>(&controllers[i])){
+				reflex->setDisabled(false);
+				reflexes.push_back(reflex);
+			}
+		return reflexes;
+	}
+
+	/** Add a controller of every muscle of the model. It is disabled: it is
+	 * only evaluated by timeEvaluation(). */
+	inline MuscleReflexController* addOnAllMuscles(Model& model,
+		MuscleReflexController* controller, const std::string& name)
+	{
+		controller->setName(name);
+		controller->setActuators(model.updActuators());
+		controller->setDisabled(true);
+		model.addController(controller);
+		return controller;
+	}
+
+	/** States of a simulation of the model from its default state, every
+	 * interval for the given duration. */
+	inline std::vector<SimTK::State> recordStates(Model& model, double duration,
+		double interval)
+	{
+		SimTK::State& s = model.initSystem();
+		model.equilibrateMuscles(s);
+
+		const SimTK::MultibodySystem& system = model.getMultibodySystem();
+		SimTK::RungeKuttaMersonIntegrator integrator(system);
+		integrator.setAccuracy(1e-5);
+		SimTK::TimeStepper stepper(system, integrator);
+		stepper.initialize(s);
+
+		std::vector<SimTK::State> states;
+		int numSteps = (int)ceil(duration/interval - 1e-9);
+		for(int k=1; k<=numSteps; ++k){
+			stepper.stepTo(std::min(k*interval, duration));
+			states.push_back(integrator.getState());
+			system.realize(states.back(), SimTK::Stage::Dynamics);
+		}
+		return states;
+	}
+
+	/** Nanoseconds per computeMuscleControls() of the controller at the
+	 * states. Each pass evaluates the states in time order, as a simulation
+	 * would; the fastest of the passes is reported. */
+	inline double timeEvaluation(const MuscleReflexController& controller,
+		const std::vector<SimTK::State>& states, int passes)
+	{
+		SimTK::Vector u(controller.getActuatorSet().getSize());
+		double best = SimTK::Infinity;
+		for(int p=0; p<passes; ++p){
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			for(size_t f=0; f<states.size(); ++f){
+				u = 0;
+				controller.computeMuscleControls(states[f], u);
+			}
+			double elapsed = std::chrono::duration<double, std::nano>(
+				std::chrono::steady_clock::now() - start).count();
+			best = std::min(best, elapsed/std::max<size_t>(1, states.size()));
+		}
+		return best;
+	}
+
+}; // namespace ReflexBench
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexBench_H_
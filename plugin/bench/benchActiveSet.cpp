@@ -0,0 +1,119 @@
+/* -------------------------------------------------------------------------- *
+ *                        OpenSim:  benchActiveSet.cpp                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Active fraction and speedup of the reflexes' active sets on the landing
+ * model. The model lands with its reflex controllers switched on; each
+ * controller's average active fraction over the landing is reported from
+ * its own counters. Then, at the states of the landing, the controller's
+ * computeControls(), which adds in the controls of its active set only, is
+ * timed against evaluating the reflexes and adding in the controls of
+ * every muscle, as the controllers did before they tracked an active set.
+ *
+ * usage: benchActiveSet [model.osim] [passes] [duration]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// nanoseconds per control request of the controller at the states, best
+	// of the passes: through computeControls() with the active set, or by
+	// adding in the reflex of every muscle. Controls are memoized per
+	// realization, so the velocity stage is realized again, untimed, first.
+	double timeControls(const Model& model, const MuscleReflexController& controller,
+		vector<State>& states, int passes, bool activeSet)
+	{
+		const MultibodySystem& system = model.getMultibodySystem();
+		const Set<Actuator>& muscles = controller.getActuatorSet();
+		Vector controls(model.getNumControls());
+		Vector u(muscles.getSize());
+		double best = Infinity;
+		for(int p=0; p<passes; ++p){
+			double elapsed = 0;
+			for(size_t f=0; f<states.size(); ++f){
+				states[f].invalidateAllCacheAtOrAbove(Stage::Velocity);
+				system.realize(states[f], Stage::Velocity);
+				controls = 0;
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				if(activeSet)
+					controller.computeControls(states[f], controls);
+				else{
+					u = 0;
+					controller.computeMuscleControls(states[f], u);
+					for(int i=0; i<muscles.getSize(); ++i)
+						muscles[i].addInControls(Vector(1, &u[i], true), controls);
+				}
+				elapsed += chrono::duration<double, std::nano>(
+					chrono::steady_clock::now() - start).count();
+			}
+			best = std::min(best, elapsed/std::max<size_t>(1, states.size()));
+		}
+		return best;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		int passes = argc > 2 ? atoi(argv[2]) : 20;
+		double duration = argc > 3 ? atof(argv[3]) : 0.2;
+
+		Model model(modelFile);
+		vector<MuscleReflexController*> reflexes = ReflexBench::enableReflexes(model);
+		vector<State> states = ReflexBench::recordStates(model, duration, 0.001);
+
+		// fractions of the landing itself, before the timing adds evaluations
+		vector<double> fractions;
+		for(size_t r=0; r<reflexes.size(); ++r)
+			fractions.push_back(reflexes[r]->getAverageActiveFraction());
+
+		cout << "controller\tmuscles\tactive_fraction\tns_all_muscles\tns_active_set\tspeedup" << endl;
+		for(size_t r=0; r<reflexes.size(); ++r){
+			const MuscleReflexController& controller = *reflexes[r];
+			double all = timeControls(model, controller, states, passes, false);
+			double active = timeControls(model, controller, states, passes, true);
+			cout << setprecision(4) << controller.getName() << '\t'
+				<< controller.getActuatorSet().getSize() << '\t'
+				<< fractions[r] << '\t' << all << '\t' << active << '\t'
+				<< all/active << endl;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "benchActiveSet: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
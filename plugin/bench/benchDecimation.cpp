@@ -0,0 +1,134 @@
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  benchDecimation.cpp                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Controller work and accuracy of control-rate decimation on the landing
+ * model. The model lands with its reflex controllers switched on, first
+ * recomputing the reflexes at every control request (update_interval 0)
+ * and then holding them over update intervals (0.001 s, a 1 kHz neural
+ * update rate, by default). Each run reports the control requests, the
+ * reflex evaluations made and avoided, the wall time, and the largest
+ * deviation of the coordinates from the undecimated run.
+ *
+ * usage: benchDecimation [model.osim] [update interval] [duration]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// coordinates are compared at this interval (seconds)
+	const double ReportingInterval = 0.001;
+
+	struct Run {
+		long requests;
+		long evaluations;
+		long avoided;
+		double seconds;
+		vector<vector<double> > coordinates;	// one row per report
+	};
+
+	// land with every reflex controller at the update interval
+	Run land(const string& modelFile, double interval, double duration)
+	{
+		Model model(modelFile);
+		vector<MuscleReflexController*> reflexes = ReflexBench::enableReflexes(model);
+		for(size_t r=0; r<reflexes.size(); ++r)
+			reflexes[r]->set_update_interval(interval);
+
+		State& s = model.initSystem();
+		model.equilibrateMuscles(s);
+		for(size_t r=0; r<reflexes.size(); ++r)
+			reflexes[r]->resetCounters();
+
+		const MultibodySystem& system = model.getMultibodySystem();
+		const CoordinateSet& coordinates = model.getCoordinateSet();
+		RungeKuttaMersonIntegrator integrator(system);
+		integrator.setAccuracy(1e-5);
+		TimeStepper stepper(system, integrator);
+		stepper.initialize(s);
+
+		Run run;
+		int numReports = (int)ceil(duration/ReportingInterval - 1e-9);
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		for(int k=1; k<=numReports; ++k){
+			stepper.stepTo(std::min(k*ReportingInterval, duration));
+			const State& state = integrator.getState();
+			vector<double> row(coordinates.getSize());
+			for(int c=0; c<coordinates.getSize(); ++c)
+				row[c] = coordinates[c].getValue(state);
+			run.coordinates.push_back(row);
+		}
+		run.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+		run.requests = run.evaluations = run.avoided = 0;
+		for(size_t r=0; r<reflexes.size(); ++r){
+			run.requests += reflexes[r]->getNumControlRequests();
+			run.evaluations += reflexes[r]->getNumEvaluations();
+			run.avoided += reflexes[r]->getNumAvoidedEvaluations();
+		}
+		return run;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		double interval = argc > 2 ? atof(argv[2]) : 0.001;
+		double duration = argc > 3 ? atof(argv[3]) : 0.2;
+
+		cout << "update_interval\trequests\tevaluations\tavoided\tevaluations_per_request\t"
+			"wall_time\tmax_coordinate_deviation" << endl;
+		Run reference = land(modelFile, 0, duration);
+		for(int decimated=0; decimated<2; ++decimated){
+			const Run run = decimated ? land(modelFile, interval, duration) : reference;
+			double deviation = 0;
+			for(size_t k=0; k<run.coordinates.size(); ++k)
+				for(size_t c=0; c<run.coordinates[k].size(); ++c)
+					deviation = std::max(deviation,
+						fabs(run.coordinates[k][c] - reference.coordinates[k][c]));
+
+			cout << setprecision(4) << (decimated ? interval : 0.0) << '\t'
+				<< run.requests << '\t' << run.evaluations << '\t' << run.avoided << '\t'
+				<< (double)run.evaluations/std::max(1L, run.requests) << '\t'
+				<< run.seconds << '\t' << deviation << endl;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "benchDecimation: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,133 @@
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  benchFusedReflex.cpp                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Speedup of the fused reflex pass on the landing model. The model's
+ * controllers are evaluated at the states of a short landing, first each on
+ * its own and then with a FusedReflexController taking over the compatible
+ * ones. The model controls are also checked against those with the fused
+ * controller disabled, which the fused controllers then compute themselves.
+ *
+ * usage: benchFusedReflex [model.osim] [passes]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+#include "FusedReflexController.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// nanoseconds per evaluation of all the model's controllers at the
+	// states, best of the passes. Controls are memoized per realization, so
+	// the velocity stage is realized again, untimed, before each evaluation.
+	double timeControllers(const Model& model, vector<State>& states, int passes)
+	{
+		const MultibodySystem& system = model.getMultibodySystem();
+		Vector controls(model.getNumControls());
+		double best = Infinity;
+		for(int p=0; p<passes; ++p){
+			double elapsed = 0;
+			for(size_t f=0; f<states.size(); ++f){
+				states[f].invalidateAllCacheAtOrAbove(Stage::Velocity);
+				system.realize(states[f], Stage::Velocity);
+				controls = 0;
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				model.getControllerSet().computeControls(states[f], controls);
+				elapsed += chrono::duration<double, std::nano>(
+					chrono::steady_clock::now() - start).count();
+			}
+			best = std::min(best, elapsed/std::max<size_t>(1, states.size()));
+		}
+		return best;
+	}
+
+	// largest difference between the model controls with the fused
+	// controller enabled and with it disabled, which hands its muscles back
+	// to the fused controllers
+	double checkFusedControls(const Model& model,
+		FusedReflexController& fused, vector<State>& states)
+	{
+		const MultibodySystem& system = model.getMultibodySystem();
+		Vector withFused(model.getNumControls()), without(model.getNumControls());
+		double maxDifference = 0;
+		for(size_t f=0; f<states.size(); ++f){
+			for(int disabled=0; disabled<2; ++disabled){
+				fused.setDisabled(disabled != 0);
+				states[f].invalidateAllCacheAtOrAbove(Stage::Velocity);
+				system.realize(states[f], Stage::Velocity);
+				Vector& controls = disabled ? without : withFused;
+				controls = 0;
+				model.getControllerSet().computeControls(states[f], controls);
+			}
+			fused.setDisabled(false);
+			for(int i=0; i<withFused.size(); ++i)
+				maxDifference = std::max(maxDifference, fabs(withFused[i] - without[i]));
+		}
+		return maxDifference;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		int passes = argc > 2 ? atoi(argv[2]) : 20;
+
+		cout << "configuration\tfused_controllers\tns_per_evaluation\tspeedup\tmax_difference" << endl;
+		double separate = 0;
+		for(int withFused=0; withFused<2; ++withFused){
+			Model model(modelFile);
+			FusedReflexController* fused = NULL;
+			if(withFused){
+				fused = new FusedReflexController();
+				fused->setName("bench_fused");
+				model.addController(fused);
+			}
+
+			vector<State> states = ReflexBench::recordStates(model, 0.1, 0.001);
+			double ns = timeControllers(model, states, passes);
+			if(!withFused)
+				separate = ns;
+
+			cout << setprecision(4) << (withFused ? "fused" : "separate") << '\t'
+				<< (fused ? fused->getNumFusedControllers() : 0) << '\t'
+				<< ns << '\t' << separate/ns << '\t'
+				<< (fused ? checkFusedControls(model, *fused, states) : 0.0) << endl;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "benchFusedReflex: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,127 @@
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  benchMuscleSpindles.cpp                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Per-step overhead of the muscle spindle sensor: a model of 70 muscles
+ * (by default) is simulated with and without a MuscleSpindleSensor on every
+ * muscle, and the cost of realizing the accelerations, which evaluates the
+ * spindle derivative kernel, is timed at the states of the simulation.
+ *
+ * usage: benchMuscleSpindles [muscles] [passes]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+#include "MuscleSpindleSensor.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// wall time and number of steps of a simulation from the default state
+	void timeSimulation(Model& model, double duration, double& seconds, int& steps)
+	{
+		State& s = model.initSystem();
+		model.equilibrateMuscles(s);
+
+		const MultibodySystem& system = model.getMultibodySystem();
+		RungeKuttaMersonIntegrator integrator(system);
+		integrator.setAccuracy(1e-5);
+		TimeStepper stepper(system, integrator);
+		stepper.initialize(s);
+
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		stepper.stepTo(duration);
+		seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+		steps = integrator.getNumStepsTaken();
+	}
+
+	// nanoseconds per realization of the accelerations at the states, best
+	// of the passes
+	double timeRealization(const Model& model, vector<State>& states, int passes)
+	{
+		const MultibodySystem& system = model.getMultibodySystem();
+		double best = Infinity;
+		for(int p=0; p<passes; ++p){
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			for(size_t f=0; f<states.size(); ++f){
+				states[f].invalidateAllCacheAtOrAbove(Stage::Position);
+				system.realize(states[f], Stage::Acceleration);
+			}
+			double elapsed = chrono::duration<double, std::nano>(
+				chrono::steady_clock::now() - start).count();
+			best = std::min(best, elapsed/std::max<size_t>(1, states.size()));
+		}
+		return best;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		int nm = argc > 1 ? atoi(argv[1]) : 70;
+		int passes = argc > 2 ? atoi(argv[2]) : 20;
+		double duration = 0.1;
+
+		cout << "muscles\tspindles\tsteps\tus_per_step\tns_per_realization\trelative_to_no_spindles" << endl;
+		double baseline = 0;
+		for(int withSpindles=0; withSpindles<2; ++withSpindles){
+			unique_ptr<Model> model(ReflexBench::buildMuscleModel(nm));
+			if(withSpindles){
+				MuscleSpindleSensor* spindles = new MuscleSpindleSensor();
+				spindles->setName("spindles");
+				for(int i=0; i<nm; ++i)
+					spindles->append_muscle_list("muscle_" + to_string(i));
+				model->addModelComponent(spindles);
+			}
+
+			double seconds;
+			int steps;
+			timeSimulation(*model, duration, seconds, steps);
+			double usPerStep = 1e6*seconds/std::max(1, steps);
+
+			vector<State> states = ReflexBench::recordStates(*model, duration, 0.001);
+			double ns = timeRealization(*model, states, passes);
+			if(!withSpindles)
+				baseline = usPerStep;
+
+			cout << setprecision(4) << nm << '\t' << (withSpindles ? nm : 0) << '\t'
+				<< steps << '\t' << usPerStep << '\t' << ns << '\t'
+				<< usPerStep/baseline << endl;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "benchMuscleSpindles: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,123 @@
+/* -------------------------------------------------------------------------- *
+ *                        OpenSim:  benchPathSurrogate                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Accuracy and cost of the muscle path surrogate on the landing model. The
+ * paths of all the model's muscles are fit (without a cache file), the
+ * surrogate's accuracy report is printed, and the path length and
+ * lengthening speed of every muscle are then timed at the states of a short
+ * landing, through the geometry path and through the surrogate.
+ *
+ * usage: benchPathSurrogate [model.osim] [samples] [passes]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// nanoseconds per muscle for the path lengths and speeds of all the
+	// muscles at the states, best of the passes. The exact path is computed
+	// on first use after each realization, so the positions are realized
+	// again, untimed, before each state.
+	double timePaths(const Model& model, const MusclePathSurrogate* surrogate,
+		vector<State>& states, int passes)
+	{
+		const MultibodySystem& system = model.getMultibodySystem();
+		const Set<Muscle>& muscles = model.getMuscles();
+		vector<int> index(muscles.getSize());
+		for(int m=0; m<muscles.getSize(); ++m)
+			index[m] = surrogate ? surrogate->getIndex(muscles[m].getName()) : -1;
+
+		double best = Infinity;
+		for(int p=0; p<passes; ++p){
+			double elapsed = 0;
+			for(size_t f=0; f<states.size(); ++f){
+				states[f].invalidateAllCacheAtOrAbove(Stage::Position);
+				system.realize(states[f], Stage::Velocity);
+				chrono::steady_clock::time_point start = chrono::steady_clock::now();
+				for(int m=0; m<muscles.getSize(); ++m){
+					double length, speed;
+					if(surrogate)
+						surrogate->calcLengthAndSpeed(states[f], index[m], length, speed);
+					else{
+						length = muscles[m].getLength(states[f]);
+						speed = muscles[m].getLengtheningSpeed(states[f]);
+					}
+				}
+				elapsed += chrono::duration<double, std::nano>(
+					chrono::steady_clock::now() - start).count();
+			}
+			best = std::min(best, elapsed/std::max<size_t>(1, states.size()));
+		}
+		return best/std::max(1, muscles.getSize());
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		int samples = argc > 2 ? atoi(argv[2]) : 200;
+		int passes = argc > 3 ? atoi(argv[3]) : 20;
+
+		Model model(modelFile);
+		vector<State> states = ReflexBench::recordStates(model, 0.1, 0.001);
+		const State& s = model.getWorkingState();
+
+		vector<const Muscle*> muscles;
+		for(int m=0; m<model.getMuscles().getSize(); ++m)
+			muscles.push_back(&model.getMuscles()[m]);
+
+		MusclePathSurrogate surrogate(model);
+		surrogate.setCacheFile("");
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+		surrogate.prepare(s, muscles);
+		double fitTime = chrono::duration<double>(
+			chrono::steady_clock::now() - start).count();
+
+		surrogate.printAccuracyReport(s, cout, samples);
+		cout << "# fit time (s): " << fitTime << endl;
+
+		cout << "path\tns_per_muscle\tspeedup" << endl;
+		double exact = timePaths(model, NULL, states, passes);
+		double fitted = timePaths(model, &surrogate, states, passes);
+		cout << setprecision(4) << "exact\t" << exact << '\t' << 1.0 << endl;
+		cout << "surrogate\t" << fitted << '\t' << exact/fitted << endl;
+	}
+	catch(const std::exception& x){
+		cout << "benchPathSurrogate: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  benchReflexEquilibrium.cpp                    *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Cost of the start of a landing with and without reflex equilibrium. The
+ * model lands with its reflex controllers switched on; the first 50 ms (by
+ * default) are integrated from the muscles equilibrated by
+ * Model::equilibrateMuscles() alone, and then after a
+ * ReflexEquilibriumSolver solve. See
+ * ReflexEquilibriumSolver::printStartupComparison().
+ *
+ * usage: benchReflexEquilibrium [model.osim] [duration]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+#include "ReflexEquilibriumSolver.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		double duration = argc > 2 ? atof(argv[2]) : 0.05;
+
+		Model model(modelFile);
+		ReflexBench::enableReflexes(model);
+		State& s = model.initSystem();
+
+		ReflexEquilibriumSolver solver(model);
+		solver.printStartupComparison(s, cout, duration);
+	}
+	catch(const std::exception& x){
+		cout << "benchReflexEquilibrium: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,163 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  benchReflexKernel.cpp                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Cost per tick of the exported reflex kernels against the controllers they
+ * were exported from. The kernels of the ReflexKernelModel controllers are
+ * exported at build time and compiled here. Both are timed at the states
+ * of a short landing, sampled every kernel tick; the kernels are stepped on
+ * sensor values read from those states beforehand, as an embedded loop
+ * would receive them.
+ *
+ * usage: benchReflexKernel [model.osim] [passes]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "PathStretchKernel.h"
+#include "FiberStretchKernel.h"
+#include "DelayedStretchKernel.h"
+
+#include "ReflexBench.h"
+#include "test/ReflexKernelModel.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// keeps the kernels' controls observable
+	volatile double sink = 0;
+
+	// nanoseconds per tick of a kernel, best of the passes. Each pass calls
+	// reset() and then tick(f) for every frame, which writes the frame's
+	// controls; they are summed, untimed, after the pass.
+	template <typename Reset, typename Tick>
+	double timeKernel(int numFrames, int passes, const vector<double>& controls,
+		Reset reset, Tick tick)
+	{
+		double best = Infinity;
+		for(int p=0; p<passes; ++p){
+			reset();
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			for(int f=0; f<numFrames; ++f)
+				tick(f);
+			double elapsed = chrono::duration<double, std::nano>(
+				chrono::steady_clock::now() - start).count();
+			best = std::min(best, elapsed/std::max(1, numFrames));
+
+			double sum = 0;
+			for(size_t k=0; k<controls.size(); ++k)
+				sum += controls[k];
+			sink = sink + sum;
+		}
+		return best;
+	}
+
+	// path (or fiber) lengths and lengthening speeds of the controller's
+	// muscles at the states, one row of muscles per state
+	void sense(const MuscleReflexController& controller, bool fiber,
+		const vector<State>& states, vector<double>& lengths, vector<double>& speeds)
+	{
+		const Set<Actuator>& muscles = controller.getActuatorSet();
+		int n = muscles.getSize();
+		lengths.resize(states.size()*n);
+		speeds.resize(states.size()*n);
+		for(size_t f=0; f<states.size(); ++f){
+			for(int i=0; i<n; ++i){
+				const Muscle& musc = static_cast<const Muscle&>(muscles[i]);
+				lengths[f*n + i] = fiber ? musc.getFiberLength(states[f]) : musc.getLength(states[f]);
+				speeds[f*n + i] = fiber ? musc.getFiberVelocity(states[f]) : musc.getLengtheningSpeed(states[f]);
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		int passes = argc > 2 ? atoi(argv[2]) : 20;
+
+		Model model(modelFile);
+		ReflexKernelModel::addDelayedController(model);
+		vector<State> states = ReflexBench::recordStates(model, 0.2, ReflexKernelModel::TickPeriod);
+		int numFrames = (int)states.size();
+
+		const ControllerSet& controllers = model.getControllerSet();
+		const MuscleReflexController& path =
+			static_cast<const MuscleReflexController&>(controllers.get("PathStretch"));
+		const MuscleReflexController& fiber =
+			static_cast<const MuscleReflexController&>(controllers.get("FiberStretch"));
+		const MuscleReflexController& delayed =
+			static_cast<const MuscleReflexController&>(controllers.get("DelayedStretch"));
+
+		cout << "kernel\tmuscles\tplugin_ns_per_tick\tkernel_ns_per_tick\tspeedup" << endl;
+		auto report = [&](const MuscleReflexController& controller, double kernelNs) {
+			double pluginNs = ReflexBench::timeEvaluation(controller, states, passes);
+			cout << setprecision(4) << controller.getName() << '\t'
+				<< controller.getActuatorSet().getSize() << '\t'
+				<< pluginNs << '\t' << kernelNs << '\t' << pluginNs/kernelNs << endl;
+		};
+
+		vector<double> lengths, speeds;
+		vector<double> controls((size_t)numFrames*PathStretch::NumMuscles);
+		sense(path, false, states, lengths, speeds);
+		report(path, timeKernel(numFrames, passes, controls, [](){},
+			[&](int f) {
+				size_t row = (size_t)f*PathStretch::NumMuscles;
+				PathStretch::step(&lengths[row], &speeds[row], &controls[row]);
+			}));
+
+		controls.assign((size_t)numFrames*FiberStretch::NumMuscles, 0.0);
+		sense(fiber, true, states, lengths, speeds);
+		report(fiber, timeKernel(numFrames, passes, controls, [](){},
+			[&](int f) {
+				size_t row = (size_t)f*FiberStretch::NumMuscles;
+				FiberStretch::step(&lengths[row], &speeds[row], &controls[row]);
+			}));
+
+		// the delayed kernel starts each pass from an empty history, as the
+		// controller's delay line does when the pass steps back in time
+		controls.assign((size_t)numFrames*DelayedStretch::NumMuscles, 0.0);
+		sense(delayed, false, states, lengths, speeds);
+		DelayedStretch::State kernel;
+		report(delayed, timeKernel(numFrames, passes, controls,
+			[&]() { DelayedStretch::reset(kernel); },
+			[&](int f) {
+				size_t row = (size_t)f*DelayedStretch::NumMuscles;
+				DelayedStretch::step(kernel, &speeds[row], &controls[row]);
+			}));
+	}
+	catch(const std::exception& x){
+		cout << "benchReflexKernel: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,114 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  benchSpinalNetwork.cpp                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Cost of the spinal network reflex with dense (every muscle onto every
+ * muscle) and sparse (each muscle onto itself and a few neighbours)
+ * couplings, undelayed and with per-connection delays, on models of 70 and
+ * 300 muscles.
+ *
+ * usage: benchSpinalNetwork [passes] [sources per sparse row]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+#include "SpinalNetworkReflexController.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// network of nm muscles in which each muscle receives from rowSize
+	// sources: itself and its neighbours, excitatory and inhibitory in turn
+	SpinalNetworkReflexController* buildNetwork(int nm, int rowSize, bool delayed)
+	{
+		SpinalNetworkReflexController* network = new SpinalNetworkReflexController();
+		network->set_sensor("path_velocity");
+		network->append_row_offsets(0);
+		for(int i=0; i<nm; ++i){
+			for(int k=0; k<rowSize; ++k){
+				int j = (i + k) % nm;
+				network->append_column_indices(j);
+				network->append_weights((k % 2 ? -0.5 : 1.0)/rowSize);
+				if(delayed)
+					network->append_connection_delays(0.01 + 0.001*(j % 20));
+			}
+			network->append_row_offsets((i+1)*rowSize);
+		}
+		return network;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		int passes = argc > 1 ? atoi(argv[1]) : 20;
+		int sparseRow = argc > 2 ? atoi(argv[2]) : 8;
+
+		cout << "muscles\tconnectivity\tdelayed\tconnections\tns_per_evaluation\tns_per_connection" << endl;
+		const int sizes[] = { 70, 300 };
+		for(int n=0; n<2; ++n){
+			int nm = sizes[n];
+			unique_ptr<Model> model(ReflexBench::buildMuscleModel(nm));
+
+			vector<MuscleReflexController*> networks;
+			vector<string> connectivity;
+			vector<bool> delayed;
+			for(int d=0; d<2; ++d){
+				networks.push_back(ReflexBench::addOnAllMuscles(*model,
+					buildNetwork(nm, nm, d == 1), d ? "dense_delayed" : "dense"));
+				connectivity.push_back("dense");
+				delayed.push_back(d == 1);
+				networks.push_back(ReflexBench::addOnAllMuscles(*model,
+					buildNetwork(nm, std::min(sparseRow, nm), d == 1),
+					d ? "sparse_delayed" : "sparse"));
+				connectivity.push_back("sparse");
+				delayed.push_back(d == 1);
+			}
+
+			vector<State> states = ReflexBench::recordStates(*model, 0.1, 0.001);
+			for(size_t c=0; c<networks.size(); ++c){
+				const SpinalNetworkReflexController& network =
+					static_cast<const SpinalNetworkReflexController&>(*networks[c]);
+				double ns = ReflexBench::timeEvaluation(network, states, passes);
+				cout << setprecision(4) << nm << '\t' << connectivity[c] << '\t'
+					<< (delayed[c] ? 1 : 0) << '\t' << network.getNumConnections() << '\t'
+					<< ns << '\t' << ns/std::max(1, network.getNumConnections()) << endl;
+			}
+		}
+	}
+	catch(const std::exception& x){
+		cout << "benchSpinalNetwork: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
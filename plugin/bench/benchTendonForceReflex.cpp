@@ -0,0 +1,92 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  benchTendonForceReflex.cpp                    *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Cost of the tendon force reflex against the stretch reflexes it sits
+ * beside. Every controller covers every muscle of the model and is timed at
+ * the same states of a short landing.
+ *
+ * usage: benchTendonForceReflex [model.osim] [passes]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexBench.h"
+#include "MusclePathStretchController.h"
+#include "MuscleFiberStretchController.h"
+#include "TendonForceReflexController.h"
+
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		string modelFile = argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL;
+		int passes = argc > 2 ? atoi(argv[2]) : 20;
+
+		Model model(modelFile);
+		ReflexBench::disableReflexes(model);
+
+		vector<MuscleReflexController*> controllers;
+		controllers.push_back(ReflexBench::addOnAllMuscles(model,
+			new MusclePathStretchController(1.0, 1.0, 1.0), "bench_path_stretch"));
+		MuscleFiberStretchController* fiber = new MuscleFiberStretchController();
+		fiber->set_gain_length(1.0);
+		fiber->set_gain_velocity(1.0);
+		controllers.push_back(ReflexBench::addOnAllMuscles(model, fiber, "bench_fiber_stretch"));
+		TendonForceReflexController* force = new TendonForceReflexController();
+		force->set_gain(1.0);
+		controllers.push_back(ReflexBench::addOnAllMuscles(model, force, "bench_tendon_force"));
+		TendonForceReflexController* delayed = new TendonForceReflexController();
+		delayed->set_gain(1.0);
+		delayed->set_delay(0.02);
+		controllers.push_back(ReflexBench::addOnAllMuscles(model, delayed, "bench_tendon_force_delayed"));
+
+		vector<State> states = ReflexBench::recordStates(model, 0.2, 0.001);
+
+		cout << "controller\tmuscles\tns_per_evaluation\tns_per_muscle\trelative_to_path_stretch" << endl;
+		double reference = 0;
+		for(size_t c=0; c<controllers.size(); ++c){
+			const MuscleReflexController& controller = *controllers[c];
+			int nm = controller.getActuatorSet().getSize();
+			double ns = ReflexBench::timeEvaluation(controller, states, passes);
+			if(c == 0)
+				reference = ns;
+			cout << setprecision(4) << controller.getName() << '\t' << nm << '\t'
+				<< ns << '\t' << ns/std::max(1, nm) << '\t' << ns/reference << endl;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "benchTendonForceReflex: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,174 @@
+/* -------------------------------------------------------------------------- *
+ *                         OpenSim:  reflexes.i                               *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+// Python bindings for batch evaluation of the reflex controllers.
+//
+// Arrays cross the boundary without copying: inputs that are C-contiguous
+// float64 arrays are read in place, controls are written into a caller-owned
+// array, and delay line contents are returned as views of the line's own
+// storage. A view is only valid while the evaluator lives and until the
+// line is next written (i.e. until the next simulation or evaluation).
+//
+//	import numpy, reflexes
+//	ev = reflexes.ReflexControlEvaluator("LandingReflexesModel.osim")
+//	u = reflexes.evaluate_sensors(ev, "fiber_reflexes", lengths, speeds)
+//	line = ev.getSensorHistory("delayed_reflexes")
+//	t, x = line.times(), line.values()
+
+%module reflexes
+
+%{
+#define SWIG_FILE_WITH_INIT
+#include <OpenSim/OpenSim.h>
+#include "SignalDelayLine.h"
+#include "ReflexControlEvaluator.h"
+%}
+
+%include "std_string.i"
+%include "exception.i"
+%include "numpy.i"
+
+%init %{
+	import_array();
+%}
+
+%exception {
+	try {
+		$action
+	}
+	catch(const std::exception& x) {
+		SWIG_exception(SWIG_RuntimeError, x.what());
+	}
+}
+
+%apply (double** ARGOUTVIEW_ARRAY1, int* DIM1) {(double** times, int* numSamples)};
+%apply (double** ARGOUTVIEW_ARRAY2, int* DIM1, int* DIM2)
+	{(double** values, int* numSamples, int* numChannels)};
+%apply (double* IN_ARRAY1, int DIM1) {(double* times, int numFrames)};
+%apply (double* IN_ARRAY2, int DIM1, int DIM2) {
+	(double* lengths, int lengthFrames, int lengthMuscles),
+	(double* speeds, int speedFrames, int speedMuscles),
+	(double* states, int stateFrames, int numStates)};
+%apply (double* INPLACE_ARRAY2, int DIM1, int DIM2)
+	{(double* controls, int controlFrames, int controlMuscles)};
+
+namespace OpenSim {
+
+// Only what scripts need; the lines belong to their controllers.
+class SignalDelayLine {
+public:
+	int getNumChannels() const;
+	int getNumSamples() const;
+	double getMaxDelay() const;
+	const std::string& getChannelName(int channel) const;
+	double read(int channel, double time) const;
+private:
+	SignalDelayLine();
+};
+
+%extend SignalDelayLine {
+	// sample times, oldest first
+	void times(double** times, int* numSamples) {
+		$self->linearize();
+		*times = const_cast<double*>($self->getTimesData());
+		*numSamples = $self->getNumSamples();
+	}
+	// samples x channels, oldest first
+	void values(double** values, int* numSamples, int* numChannels) {
+		$self->linearize();
+		*values = const_cast<double*>($self->getValuesData());
+		*numSamples = $self->getNumSamples();
+		*numChannels = $self->getNumChannels();
+	}
+}
+
+class ReflexControlEvaluator {
+public:
+	ReflexControlEvaluator(const std::string& modelFile);
+	~ReflexControlEvaluator();
+
+	void setNumThreads(int numThreads);
+	void setBlockSize(int blockSize);
+
+	int getNumStates() const;
+	int getNumMuscles(const std::string& controllerName) const;
+	SignalDelayLine* getSensorHistory(const std::string& controllerName) const;
+
+	static void evaluateFiles(const std::string& modelFile,
+		const std::string& statesFile, const std::string& controllerName,
+		const std::string& outputFile, int numThreads = 0);
+};
+
+%extend ReflexControlEvaluator {
+	// controls (frames x muscles) from sensed lengths and speeds of the
+	// same shape
+	void evaluateSensors(const std::string& controllerName,
+		double* lengths, int lengthFrames, int lengthMuscles,
+		double* speeds, int speedFrames, int speedMuscles,
+		double* controls, int controlFrames, int controlMuscles) {
+		int nm = $self->getNumMuscles(controllerName);
+		if(lengthMuscles != nm || speedMuscles != nm || controlMuscles != nm
+			|| speedFrames != lengthFrames || controlFrames != lengthFrames)
+			throw OpenSim::Exception("evaluateSensors: arrays must all be "
+				"frames x muscles of " + controllerName + ".");
+		$self->evaluateSensors(controllerName, lengths, speeds, lengthFrames, controls);
+	}
+
+	// controls (frames x muscles) at frames of model-ordered state values
+	void evaluateStates(const std::string& controllerName,
+		double* times, int numFrames,
+		double* states, int stateFrames, int numStates,
+		double* controls, int controlFrames, int controlMuscles) {
+		if(stateFrames != numFrames || controlFrames != numFrames
+			|| numStates != $self->getNumStates()
+			|| controlMuscles != $self->getNumMuscles(controllerName))
+			throw OpenSim::Exception("evaluateStates: array shapes do not "
+				"match the model and " + controllerName + ".");
+		$self->evaluate(controllerName, times, states, numFrames, controls);
+	}
+}
+
+} // namespace OpenSim
+
+%pythoncode %{
+import numpy
+
+def evaluate_sensors(evaluator, controller, lengths, speeds):
+    """Controls of a reflex controller from (frames x muscles) arrays of
+    sensed lengths and lengthening speeds, in one call."""
+    speeds = numpy.ascontiguousarray(speeds, dtype=numpy.float64)
+    lengths = speeds if lengths is None else \
+        numpy.ascontiguousarray(lengths, dtype=numpy.float64)
+    controls = numpy.empty(speeds.shape)
+    evaluator.evaluateSensors(controller, lengths, speeds, controls)
+    return controls
+
+def evaluate_states(evaluator, controller, times, states):
+    """Controls of a reflex controller at (frames x states) model-ordered
+    state values, in one call."""
+    times = numpy.ascontiguousarray(times, dtype=numpy.float64)
+    states = numpy.ascontiguousarray(states, dtype=numpy.float64)
+    controls = numpy.empty((len(times), evaluator.getNumMuscles(controller)))
+    evaluator.evaluateStates(controller, times, states, controls)
+    return controls
+%}
@@ -0,0 +1,90 @@
+#ifndef OPENSIM_ReflexKernelModel_H_
+#define OPENSIM_ReflexKernelModel_H_
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  ReflexKernelModel.h                        *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+
+//============================================================================
+// INCLUDE
+//============================================================================
+#include <OpenSim/OpenSim.h>
+#include "DelayedPathReflexController.h"
+
+#include <string>
+
+namespace OpenSim {
+
+//=============================================================================
+//=============================================================================
+/**
+ * The controllers whose kernels are exported, tested and benchmarked:
+ * PathStretch and FiberStretch of the landing example, and DelayedStretch,
+ * a DelayedPathReflexController added here on the same muscles.
+ * writeReflexKernels exports their kernels at build time, so the kernel
+ * test and benchmark compile the generated headers themselves.
+ */
+namespace ReflexKernelModel {
+
+	/** Tick period of the delayed kernel. A power of two, so that tick
+	 * times and delays of whole and half ticks are exact and the plugin's
+	 * delay line reads exactly where the kernel does. */
+	const double TickPeriod = 1.0/1024;
+
+	/** Delays of DelayedStretch in ticks, cycled over its muscles: whole,
+	 * half and arbitrary fractions of a tick. */
+	const double DelayTicks[] = { 10, 10.5, 20.3, 33.75 };
+	const int NumDelays = 4;
+
+	const char* const ControllerNames[] = { "PathStretch", "FiberStretch", "DelayedStretch" };
+	const int NumControllers = 3;
+
+	/** Header file of a controller's kernel in directory. */
+	inline std::string getKernelFileName(const std::string& directory,
+		const std::string& controller)
+	{
+		return directory + "/" + controller + "Kernel.h";
+	}
+
+	/** Add DelayedStretch to the landing model, disabled like the model's
+	 * own reflexes. */
+	inline DelayedPathReflexController* addDelayedController(Model& model)
+	{
+		const Controller& path = model.getControllerSet().get("PathStretch");
+		DelayedPathReflexController* delayed = new DelayedPathReflexController(0.85, 0);
+		delayed->setName("DelayedStretch");
+		delayed->setDisabled(true);
+		for(int i=0; i<path.getProperty_actuator_list().size(); ++i){
+			delayed->append_actuator_list(path.get_actuator_list(i));
+			delayed->append_muscle_delays(TickPeriod*DelayTicks[i % NumDelays]);
+		}
+		model.addController(delayed);
+		return delayed;
+	}
+
+}; // namespace ReflexKernelModel
+
+}; //namespace
+//=============================================================================
+//=============================================================================
+
+#endif // OPENSIM_ReflexKernelModel_H_
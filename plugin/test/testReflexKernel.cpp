@@ -0,0 +1,252 @@
+/* -------------------------------------------------------------------------- *
+ *                       OpenSim:  testReflexKernel.cpp                       *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Equivalence test of the exported reflex kernels. writeReflexKernels
+ * exports the kernels of the ReflexKernelModel controllers at build time
+ * and this test compiles the generated headers. Each kernel is stepped on
+ * the sensor values of a passive landing, sampled every tick, and compared
+ * with the controller's computeMuscleControls() at the same states. The
+ * delayed kernel is also compared with a SignalDelayLine fed the same
+ * signals over many ticks, so that its ring wraps and every delay is read
+ * between two ticks as well as on them.
+ *
+ * usage: testReflexKernel [model.osim]
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+// The generated kernels come first: they must compile on their own.
+#include "PathStretchKernel.h"
+#include "FiberStretchKernel.h"
+#include "DelayedStretchKernel.h"
+
+#include <OpenSim/OpenSim.h>
+#include "ReflexKernelModel.h"
+#include "SignalDelayLine.h"
+#include "RegisterTypes_osimPlugin.h"
+
+#include <iomanip>
+#include <iostream>
+#include <vector>
+
+using namespace OpenSim;
+using namespace std;
+using namespace SimTK;
+
+namespace {
+	// largest difference allowed between kernel and plugin controls
+	const double Tolerance = 1e-10;
+	// simulated landing (seconds)
+	const double Duration = 0.15;
+	// ticks of synthetic signals fed to the delayed kernel and the line
+	const int NumLineTicks = 2000;
+
+	typedef void (*StretchStep)(const double* lengths, const double* speeds,
+		double* controls);
+
+	// true if the kernel's sensor order is the controller's muscle order;
+	// only then can the two be compared
+	bool sameMuscles(const char* const* names, int numNames,
+		const Set<Actuator>& muscles)
+	{
+		if(numNames != muscles.getSize())
+			return false;
+		for(int i=0; i<numNames; ++i)
+			if(muscles[i].getName() != names[i])
+				return false;
+		return true;
+	}
+
+	// states of a landing with the reflexes disabled, one per tick
+	vector<State> recordTicks(Model& model)
+	{
+		State& s = model.initSystem();
+		model.equilibrateMuscles(s);
+
+		const MultibodySystem& system = model.getMultibodySystem();
+		RungeKuttaMersonIntegrator integrator(system);
+		integrator.setAccuracy(1e-5);
+		TimeStepper stepper(system, integrator);
+		stepper.initialize(s);
+
+		vector<State> states;
+		int numTicks = (int)(Duration/ReflexKernelModel::TickPeriod);
+		for(int k=0; k<=numTicks; ++k){
+			if(k > 0)
+				stepper.stepTo(k*ReflexKernelModel::TickPeriod);
+			states.push_back(integrator.getState());
+			system.realize(states.back(), Stage::Dynamics);
+		}
+		return states;
+	}
+
+	// largest difference between a stretch kernel, stepped on the path (or
+	// fiber) lengths and lengthening speeds, and the controller
+	double compareStretch(const MuscleReflexController& controller, bool fiber,
+		StretchStep step, const vector<State>& states)
+	{
+		const Set<Actuator>& muscles = controller.getActuatorSet();
+		int n = muscles.getSize();
+		vector<double> lengths(n), speeds(n), controls(n);
+		Vector u(n);
+		double maxDifference = 0;
+		for(size_t f=0; f<states.size(); ++f){
+			for(int i=0; i<n; ++i){
+				const Muscle& musc = static_cast<const Muscle&>(muscles[i]);
+				lengths[i] = fiber ? musc.getFiberLength(states[f]) : musc.getLength(states[f]);
+				speeds[i] = fiber ? musc.getFiberVelocity(states[f]) : musc.getLengtheningSpeed(states[f]);
+			}
+			step(&lengths[0], &speeds[0], &controls[0]);
+			u = 0;
+			controller.computeMuscleControls(states[f], u);
+			for(int i=0; i<n; ++i)
+				maxDifference = std::max(maxDifference, fabs(controls[i] - u[i]));
+		}
+		return maxDifference;
+	}
+
+	// largest difference between the delayed kernel and the controller,
+	// both sensing on the ticks only, from an empty history
+	double compareDelayedWithController(const DelayedPathReflexController& controller,
+		const vector<State>& states)
+	{
+		const Set<Actuator>& muscles = controller.getActuatorSet();
+		vector<double> speeds(DelayedStretch::NumMuscles);
+		vector<double> controls(DelayedStretch::NumMuscles);
+		Vector u(muscles.getSize());
+
+		controller.resetSimulationState();
+		DelayedStretch::State kernel;
+		DelayedStretch::reset(kernel);
+		double maxDifference = 0;
+		for(size_t f=0; f<states.size(); ++f){
+			for(int i=0; i<DelayedStretch::NumMuscles; ++i)
+				speeds[i] = static_cast<const Muscle&>(muscles[i]).getLengtheningSpeed(states[f]);
+			DelayedStretch::step(kernel, &speeds[0], &controls[0]);
+			u = 0;
+			controller.computeMuscleControls(states[f], u);
+			for(int i=0; i<DelayedStretch::NumMuscles; ++i)
+				maxDifference = std::max(maxDifference, fabs(controls[i] - u[i]));
+		}
+		return maxDifference;
+	}
+
+	// largest difference between the delayed kernel and a SignalDelayLine
+	// written the kernel's sensed signals on the same ticks and read at the
+	// configured delays. The speeds change sign, so that stretches start
+	// and stop throughout the history.
+	double compareDelayedWithLine(int numTicks)
+	{
+		const int n = DelayedStretch::NumMuscles;
+		SignalDelayLine line;
+		vector<int> channels(n);
+		vector<double> delays(n);
+		for(int i=0; i<n; ++i){
+			channels[i] = line.addChannel(DelayedStretch::MuscleNames[i]);
+			delays[i] = ReflexKernelModel::TickPeriod
+				*ReflexKernelModel::DelayTicks[i % ReflexKernelModel::NumDelays];
+			line.requireDelay(delays[i]);
+		}
+
+		DelayedStretch::State kernel;
+		DelayedStretch::reset(kernel);
+		vector<double> speeds(n), controls(n);
+		double maxDifference = 0;
+		for(int k=0; k<numTicks; ++k){
+			double time = k*ReflexKernelModel::TickPeriod;
+			for(int i=0; i<n; ++i)
+				speeds[i] = 0.3*sin(0.05*k + 0.7*i) + 0.1*sin(0.31*k*(i % 5 + 1));
+			DelayedStretch::step(kernel, &speeds[0], &controls[0]);
+
+			for(int i=0; i<n; ++i)
+				line.write(time, channels[i],
+					DelayedStretch::SpeedScale[i]*(fabs(speeds[i]) + speeds[i]));
+			for(int i=0; i<n; ++i){
+				double expected = DelayedStretch::Gain*line.read(channels[i], time - delays[i]);
+				maxDifference = std::max(maxDifference, fabs(controls[i] - expected));
+			}
+		}
+		return maxDifference;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		Model model(argc > 1 ? argv[1] : REFLEX_EXAMPLE_MODEL);
+		ReflexKernelModel::addDelayedController(model);
+		vector<State> states = recordTicks(model);
+
+		const ControllerSet& controllers = model.getControllerSet();
+		const MuscleReflexController& path =
+			static_cast<const MuscleReflexController&>(controllers.get("PathStretch"));
+		const MuscleReflexController& fiber =
+			static_cast<const MuscleReflexController&>(controllers.get("FiberStretch"));
+		const DelayedPathReflexController& delayed =
+			static_cast<const DelayedPathReflexController&>(controllers.get("DelayedStretch"));
+
+		bool passed = true;
+		cout << "kernel\tcompared_with\tmuscles\tticks\tmax_difference\tresult" << endl;
+		auto report = [&](const string& kernel, const string& reference,
+			bool sameOrder, int numMuscles, int numTicks, double difference) {
+			bool ok = sameOrder && difference <= Tolerance;
+			passed = passed && ok;
+			cout << setprecision(4) << kernel << '\t' << reference << '\t'
+				<< numMuscles << '\t' << numTicks << '\t' << difference << '\t'
+				<< (ok ? "pass" : sameOrder ? "FAIL" : "FAIL:muscle order") << endl;
+		};
+
+		int numTicks = (int)states.size();
+		bool pathOrder = sameMuscles(PathStretch::MuscleNames,
+			PathStretch::NumMuscles, path.getActuatorSet());
+		report("PathStretch", "computeMuscleControls", pathOrder,
+			PathStretch::NumMuscles, numTicks,
+			pathOrder ? compareStretch(path, false, PathStretch::step, states) : Infinity);
+		bool fiberOrder = sameMuscles(FiberStretch::MuscleNames,
+			FiberStretch::NumMuscles, fiber.getActuatorSet());
+		report("FiberStretch", "computeMuscleControls", fiberOrder,
+			FiberStretch::NumMuscles, numTicks,
+			fiberOrder ? compareStretch(fiber, true, FiberStretch::step, states) : Infinity);
+		bool delayedOrder = sameMuscles(DelayedStretch::MuscleNames,
+			DelayedStretch::NumMuscles, delayed.getActuatorSet());
+		report("DelayedStretch", "computeMuscleControls", delayedOrder,
+			DelayedStretch::NumMuscles, numTicks,
+			delayedOrder ? compareDelayedWithController(delayed, states) : Infinity);
+		report("DelayedStretch", "SignalDelayLine", true,
+			DelayedStretch::NumMuscles, NumLineTicks,
+			compareDelayedWithLine(NumLineTicks));
+
+		if(!passed){
+			cout << "testReflexKernel: FAILED" << endl;
+			return 1;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "testReflexKernel: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
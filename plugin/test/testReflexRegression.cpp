@@ -0,0 +1,174 @@
+/* -------------------------------------------------------------------------- *
+ *                     OpenSim:  testReflexRegression.cpp                     *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Regression test of the reflex controllers. Each reflex controller of the
+ * landing example lands on its own and is compared with its golden
+ * trajectory in the golden directory; its integration steps and heap
+ * allocations are checked against the budgets recorded there in
+ * budgets.txt. The evaluation time budget is wall-clock time of the host
+ * that recorded it, so it is only checked with --check-time.
+ *
+ * usage: testReflexRegression [--write-golden | --check-time] [model.osim]
+ *        [golden directory]
+ *
+ * With --write-golden the trajectories and budgets are recorded instead.
+ * Do that (the update_reflex_golden target does) only after a deliberate
+ * change in behavior, and commit the files.
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <OpenSim/OpenSim.h>
+#include "ReflexRegressionHarness.h"
+#include "RegisterTypes_osimPlugin.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <new>
+#include <sstream>
+
+using namespace OpenSim;
+using namespace std;
+
+namespace {
+	atomic<long long> numAllocations(0);
+
+	long long getNumAllocations()
+	{
+		return numAllocations.load(memory_order_relaxed);
+	}
+
+	// headroom of the recorded budgets over the measurements: the step
+	// count and allocations are deterministic, the time depends on the host
+	const double StepHeadroom = 1.1;
+	const double TimeHeadroom = 5.0;
+	const double AllocationHeadroom = 1.1;
+	const double AllocationSlack = 0.05;
+
+	string getBudgetFileName(const string& directory)
+	{
+		return directory + "/budgets.txt";
+	}
+
+	void writeBudgets(const string& fileName,
+		const vector<ReflexRegressionHarness::Measurement>& measurements)
+	{
+		ofstream out(fileName.c_str());
+		if(!out.good())
+			throw Exception("testReflexRegression: cannot write " + fileName + ".");
+		out << "# controller\tmax_steps\tmax_ns_per_evaluation\tmax_allocations_per_evaluation" << endl;
+		for(size_t i=0; i<measurements.size(); ++i){
+			const ReflexRegressionHarness::Measurement& m = measurements[i];
+			out << m.controller << '\t'
+				<< (int)ceil(StepHeadroom*m.numSteps) << '\t'
+				<< TimeHeadroom*m.nsPerEvaluation << '\t'
+				<< AllocationHeadroom*m.allocationsPerEvaluation + AllocationSlack << endl;
+		}
+	}
+
+	// the time budgets are dropped unless checkTime is set
+	void readBudgets(const string& fileName, bool checkTime,
+		ReflexRegressionHarness& harness)
+	{
+		ifstream in(fileName.c_str());
+		if(!in.good())
+			throw Exception("testReflexRegression: no budgets in " + fileName
+				+ "; record the golden files with --write-golden.");
+		string line;
+		while(getline(in, line)){
+			if(line.empty() || line[0] == '#')
+				continue;
+			istringstream fields(line);
+			string controller;
+			ReflexRegressionHarness::Budget budget;
+			if(!(fields >> controller >> budget.maxSteps >> budget.maxNsPerEvaluation
+				>> budget.maxAllocationsPerEvaluation))
+				throw Exception("testReflexRegression: bad budget line in "
+					+ fileName + ": " + line);
+			if(!checkTime)
+				budget.maxNsPerEvaluation = -1;
+			harness.setBudget(controller, budget);
+		}
+	}
+}
+
+// Count every heap allocation of the test, including those made inside the
+// plugin, for the allocation budgets.
+void* operator new(size_t size)
+{
+	numAllocations.fetch_add(1, memory_order_relaxed);
+	if(void* p = malloc(size ? size : 1))
+		return p;
+	throw bad_alloc();
+}
+void* operator new[](size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+
+int main(int argc, char* argv[])
+{
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		int a = 1;
+		bool writeGolden = argc > a && strcmp(argv[a], "--write-golden") == 0;
+		bool checkTime = argc > a && strcmp(argv[a], "--check-time") == 0;
+		if(writeGolden || checkTime)
+			++a;
+		string modelFile = argc > a ? argv[a] : REFLEX_EXAMPLE_MODEL;
+		string directory = argc > a+1 ? argv[a+1] : REFLEX_GOLDEN_DIR;
+
+		ReflexRegressionHarness harness(modelFile);
+		harness.setAllocationCounter(getNumAllocations);
+
+		if(writeGolden){
+			writeBudgets(getBudgetFileName(directory), harness.writeGolden(directory));
+			cout << "testReflexRegression: recorded golden files in " << directory << endl;
+			return 0;
+		}
+
+		vector<string> names = harness.getControllerNames();
+		for(size_t i=0; i<names.size(); ++i){
+			string golden = ReflexRegressionHarness::getGoldenFileName(directory, names[i]);
+			if(!ifstream(golden.c_str()).good())
+				throw Exception("testReflexRegression: missing " + golden
+					+ "; record the golden files with --write-golden.");
+		}
+		readBudgets(getBudgetFileName(directory), checkTime, harness);
+
+		if(!harness.check(directory, cout)){
+			cout << "testReflexRegression: FAILED" << endl;
+			return 1;
+		}
+	}
+	catch(const std::exception& x){
+		cout << "testReflexRegression: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,67 @@
+/* -------------------------------------------------------------------------- *
+ *                      OpenSim:  writeReflexKernels.cpp                      *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Export the kernels of the ReflexKernelModel controllers of the landing
+ * example as headers, one per controller, for testReflexKernel and
+ * benchReflexKernel to compile.
+ *
+ * usage: writeReflexKernels model.osim directory
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include "ReflexKernelModel.h"
+#include "ReflexKernelExporter.h"
+#include "RegisterTypes_osimPlugin.h"
+
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if(argc != 3){
+		cout << "usage: writeReflexKernels model.osim directory" << endl;
+		return 1;
+	}
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		Model model(argv[1]);
+		ReflexKernelModel::addDelayedController(model);
+
+		ReflexKernelExporter exporter(model);
+		exporter.setTickPeriod(ReflexKernelModel::TickPeriod);
+		for(int c=0; c<ReflexKernelModel::NumControllers; ++c){
+			string name = ReflexKernelModel::ControllerNames[c];
+			exporter.print(name, ReflexKernelModel::getKernelFileName(argv[2], name));
+		}
+	}
+	catch(const std::exception& x){
+		cout << "writeReflexKernels: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}
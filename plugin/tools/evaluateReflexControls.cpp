@@ -0,0 +1,64 @@
+/* -------------------------------------------------------------------------- *
+ *                    OpenSim:  evaluateReflexControls.cpp                    *
+ * -------------------------------------------------------------------------- *
+ * The OpenSim API is a toolkit for musculoskeletal modeling and simulation.  *
+ * See http://opensim.stanford.edu and the NOTICE file for more information.  *
+ * OpenSim is developed at Stanford University and supported by the US        *
+ * National Institutes of Health (U54 GM072970, R24 HD065690) and by DARPA    *
+ * through the Warrior Web program.                                           *
+ *                                                                            *
+ * Copyright (c) 2005-2013 Stanford University and the Authors                *
+ * Author(s): Matt DeMers                                                     *
+ *                                                                            *
+ * Licensed under the Apache License, Version 2.0 (the "License"); you may    *
+ * not use this file except in compliance with the License. You may obtain a  *
+ * copy of the License at http://www.apache.org/licenses/LICENSE-2.0.         *
+ *                                                                            *
+ * Unless required by applicable law or agreed to in writing, software        *
+ * distributed under the License is distributed on an "AS IS" BASIS,          *
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied    *
+ * See the License for the specific language governing permissions and        *
+ * limitations under the License.                                             *
+ * -------------------------------------------------------------------------- */
+
+/*
+ * Evaluate a reflex controller offline over a states file, such as one
+ * recorded by a forward simulation, and write its controls as a storage.
+ * See ReflexControlEvaluator.
+ *
+ * usage: evaluateReflexControls model.osim states.sto controller controls.sto [threads]
+ *
+ * threads defaults to 0, one per hardware thread.
+ */
+
+//=============================================================================
+// INCLUDES
+//=============================================================================
+#include <OpenSim/OpenSim.h>
+#include "ReflexControlEvaluator.h"
+#include "RegisterTypes_osimPlugin.h"
+
+#include <cstdlib>
+#include <iostream>
+
+using namespace OpenSim;
+using namespace std;
+
+int main(int argc, char* argv[])
+{
+	if(argc != 5 && argc != 6){
+		cout << "usage: evaluateReflexControls model.osim states.sto controller "
+			"controls.sto [threads]" << endl;
+		return 1;
+	}
+	try{
+		RegisterTypes_osimReflexesPlugin();
+		int numThreads = argc > 5 ? atoi(argv[5]) : 0;
+		ReflexControlEvaluator::evaluateFiles(argv[1], argv[2], argv[3], argv[4], numThreads);
+	}
+	catch(const std::exception& x){
+		cout << "evaluateReflexControls: " << x.what() << endl;
+		return 1;
+	}
+	return 0;
+}